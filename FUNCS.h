@@ -9,9 +9,12 @@
 /* Constructors */
 
 //lval constructors
+lval* lval_new(int type);
 lval* lval_num(long x);
 lval* lval_err(char* fmt, ...);
 lval* lval_sym(char* symbol);
+lval* lval_sym_len(char* symbol, long len);
+lval* lval_str_len(char* string, long len);
 lval* lval_fun(lbuiltin func);
 lval* lval_sexpr(void);
 lval* lval_qexpr(void);
@@ -47,6 +50,15 @@ void lval_print_str(lval* v);
 lval* lenv_get(lenv* e, lval* k);
 void lenv_put(lenv* e, lval* k, lval* v);
 lenv* lenv_copy(lenv* e);
+void lenv_bind(lenv* e, lval* k, lval* v);
+
+//Caches of global bindings
+lsite* lsite_new(void);
+void lsite_del(lsite* s);
+int lglobals_local(char* name);
+void lglobals_add(char* name);
+void lglobals_lambda(lval* f);
+lval* lsite_get(lenv* e, lval* k);
 
 
 
@@ -58,12 +70,130 @@ lval* lval_eval_sexpr(lenv* e, lval* v);
 
 //Reading
 lval* lval_read_num(mpc_ast_t* t);
+lval* lval_read_str(mpc_ast_t* t);
 lval* lval_read(mpc_ast_t* t);
+lval* lval_load(lenv* e, mpc_stream_t* s, mpc_arena_t* arena, lcache* c);
+lval* lval_load_stdin(lenv* e);
+lval* builtin_load_native(lenv* e, lval* a);
+
+//Binary cache of read forms
+uint64_t lcache_hash(const char* text, long size);
+char* lcache_path(uint64_t hash);
+lval* lcache_open(lcache* c, char* filename);
+lval* lcache_read(lcache* c);
+int lcache_decode_varint(char** p, char* end, uint64_t* x);
+lval* lcache_decode(char** p, char* end);
+lenv* lcache_decode_env(char** p, char* end);
+char* lcache_reserve(lcache* c, long n);
+void lcache_encode_varint(lcache* c, uint64_t x);
+void lcache_encode_text(lcache* c, char* s);
+void lcache_encode(lcache* c, lval* v);
+void lcache_encode_env(lcache* c, lenv* e);
+void lcache_add(lcache* c, lval* x);
+int lcache_write(char* path, void* header, long size, char* data, long length);
+void lcache_mkdirs(char* path);
+void lcache_save(lcache* c);
+void lcache_delete(lcache* c);
+
+//Loading files in parallel
+lval* lload_read(char* filename, lval** err);
+void* lload_worker(void* arg);
+lval* lload_eval(lenv* e, lval* expr, lval* err);
+void lload_files(lenv* e, int count, char** filenames);
+
+//Loading a large file in parallel chunks
+int lload_scan(char* text, long size, int chunks, mpc_state_t* starts);
+int lload_bound(const char* text, long size, void* state);
+lval* lload_forms(mpc_stream_t* s, mpc_arena_t* arena, lcache* c, lval** err);
+void* lload_chunk(void* arg);
+lval* lload_split(char* filename, char* text, long size, lval** err);
 
 
 
 void lenv_add_builtin(lenv* e, char* name, lbuiltin func);
 void lenv_add_builtins(lenv* e);
+int lbuiltin_index(lbuiltin func);
+lbuiltin lbuiltin_get(uint64_t i);
+char* lbuiltin_get_name(lbuiltin func);
+uint64_t lbuiltins_hash(void);
+
+//Heap images
+lval* limage_dump(lenv* e, char* filename);
+lenv* limage_load(char* filename);
+
+//Profiling
+double lprof_now(void);
+void lprof_sample(int sig);
+void lprof_start(int mode);
+void lprof_stop(void);
+void lprof_node_del(lprof_node* n);
+void lprof_clear(void);
+int lprof_intern(char* name);
+void lprof_enter(lval* f, char* name);
+void lprof_leave(void);
+double lprof_self(lprof_node* n);
+double lprof_sum(lprof_node* n, long* calls, double* self, double* total, int* active);
+void lprof_report(FILE* f);
+void lprof_folded_node(FILE* f, lprof_node* n, lprof_node** path, int depth);
+void lprof_folded(FILE* f);
+lval* lprof_save(char* filename);
+lval* builtin_profile(lenv* e, lval* a);
+
+//Memory statistics
+int lstats_read(char names[][LSTATS_NAME], unsigned long* values);
+lval* builtin_memstats(lenv* e, lval* a);
+void lstats_dump(void);
+double ltime_since(clockid_t clock, struct timespec* start);
+lval* builtin_time(lenv* e, lval* a);
+
+//Event trace
+uint64_t ltrace_ticks(void);
+int64_t ltrace_ns(void);
+ltrace_ring* ltrace_ring_new(void);
+void ltrace_emit(int kind, uint32_t id);
+uint32_t ltrace_intern(char* text, long len);
+uint32_t ltrace_site(lval* k);
+int ltrace_write(int fd, void* data, long size);
+int ltrace_save(char* filename);
+void ltrace_signal(int sig);
+void ltrace_start(char* filename);
+void ltrace_error(void);
+lval* builtin_trace_dump(lenv* e, lval* a);
+
+//Compiling to C
+void lcompile_indent(FILE* f, int depth);
+void lcompile_text(FILE* f, char* s);
+int lcompile_sym(lcompile* c, char* name);
+int lcompile_param(lcompile* c, char* name);
+int lcompile_build(lcompile* c, FILE* f, lval* v, int depth);
+int lcompile_const(lcompile* c, lval* v);
+int lcompile_expr(lcompile* c, FILE* f, lval* x, int depth);
+int lcompile_if(lcompile* c, FILE* f, lval* x, int depth);
+int lcompile_sexpr(lcompile* c, FILE* f, lval* x, int depth);
+int lcompile_is_function(lval* x);
+void lcompile_function(lcompile* c, lval* x);
+void lcompile_form(lcompile* c, lval* x);
+lval* lcompile_files(char* out, int count, char** filenames);
+
+//Native code for hot lambdas
+ljit* ljit_new(void);
+void ljit_del(ljit* j);
+lval* ljit_lookup(lenv* e, char* sym);
+int ljit_guard(lenv* e, ljit* j);
+void ljit_emit(ljit_code* c, int n, ...);
+void ljit_emit_32(ljit_code* c, uint32_t x);
+void ljit_patch(ljit_code* c, long at);
+void ljit_fail(ljit_code* c, int cond);
+void ljit_check(ljit_code* c);
+int ljit_param(ljit_code* c, char* name);
+void ljit_need(ljit_code* c, char* name, lbuiltin func);
+int ljit_expr(ljit_code* c, lval* x);
+int ljit_args(ljit_code* c, lval* x);
+int ljit_sexpr(ljit_code* c, lval* x);
+char* ljit_name(lenv* e, ljit* j);
+void ljit_map(ljit* j, char* name);
+int ljit_compile(lenv* e, lval* f);
+lval* ljit_call(lenv* e, lval* f, lval* a);
 
 
 
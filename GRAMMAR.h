@@ -0,0 +1,377 @@
+/*
+** Generated by mpc_codegen from lipl.mpca, do not edit.
+*/
+
+/* <number> */
+static long lipl_grammar_scan0(const char *s, long n, long *len) {
+
+  const unsigned char *c = (const unsigned char*)s, *e = c + n;
+
+  {
+    const unsigned char *b1 = c;
+    {
+      static const unsigned char k[32] = {0x00,0x00,0x00,0x00,0x00,0x20,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
+      if (c == e || !(k[*c >> 3] >> (*c & 7) & 1)) { goto f1; }
+      c++;
+    }
+    goto d1;
+    f1: c = b1;
+    d1: ;
+  }
+  {
+    static const unsigned char k[32] = {0x01,0x00,0x00,0x00,0x00,0x00,0xff,0x03,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
+    if (c == e || !(k[*c >> 3] >> (*c & 7) & 1)) { goto f0; }
+    c++;
+  }
+  {
+    static const unsigned char k[32] = {0x01,0x00,0x00,0x00,0x00,0x00,0xff,0x03,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
+    while (c < e && k[*c >> 3] >> (*c & 7) & 1) { c++; }
+  }
+  *len = (long)(c - (const unsigned char*)s);
+  {
+    static const unsigned char k[32] = {0x01,0x3e,0x00,0x00,0x01,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
+    while (c < e && k[*c >> 3] >> (*c & 7) & 1) { c++; }
+  }
+  return (long)(c - (const unsigned char*)s);
+
+  f0: return -1;
+
+}
+
+/* <symbol> */
+static long lipl_grammar_scan1(const char *s, long n, long *len) {
+
+  const unsigned char *c = (const unsigned char*)s, *e = c + n;
+
+  {
+    static const unsigned char k[32] = {0x01,0x00,0x00,0x00,0x42,0xac,0xff,0x73,0xfe,0xff,0xff,0x97,0xfe,0xff,0xff,0x07,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
+    if (c == e || !(k[*c >> 3] >> (*c & 7) & 1)) { goto f0; }
+    c++;
+  }
+  {
+    static const unsigned char k[32] = {0x01,0x00,0x00,0x00,0x42,0xac,0xff,0x73,0xfe,0xff,0xff,0x97,0xfe,0xff,0xff,0x07,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
+    while (c < e && k[*c >> 3] >> (*c & 7) & 1) { c++; }
+  }
+  *len = (long)(c - (const unsigned char*)s);
+  {
+    static const unsigned char k[32] = {0x01,0x3e,0x00,0x00,0x01,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
+    while (c < e && k[*c >> 3] >> (*c & 7) & 1) { c++; }
+  }
+  return (long)(c - (const unsigned char*)s);
+
+  f0: return -1;
+
+}
+
+/* <string> */
+static long lipl_grammar_scan2(const char *s, long n, long *len) {
+
+  const unsigned char *c = (const unsigned char*)s, *e = c + n;
+
+  {
+    static const unsigned char k[32] = {0x00,0x00,0x00,0x00,0x04,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
+    if (c == e || !(k[*c >> 3] >> (*c & 7) & 1)) { goto f0; }
+    c++;
+  }
+  for (;;) {
+    const unsigned char *b2 = c;
+    {
+      const unsigned char *b3 = c;
+      {
+        static const unsigned char k[32] = {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
+        if (c == e || !(k[*c >> 3] >> (*c & 7) & 1)) { goto f4; }
+        c++;
+      }
+      {
+        static const unsigned char k[32] = {0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff};
+        if (c == e || !(k[*c >> 3] >> (*c & 7) & 1)) { goto f4; }
+        c++;
+      }
+      goto d3;
+      f4: c = b3;
+      {
+        static const unsigned char k[32] = {0xfe,0xff,0xff,0xff,0xfb,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff};
+        if (c == e || !(k[*c >> 3] >> (*c & 7) & 1)) { goto f2; }
+        c++;
+      }
+      d3: ;
+    }
+    if (c == b2) { break; }
+    continue;
+    f2: c = b2;
+    break;
+  }
+  {
+    static const unsigned char k[32] = {0x00,0x00,0x00,0x00,0x04,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
+    if (c == e || !(k[*c >> 3] >> (*c & 7) & 1)) { goto f0; }
+    c++;
+  }
+  *len = (long)(c - (const unsigned char*)s);
+  {
+    static const unsigned char k[32] = {0x01,0x3e,0x00,0x00,0x01,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
+    while (c < e && k[*c >> 3] >> (*c & 7) & 1) { c++; }
+  }
+  return (long)(c - (const unsigned char*)s);
+
+  f0: return -1;
+
+}
+
+/* <comment> */
+static long lipl_grammar_scan3(const char *s, long n, long *len) {
+
+  const unsigned char *c = (const unsigned char*)s, *e = c + n;
+
+  {
+    static const unsigned char k[32] = {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x08,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
+    if (c == e || !(k[*c >> 3] >> (*c & 7) & 1)) { goto f0; }
+    c++;
+  }
+  {
+    static const unsigned char k[32] = {0xfe,0xdb,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff};
+    while (c < e && k[*c >> 3] >> (*c & 7) & 1) { c++; }
+  }
+  *len = (long)(c - (const unsigned char*)s);
+  {
+    static const unsigned char k[32] = {0x01,0x3e,0x00,0x00,0x01,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
+    while (c < e && k[*c >> 3] >> (*c & 7) & 1) { c++; }
+  }
+  return (long)(c - (const unsigned char*)s);
+
+  f0: return -1;
+
+}
+
+static long lipl_grammar_scan4(const char *s, long n, long *len) {
+
+  const unsigned char *c = (const unsigned char*)s, *e = c + n;
+
+  {
+    static const unsigned char k[32] = {0x00,0x00,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
+    if (c == e || !(k[*c >> 3] >> (*c & 7) & 1)) { goto f0; }
+    c++;
+  }
+  *len = (long)(c - (const unsigned char*)s);
+  {
+    static const unsigned char k[32] = {0x01,0x3e,0x00,0x00,0x01,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
+    while (c < e && k[*c >> 3] >> (*c & 7) & 1) { c++; }
+  }
+  return (long)(c - (const unsigned char*)s);
+
+  f0: return -1;
+
+}
+
+static long lipl_grammar_scan5(const char *s, long n, long *len) {
+
+  const unsigned char *c = (const unsigned char*)s, *e = c + n;
+
+  {
+    static const unsigned char k[32] = {0x00,0x00,0x00,0x00,0x00,0x02,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
+    if (c == e || !(k[*c >> 3] >> (*c & 7) & 1)) { goto f0; }
+    c++;
+  }
+  *len = (long)(c - (const unsigned char*)s);
+  {
+    static const unsigned char k[32] = {0x01,0x3e,0x00,0x00,0x01,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
+    while (c < e && k[*c >> 3] >> (*c & 7) & 1) { c++; }
+  }
+  return (long)(c - (const unsigned char*)s);
+
+  f0: return -1;
+
+}
+
+static long lipl_grammar_scan6(const char *s, long n, long *len) {
+
+  const unsigned char *c = (const unsigned char*)s, *e = c + n;
+
+  {
+    static const unsigned char k[32] = {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x08,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
+    if (c == e || !(k[*c >> 3] >> (*c & 7) & 1)) { goto f0; }
+    c++;
+  }
+  *len = (long)(c - (const unsigned char*)s);
+  {
+    static const unsigned char k[32] = {0x01,0x3e,0x00,0x00,0x01,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
+    while (c < e && k[*c >> 3] >> (*c & 7) & 1) { c++; }
+  }
+  return (long)(c - (const unsigned char*)s);
+
+  f0: return -1;
+
+}
+
+static long lipl_grammar_scan7(const char *s, long n, long *len) {
+
+  const unsigned char *c = (const unsigned char*)s, *e = c + n;
+
+  {
+    static const unsigned char k[32] = {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x20,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
+    if (c == e || !(k[*c >> 3] >> (*c & 7) & 1)) { goto f0; }
+    c++;
+  }
+  *len = (long)(c - (const unsigned char*)s);
+  {
+    static const unsigned char k[32] = {0x01,0x3e,0x00,0x00,0x01,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
+    while (c < e && k[*c >> 3] >> (*c & 7) & 1) { c++; }
+  }
+  return (long)(c - (const unsigned char*)s);
+
+  f0: return -1;
+
+}
+
+static void lipl_grammar(mpc_parser_t *number, mpc_parser_t *symbol, mpc_parser_t *string, mpc_parser_t *comment, mpc_parser_t *sexpr, mpc_parser_t *qexpr, mpc_parser_t *expr, mpc_parser_t *lipl) {
+
+  mpc_parser_t *ps[8];
+
+  mpc_define(number, mpca_scan(lipl_grammar_scan0, "regex",
+      mpc_and(2, mpcf_state_ast,
+        mpc_state(),
+        mpca_tag(mpc_apply(mpc_and(2, mpcf_fst,
+          mpc_and(2, mpcf_strfold,
+            mpc_maybe_lift(mpc_expect(mpc_char('-'), "\'-\'"), mpcf_ctor_str),
+            mpc_many1(mpcf_strfold,
+              mpc_expect(mpc_oneof("0123456789"), "one of \'0123456789\'")), free),
+          mpc_expect(mpc_apply(mpc_expect(mpc_many(mpcf_strfold,
+            mpc_expect(mpc_expect(mpc_oneof(" \f\n\r\t\v"), "one of \' \f\n\r\t\v\'"), "whitespace")), "spaces"), mpcf_free), "whitespace"), mpcf_dtor_null), mpcf_str_ast), "regex"), free)));
+
+  mpc_define(symbol, mpca_scan(lipl_grammar_scan1, "regex",
+      mpc_and(2, mpcf_state_ast,
+        mpc_state(),
+        mpca_tag(mpc_apply(mpc_and(2, mpcf_fst,
+          mpc_many1(mpcf_strfold,
+            mpc_expect(mpc_oneof("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_+-*/\\=<>!&"), "one of \'abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_+-*/\\=<>!&\'")),
+          mpc_expect(mpc_apply(mpc_expect(mpc_many(mpcf_strfold,
+            mpc_expect(mpc_expect(mpc_oneof(" \f\n\r\t\v"), "one of \' \f\n\r\t\v\'"), "whitespace")), "spaces"), mpcf_free), "whitespace"), mpcf_dtor_null), mpcf_str_ast), "regex"), free)));
+
+  mpc_define(string, mpca_scan(lipl_grammar_scan2, "regex",
+      mpc_and(2, mpcf_state_ast,
+        mpc_state(),
+        mpca_tag(mpc_apply(mpc_and(2, mpcf_fst,
+          mpc_and(3, mpcf_strfold,
+            mpc_expect(mpc_char('\"'), "\'\"\'"),
+            mpc_many(mpcf_strfold,
+              mpc_or(2,
+                mpc_and(2, mpcf_strfold,
+                  mpc_expect(mpc_char('\\'), "\'\\\'"),
+                  mpc_expect(mpc_any(), "any character"), free),
+                mpc_expect(mpc_noneof("\""), "none of \'\"\'"))),
+            mpc_expect(mpc_char('\"'), "\'\"\'"), free, free),
+          mpc_expect(mpc_apply(mpc_expect(mpc_many(mpcf_strfold,
+            mpc_expect(mpc_expect(mpc_oneof(" \f\n\r\t\v"), "one of \' \f\n\r\t\v\'"), "whitespace")), "spaces"), mpcf_free), "whitespace"), mpcf_dtor_null), mpcf_str_ast), "regex"), free)));
+
+  mpc_define(comment, mpca_scan(lipl_grammar_scan3, "regex",
+      mpc_and(2, mpcf_state_ast,
+        mpc_state(),
+        mpca_tag(mpc_apply(mpc_and(2, mpcf_fst,
+          mpc_and(2, mpcf_strfold,
+            mpc_expect(mpc_char(';'), "\';\'"),
+            mpc_many(mpcf_strfold,
+              mpc_expect(mpc_noneof("\r\n"), "none of \'\r\n\'")), free),
+          mpc_expect(mpc_apply(mpc_expect(mpc_many(mpcf_strfold,
+            mpc_expect(mpc_expect(mpc_oneof(" \f\n\r\t\v"), "one of \' \f\n\r\t\v\'"), "whitespace")), "spaces"), mpcf_free), "whitespace"), mpcf_dtor_null), mpcf_str_ast), "regex"), free)));
+
+  mpc_define(sexpr, mpc_and(3, mpcf_fold_ast,
+      mpca_scan(lipl_grammar_scan4, "char",
+        mpc_and(2, mpcf_state_ast,
+          mpc_state(),
+          mpca_tag(mpc_apply(mpc_and(2, mpcf_fst,
+            mpc_expect(mpc_char('('), "\'(\'"),
+            mpc_expect(mpc_apply(mpc_expect(mpc_many(mpcf_strfold,
+              mpc_expect(mpc_expect(mpc_oneof(" \f\n\r\t\v"), "one of \' \f\n\r\t\v\'"), "whitespace")), "spaces"), mpcf_free), "whitespace"), mpcf_dtor_null), mpcf_str_ast), "char"), free)),
+      mpc_many(mpcf_fold_ast,
+        mpc_and(2, mpcf_state_ast,
+          mpc_state(),
+          mpca_root(mpca_add_tag(expr, "expr")), free)),
+      mpca_scan(lipl_grammar_scan5, "char",
+        mpc_and(2, mpcf_state_ast,
+          mpc_state(),
+          mpca_tag(mpc_apply(mpc_and(2, mpcf_fst,
+            mpc_expect(mpc_char(')'), "\')\'"),
+            mpc_expect(mpc_apply(mpc_expect(mpc_many(mpcf_strfold,
+              mpc_expect(mpc_expect(mpc_oneof(" \f\n\r\t\v"), "one of \' \f\n\r\t\v\'"), "whitespace")), "spaces"), mpcf_free), "whitespace"), mpcf_dtor_null), mpcf_str_ast), "char"), free)), (mpc_dtor_t)mpc_ast_delete, (mpc_dtor_t)mpc_ast_delete));
+
+  mpc_define(qexpr, mpc_and(3, mpcf_fold_ast,
+      mpca_scan(lipl_grammar_scan6, "char",
+        mpc_and(2, mpcf_state_ast,
+          mpc_state(),
+          mpca_tag(mpc_apply(mpc_and(2, mpcf_fst,
+            mpc_expect(mpc_char('{'), "\'{\'"),
+            mpc_expect(mpc_apply(mpc_expect(mpc_many(mpcf_strfold,
+              mpc_expect(mpc_expect(mpc_oneof(" \f\n\r\t\v"), "one of \' \f\n\r\t\v\'"), "whitespace")), "spaces"), mpcf_free), "whitespace"), mpcf_dtor_null), mpcf_str_ast), "char"), free)),
+      mpc_many(mpcf_fold_ast,
+        mpc_and(2, mpcf_state_ast,
+          mpc_state(),
+          mpca_root(mpca_add_tag(expr, "expr")), free)),
+      mpca_scan(lipl_grammar_scan7, "char",
+        mpc_and(2, mpcf_state_ast,
+          mpc_state(),
+          mpca_tag(mpc_apply(mpc_and(2, mpcf_fst,
+            mpc_expect(mpc_char('}'), "\'}\'"),
+            mpc_expect(mpc_apply(mpc_expect(mpc_many(mpcf_strfold,
+              mpc_expect(mpc_expect(mpc_oneof(" \f\n\r\t\v"), "one of \' \f\n\r\t\v\'"), "whitespace")), "spaces"), mpcf_free), "whitespace"), mpcf_dtor_null), mpcf_str_ast), "char"), free)), (mpc_dtor_t)mpc_ast_delete, (mpc_dtor_t)mpc_ast_delete));
+
+  mpc_define(expr, mpc_or(6,
+      mpc_and(2, mpcf_state_ast,
+        mpc_state(),
+        mpca_root(mpca_add_tag(number, "number")), free),
+      mpc_and(2, mpcf_state_ast,
+        mpc_state(),
+        mpca_root(mpca_add_tag(string, "string")), free),
+      mpc_and(2, mpcf_state_ast,
+        mpc_state(),
+        mpca_root(mpca_add_tag(comment, "comment")), free),
+      mpc_and(2, mpcf_state_ast,
+        mpc_state(),
+        mpca_root(mpca_add_tag(symbol, "symbol")), free),
+      mpc_and(2, mpcf_state_ast,
+        mpc_state(),
+        mpca_root(mpca_add_tag(sexpr, "sexpr")), free),
+      mpc_and(2, mpcf_state_ast,
+        mpc_state(),
+        mpca_root(mpca_add_tag(qexpr, "qexpr")), free)));
+
+  mpc_define(lipl, mpc_and(3, mpcf_fold_ast,
+      mpc_and(2, mpcf_state_ast,
+        mpc_state(),
+        mpca_tag(mpc_apply(mpc_and(2, mpcf_fst,
+          mpc_and(2, mpcf_snd,
+            mpc_soi(),
+            mpc_lift(mpcf_ctor_str), free),
+          mpc_expect(mpc_apply(mpc_expect(mpc_many(mpcf_strfold,
+            mpc_expect(mpc_expect(mpc_oneof(" \f\n\r\t\v"), "one of \' \f\n\r\t\v\'"), "whitespace")), "spaces"), mpcf_free), "whitespace"), mpcf_dtor_null), mpcf_str_ast), "regex"), free),
+      mpc_many(mpcf_fold_ast,
+        mpc_and(2, mpcf_state_ast,
+          mpc_state(),
+          mpca_root(mpca_add_tag(expr, "expr")), free)),
+      mpc_and(2, mpcf_state_ast,
+        mpc_state(),
+        mpca_tag(mpc_apply(mpc_and(2, mpcf_fst,
+          mpc_and(2, mpcf_snd,
+            mpc_eoi(),
+            mpc_lift(mpcf_ctor_str), free),
+          mpc_expect(mpc_apply(mpc_expect(mpc_many(mpcf_strfold,
+            mpc_expect(mpc_expect(mpc_oneof(" \f\n\r\t\v"), "one of \' \f\n\r\t\v\'"), "whitespace")), "spaces"), mpcf_free), "whitespace"), mpcf_dtor_null), mpcf_str_ast), "regex"), free), (mpc_dtor_t)mpc_ast_delete, (mpc_dtor_t)mpc_ast_delete));
+
+  mpc_optimise(number);
+  mpc_optimise(symbol);
+  mpc_optimise(string);
+  mpc_optimise(comment);
+  mpc_optimise(sexpr);
+  mpc_optimise(qexpr);
+  mpc_optimise(expr);
+  mpc_optimise(lipl);
+
+  ps[0] = number;
+  ps[1] = symbol;
+  ps[2] = string;
+  ps[3] = comment;
+  ps[4] = sexpr;
+  ps[5] = qexpr;
+  ps[6] = expr;
+  ps[7] = lipl;
+  mpc_analyse_grammar(8, ps);
+
+}
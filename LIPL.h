@@ -0,0 +1,125 @@
+#ifndef LIPL_H
+#define LIPL_H
+
+/*
+** Interface for native modules, loaded with (load-native "path.so").
+**
+** A module is a shared object defining its builtins and registering them
+** from lipl_init, which LIPL_MODULE declares:
+**
+**     #include "LIPL.h"
+**
+**     lval* builtin_square(lenv* e, lval* a) {
+**         if (a->count != 1 || a->cell[0]->type != LVAL_NUM) {
+**             lval_del(a);
+**             return lval_err("Function 'square' takes a number.");
+**         }
+**
+**         lval* x = lval_take(a, 0);
+**         x->num *= x->num;
+**         return x;
+**     }
+**
+**     LIPL_MODULE {
+**         lenv_add_builtin(e, "square", builtin_square);
+**         return 0;
+**     }
+**
+**     cc -shared -fPIC square.c -o square.so
+**
+** A builtin owns its arguments a, and must delete them or hand them on.
+** It returns a new lval, an error made with lval_err to fail. Anything
+** which changes in this file bumps LIPL_ABI, and modules built against
+** another version are refused.
+*/
+
+#include <stddef.h>
+
+enum { LIPL_ABI = 4 };
+
+enum { LVAL_NUM, LVAL_ERR, LVAL_SYM, LVAL_STR, LVAL_SEXPR, LVAL_QEXPR, LVAL_FUN };
+
+//Forward Declarations
+//TODO: Figure out how this works, and why it can't be simplified
+struct lval;
+struct lenv;
+struct ljit;
+struct lsite;
+typedef struct lenv lenv;
+typedef struct lval lval;
+
+//TODO: Figure out how functional pointer works
+typedef lval*(*lbuiltin)(lenv*, lval*);
+
+// lval type
+struct lval{
+	int type;
+
+	/* Basic */
+	long num;
+	char* err;
+	char* sym;
+	struct lsite* site;
+	char* str;
+	
+	/* Function Related */
+	lbuiltin builtin;
+	lenv* env;
+	lval* formals;
+	lval* body;
+	struct ljit* jit;
+
+	/* Expression */
+	int count;
+	lval** cell;
+};
+
+// env type
+struct lenv {
+	lenv* parent;
+	int count;
+	char** syms;
+	lval** vals;
+};
+
+// entry point of a native module, nonzero if it could not start
+typedef int (*lipl_init_func)(lenv* e);
+
+#define LIPL_MODULE \
+	const int lipl_abi = LIPL_ABI; \
+	int lipl_init(lenv* e)
+
+/* Functions of the interpreter open to modules */
+
+lval* lval_num(long x);
+lval* lval_err(char* fmt, ...);
+lval* lval_sym(char* symbol);
+lval* lval_str(char* string);
+lval* lval_sexpr(void);
+lval* lval_qexpr(void);
+
+void lval_del(lval* v);
+lval* lval_copy(lval* v);
+lval* lval_add(lval* v, lval* x);
+lval* lval_pop(lval* v, int i);
+lval* lval_take(lval* v, int i);
+void lval_println(lval* v);
+char* ltype_name(int t);
+
+lval* lval_eval(lenv* e, lval* v);
+lval* lval_call(lenv* e, lval* f, lval* a);
+
+lenv* lenv_new(void);
+void lenv_del(lenv* e);
+
+lval* lenv_get(lenv* e, lval* k);
+void lenv_put(lenv* e, lval* k, lval* v);
+// binds k in e alone, only for a name some lambda already takes as an argument, lenv_put otherwise
+void lenv_bind(lenv* e, lval* k, lval* v);
+void lenv_def(lenv* e, lval* k, lval* v);
+void lenv_add_builtin(lenv* e, char* name, lbuiltin func);
+
+// a cache for a symbol's site field, through which lenv_get finds the symbol's global binding again without a search
+struct lsite* lsite_new(void);
+
+#endif
@@ -1,40 +1,247 @@
 #define TYPES_H
 
-//Forward Declarations
-//TODO: Figure out how this works, and why it can't be simplified
-struct lval;
-struct lenv;
-typedef struct lenv lenv;
-typedef struct lval lval;
-
-//TODO: Figure out how functional pointer works
-typedef lval*(*lbuiltin)(lenv*, lval*);
-
-// lval type
-struct lval{
-	int type;
-
-	/* Basic */
-	long num;
-	char* err;
-	char* sym;
-	char* str;
-	
-	/* Function Related */
-	lbuiltin builtin;
-	lenv* env;
-	lval* formals;
-	lval* body;
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include "LIPL.h"
+
+// global binding found for a symbol at the head of a list, shared by the symbol's copies and good while version holds,
+// and the symbol's trace id once it has been traced
+typedef struct lsite {
+	int refs;
+	unsigned long version;
+	lval* value;
+	uint32_t trace;
+} lsite;
+
+// version of the global environment, bumped when it changes or a name is first bound anywhere else, and those names
+typedef struct {
+	unsigned long version;
+	char** locals;
+	int locals_count;
+	int locals_slots;
+} lglobals;
+
+// file parsed and read by a loader thread ahead of its evaluation, with the parse error that ended it
+typedef struct {
+	char* filename;
+	lval* expr;
+	lval* err;
+	int ready;
+} lload;
 
-	/* Expression */
+// files shared out between the loader threads
+typedef struct {
+	lload* loads;
 	int count;
-	lval** cell;
-};
+	int next;
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+} lpool;
+
+// part of a large file parsed on its own thread, with the parse error that ended it
+typedef struct {
+	char* filename;
+	char* text;
+	mpc_state_t start;
+	long end;
+	lval* expr;
+	lval* err;
+} lchunk;
 
-// env type
-struct lenv {
-	lenv* parent;
+// brackets left open by the lines of a piped stream so far, and the string or comment it is in
+typedef struct {
+	int depth;
+	char in;
+} lbound;
+
+// forms read from a file, encoded for the binary cache as they go
+typedef struct {
+	char* path;
+	char* text;
+	uint64_t hash;
+	long size;
+	int failed;
 	int count;
-	char** syms;
-	lval** vals;
+	char* data;
+	long length;
+	long slots;
+} lcache;
+
+// .lplc file header, the encoded forms follow it
+typedef struct {
+	char magic[4];
+	uint32_t order;
+	uint64_t hash;
+	int64_t size;
+	int64_t length;
+	int32_t count;
+	int32_t version;
+} lcache_header;
+
+// builtin as listed in the table of builtins
+typedef struct {
+	char* name;
+	lbuiltin func;
+} lbuiltin_name;
+
+// image file header, the encoded global environment follows it
+typedef struct {
+	char magic[4];
+	uint32_t order;
+	uint64_t builtins;
+	int64_t length;
+	int32_t version;
+	int32_t reserved;
+} limage_header;
+
+// call path in the profiler's tree, one node per distinct stack of functions
+typedef struct lprof_node {
+	int func;
+	long calls;
+	double self;
+	volatile sig_atomic_t samples;
+	struct lprof_node* parent;
+	struct lprof_node* child;
+	struct lprof_node* next;
+} lprof_node;
+
+// call in progress on the profiler's shadow stack
+typedef struct {
+	lprof_node* node;
+	double start;
+	double inner;
+} lprof_frame;
+
+// profiler state, functions go by the symbol they were called through or their builtin name
+typedef struct {
+	int mode;
+	int sampled;
+	char** names;
+	int names_count;
+	lprof_node root;
+	lprof_node* volatile current;
+	lprof_frame* frames;
+	int depth;
+	int deepest;
+	int slots;
+} lprof;
+
+// allocation and copy counters, kept only in builds with LIPL_STATS
+enum { LSTATS_TYPES = 7, LSTATS_MAX = 32, LSTATS_NAME = 24 };
+
+typedef struct {
+	_Atomic unsigned long allocs[LSTATS_TYPES];
+	_Atomic unsigned long frees[LSTATS_TYPES];
+	_Atomic unsigned long string_bytes;
+	_Atomic unsigned long cell_bytes;
+	_Atomic unsigned long env_bytes;
+	_Atomic unsigned long lval_copies;
+	_Atomic unsigned long lval_copy_nodes;
+	_Atomic unsigned long lenv_copies;
+	_Atomic unsigned long lenv_copy_entries;
+	_Atomic unsigned long lookups;
+	_Atomic unsigned long lookup_depth;
+	_Atomic unsigned long lookup_depth_max;
+} lstats;
+
+// event trace, a ring of the latest events on each thread written out on error, signal or demand
+enum { LTRACE_EVENTS = 1 << 16, LTRACE_NAMES = 1024, LTRACE_NAME = 44 };
+enum { LTRACE_VERSION = 1, LTRACE_ORDER = 0x01020304 };
+
+enum {
+	LTRACE_ENTER, LTRACE_EXIT, LTRACE_BUILTIN, LTRACE_LOAD_START, LTRACE_LOAD_END,
+	LTRACE_PARSE_START, LTRACE_PARSE_END, LTRACE_ERROR, LTRACE_KINDS
 };
+
+// event as written to the trace file, its id names a function, file or error message
+typedef struct {
+	uint64_t time;
+	uint32_t id;
+	uint32_t kind;
+} ltrace_event;
+
+// id of a name and as much of the name as fits, an id of 0 is an empty slot
+typedef struct {
+	uint32_t id;
+	char name[LTRACE_NAME];
+} ltrace_symbol;
+
+// one thread's events, next counts every event so far and wraps around the ring
+typedef struct ltrace_ring {
+	struct ltrace_ring* link;
+	int32_t thread;
+	int32_t names_count;
+	uint64_t next;
+	ltrace_symbol names[LTRACE_NAMES];
+	ltrace_event events[LTRACE_EVENTS];
+} ltrace_ring;
+
+// tracer state, rings are never freed once made so a signal can write them out at any time
+typedef struct {
+	int on;
+	char* file;
+	ltrace_ring* volatile rings;
+	int threads;
+	pthread_mutex_t lock;
+	uint64_t ticks;
+	int64_t ns;
+} ltrace;
+
+// trace file header, each ring follows as its thread, count of events so far, names and events
+typedef struct {
+	char magic[4];
+	uint32_t order;
+	int32_t version;
+	int32_t rings;
+	uint64_t ticks[2];
+	int64_t ns[2];
+	int32_t events;
+	int32_t names;
+} ltrace_header;
+
+// compiler from lipl to C, each part of the output is written to its own stream and put together at the end
+enum { LCOMPILE_CODE, LCOMPILE_INIT, LCOMPILE_CONSTS, LCOMPILE_STREAMS };
+
+typedef struct {
+	FILE* out[LCOMPILE_STREAMS];
+	char* text[LCOMPILE_STREAMS];
+	size_t size[LCOMPILE_STREAMS];
+	char** syms;
+	int syms_count;
+	int consts_count;
+	int fns_count;
+	int temps;
+	lval* formals;
+} lcompile;
+
+// native code for a lambda, shared by its copies and made once they have been called often enough between them
+enum { LJIT_COUNTING, LJIT_COMPILED, LJIT_REJECTED };
+enum { LJIT_THRESHOLD = 1000, LJIT_ARGS = 6 };
+
+typedef struct ljit {
+	int refs;
+	int state;
+	long calls;
+	int arity;
+	void* code;
+	long size;
+	char** syms;
+	lbuiltin* funcs;
+	int syms_count;
+} ljit;
+
+// compiled code takes its arguments in registers and returns its result in one
+typedef long (*ljit_func)(long, long, long, long, long, long);
+
+// machine code as it is put together, jumps to the exit for failed calls are filled in at the end
+typedef struct {
+	unsigned char* data;
+	long size;
+	long slots;
+	lenv* env;
+	lval* formals;
+	ljit* jit;
+	long* fails;
+	int fails_count;
+} ljit_code;
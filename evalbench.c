@@ -0,0 +1,207 @@
+// Evaluator benchmark runner
+//
+//   evalbench [--load PATH] [--warmup N] [--runs N] program.lpl...
+//
+// Runs each program with the interpreter at PATH, N times after the
+// warm-up runs, and prints one JSON object per line with the median and
+// 95th percentile wall time. A program's first line reads "; ops N ...",
+// the number of operations it performs, and ns_per_op is the median less
+// the interpreter's startup, measured first on an empty program, over N.
+// Read forms are cached in a directory of its own, which is removed after.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+	char* load;
+	int warmup;
+	int runs;
+} bench_options;
+
+double bench_now(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Run the interpreter on one program and return the wall time, or -1 if it failed or printed an error
+double bench_run(bench_options* o, char* program) {
+	int out[2];
+	if (pipe(out) != 0) return -1;
+
+	double start = bench_now();
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		close(out[0]);
+		close(out[1]);
+		return -1;
+	}
+
+	// The REPL reads end of input from /dev/null straight after the program
+	if (pid == 0) {
+		int in = open("/dev/null", O_RDONLY);
+		dup2(in, 0);
+		dup2(out[1], 1);
+		dup2(out[1], 2);
+		close(out[0]);
+		execl(o->load, o->load, program, (char*)NULL);
+		_exit(127);
+	}
+
+	close(out[1]);
+
+	// The programs print little, so all of it is kept to look for errors
+	char* output = NULL;
+	long length = 0;
+	char buffer[4096];
+	ssize_t n;
+	while ((n = read(out[0], buffer, sizeof(buffer))) > 0) {
+		output = realloc(output, length + n + 1);
+		memcpy(output + length, buffer, n);
+		length += n;
+		output[length] = '\0';
+	}
+	close(out[0]);
+
+	int status;
+	waitpid(pid, &status, 0);
+	double t = bench_now() - start;
+
+	int failed = output && strstr(output, "Error");
+	free(output);
+
+	if (failed || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+	return t;
+}
+
+int bench_compare(const void* a, const void* b) {
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+// Warm up, then time the runs, sorted so percentiles can be read off
+int bench_measure(bench_options* o, char* program, double* times) {
+	for (int i = 0; i < o->warmup; i++)
+		if (bench_run(o, program) < 0) return 0;
+
+	for (int i = 0; i < o->runs; i++)
+		if ((times[i] = bench_run(o, program)) < 0) return 0;
+
+	qsort(times, o->runs, sizeof(double), bench_compare);
+	return 1;
+}
+
+double bench_median(double* times, int n) {
+	return n % 2 ? times[n / 2] : (times[n / 2 - 1] + times[n / 2]) / 2;
+}
+
+// Nearest rank, so with few runs it is the slowest
+double bench_p95(double* times, int n) {
+	int rank = (95 * n + 99) / 100;
+	return times[rank - 1];
+}
+
+// The number of operations from the "; ops N" first line, 0 if there is none
+long bench_ops(char* program) {
+	FILE* f = fopen(program, "r");
+	if (!f) return 0;
+
+	long ops = 0;
+	if (fscanf(f, "; ops %ld", &ops) != 1) ops = 0;
+	fclose(f);
+
+	return ops;
+}
+
+void bench_cleanup(char* dir) {
+	DIR* d = opendir(dir);
+	if (d) {
+		struct dirent* e;
+		char path[4096];
+		while ((e = readdir(d))) {
+			if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+			snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+			unlink(path);
+		}
+		closedir(d);
+	}
+	rmdir(dir);
+}
+
+int main(int argc, char** argv) {
+	bench_options o = { "./load", 1, 10 };
+
+	int arg = 1;
+	for (; arg + 1 < argc && strncmp(argv[arg], "--", 2) == 0; arg += 2) {
+		if (strcmp(argv[arg], "--load") == 0) o.load = argv[arg+1];
+		else if (strcmp(argv[arg], "--warmup") == 0) o.warmup = atoi(argv[arg+1]);
+		else if (strcmp(argv[arg], "--runs") == 0) o.runs = atoi(argv[arg+1]);
+		else break;
+	}
+
+	if (arg == argc || o.warmup < 0 || o.runs < 1 || strncmp(argv[arg], "--", 2) == 0) {
+		fprintf(stderr, "usage: %s [--load PATH] [--warmup N] [--runs N] program.lpl...\n", argv[0]);
+		return 1;
+	}
+
+	// Every run after the warm-up reads its forms from this cache, which does not outlive the runs
+	char cache[] = "/tmp/evalbench-XXXXXX";
+	if (!mkdtemp(cache)) {
+		fprintf(stderr, "%s: could not make a cache directory\n", argv[0]);
+		return 1;
+	}
+	setenv("LIPL_CACHE", cache, 1);
+
+	double* times = malloc(sizeof(double) * o.runs);
+	int failed = 0;
+
+	// Startup is timed on an empty program and taken off each program's time per operation
+	char empty[4096];
+	snprintf(empty, sizeof(empty), "%s/empty.lpl", cache);
+	FILE* f = fopen(empty, "w");
+	if (f) fclose(f);
+
+	double startup = 0;
+	if (f && bench_measure(&o, empty, times)) {
+		startup = bench_median(times, o.runs);
+		printf("{\"program\": \"startup\", \"runs\": %d, \"median_ms\": %.3f, \"p95_ms\": %.3f}\n",
+			o.runs, startup * 1e3, bench_p95(times, o.runs) * 1e3);
+		fflush(stdout);
+	} else {
+		fprintf(stderr, "%s: could not run %s\n", argv[0], o.load);
+		failed = 1;
+	}
+
+	for (; arg < argc && !failed; arg++) {
+		long ops = bench_ops(argv[arg]);
+
+		if (!bench_measure(&o, argv[arg], times)) {
+			fprintf(stderr, "%s: %s failed or printed an error\n", argv[0], argv[arg]);
+			failed = 1;
+			break;
+		}
+
+		double median = bench_median(times, o.runs);
+		double eval = median > startup ? median - startup : 0;
+
+		printf("{\"program\": \"%s\", \"ops\": %ld, \"runs\": %d, \"median_ms\": %.3f, "
+			"\"p95_ms\": %.3f, \"ns_per_op\": %.1f}\n",
+			argv[arg], ops, o.runs, median * 1e3, bench_p95(times, o.runs) * 1e3,
+			ops ? eval * 1e9 / ops : 0.0);
+		fflush(stdout);
+	}
+
+	free(times);
+	bench_cleanup(cache);
+
+	return failed;
+}
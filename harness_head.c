@@ -0,0 +1,33 @@
+#include "mpc.h"
+#include "GRAMMAR.h"
+int main(int argc, char** argv) {
+  mpc_parser_t *Number = mpc_new("number"), *Symbol = mpc_new("symbol"), *String = mpc_new("string"),
+    *Comment = mpc_new("comment"), *Sexpr = mpc_new("sexpr"), *Qexpr = mpc_new("qexpr"), *Expr = mpc_new("expr"), *Lipl = mpc_new("lipl");
+  int mode = atoi(argv[2]);
+  if (mode >= 10) {
+    mpca_lang(MPCA_LANG_DEFAULT,
+	  " number	: /-?[0-9]+/ ;				\
+	    symbol	: /[a-zA-Z0-9_+\\-*\\/\\\\=<>!&]+/ ;	\
+	    string	: /\"(\\\\.|[^\"])*\"/ ;		\
+	    comment	: /;[^\\r\\n]*/ ;			\
+	    sexpr	: '(' <expr>* ')' ;			\
+	    qexpr	: '{' <expr>* '}' ;			\
+	    expr	: <number> | <string> | <comment> 	\
+	    		| <symbol> | <sexpr> | <qexpr> ;	\
+	    lipl	: /^/ <expr>* /$/ ;" ,
+	  Number, Symbol, String, Comment, Sexpr, Qexpr, Expr, Lipl);
+    mode -= 10;
+  } else lipl_grammar(Number, Symbol, String, Comment, Sexpr, Qexpr, Expr, Lipl);
+  mpc_result_t r;
+  int ok;
+  mpc_arena_t* a = mpc_arena_new();
+  if (mode == 0) ok = mpc_parse_contents(argv[1], Lipl, &r);
+  else if (mode == 1) { FILE* f = fopen(argv[1], "rb"); ok = mpc_parse_pipe(argv[1], f, Lipl, &r); fclose(f); }
+  else if (mode == 2) ok = mpc_parse_contents_view(argv[1], Lipl, a, &r);
+  else if (mode == 3) ok = mpc_parse_contents_arena(argv[1], Lipl, a, &r);
+  else { FILE* f = fopen(argv[1], "rb"); ok = mpc_parse_file(argv[1], f, Lipl, &r); fclose(f); }
+  if (ok) { mpc_ast_print(r.output); if (mode != 2 && mode != 3) mpc_ast_delete(r.output); }
+  else { mpc_err_print(r.error); mpc_err_delete(r.error); }
+  mpc_arena_delete(a);
+  return 0;
+}
@@ -1,7 +1,23 @@
+// POSIX threads and sysconf, and anonymous mappings for compiled code
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
 #include <editline/readline.h>
 #include <editline/history.h>
 #include "mpc.h"
 #include "FUNCS.h"
+#include "GRAMMAR.h"
 
 #define LASSERT(args, cond, fmt, ...) \
 	if (!(cond)) { \
@@ -26,8 +42,18 @@
 	LASSERT(args, args->cell[index]->count != 0, \
 	"Function '%s' passed {} for argument %i.", func, index);
 
-
-enum { LVAL_NUM, LVAL_ERR, LVAL_SYM, LVAL_STR, LVAL_SEXPR, LVAL_QEXPR, LVAL_FUN };
+// Counters behind (memstats), only built with -DLIPL_STATS so they cost nothing otherwise
+#ifdef LIPL_STATS
+#define LSTAT(...) do { __VA_ARGS__; } while (0)
+#else
+#define LSTAT(...) do { } while (0)
+#endif
+
+// Raises a shared maximum, retrying when another thread moved it in between
+static inline void lstats_max(_Atomic unsigned long* max, unsigned long x) {
+	unsigned long seen = atomic_load(max);
+	while (x > seen && !atomic_compare_exchange_weak(max, &seen, x));
+}
 
 
 mpc_parser_t* Number;
@@ -39,6 +65,19 @@ mpc_parser_t* Qexpr;
 mpc_parser_t* Expr;
 mpc_parser_t* Lipl;
 
+// Version of the global environment that cached bindings are checked against
+lglobals globals = { .version = 1 };
+
+// Event trace, off unless started with --trace
+ltrace tracer = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+#ifdef LIPL_STATS
+lstats stats;
+
+// Nesting of lval_copy and lenv_copy on this thread, so only the outermost call counts as a copy
+_Thread_local int lstats_depth;
+#endif
+
 
 /* enum2string */
 char* ltype_name(int t) {
@@ -57,18 +96,24 @@ char* ltype_name(int t) {
 
 /* Constructors */
 
+// Every lval is allocated here
+lval* lval_new(int type) {
+	lval* v = malloc(sizeof(lval));
+	v->type = type;
+	LSTAT(stats.allocs[type]++);
+	return v;
+}
+
 // lval constructor for numbers
 lval* lval_num(long x) {
-	lval* v = malloc(sizeof(lval));
-	v->type = LVAL_NUM;
+	lval* v = lval_new(LVAL_NUM);
 	v->num = x;
 	return v;
 }
 
 //lval constructor for errors
 lval* lval_err(char* fmt, ...) {
-	lval* v = malloc(sizeof(lval));
-	v->type = LVAL_ERR;
+	lval* v = lval_new(LVAL_ERR);
 	
 	/* Create va lis and intialize */
 	va_list va;
@@ -82,6 +127,8 @@ lval* lval_err(char* fmt, ...) {
 	
 	/* Reallocate to actual number of bytes used */
 	v->err = realloc(v->err, strlen(v->err)+1);
+	LSTAT(stats.string_bytes += strlen(v->err) + 1);
+	if (tracer.on) ltrace_emit(LTRACE_ERROR, ltrace_intern(v->err, strlen(v->err)));
 	
 	/* Clean up of va list */
 	va_end(va);
@@ -91,26 +138,47 @@ lval* lval_err(char* fmt, ...) {
 
 //lval constructor for symbol
 lval* lval_sym(char* symbol) {
-	lval* v = malloc(sizeof(lval));
-	v->type = LVAL_SYM;
+	lval* v = lval_new(LVAL_SYM);
 	v->sym = malloc(strlen(symbol) + 1);
+	LSTAT(stats.string_bytes += strlen(symbol) + 1);
 	strcpy(v->sym, symbol);
+	v->site = NULL;
+	return v;
+}
+
+//lval constructor for symbol from a slice of the parsed text
+lval* lval_sym_len(char* symbol, long len) {
+	lval* v = lval_new(LVAL_SYM);
+	v->sym = malloc(len + 1);
+	LSTAT(stats.string_bytes += len + 1);
+	memcpy(v->sym, symbol, len);
+	v->sym[len] = '\0';
+	v->site = NULL;
 	return v;
 }
 
 //lval constructor for string
 lval* lval_str(char* string) {
-	lval* v = malloc(sizeof(lval));
-	v->type = LVAL_STR;
+	lval* v = lval_new(LVAL_STR);
 	v->str = malloc(strlen(string) + 1);
+	LSTAT(stats.string_bytes += strlen(string) + 1);
 	strcpy(v->str, string);
 	return v;
 }
 
+//lval constructor for string from a slice of text
+lval* lval_str_len(char* string, long len) {
+	lval* v = lval_new(LVAL_STR);
+	v->str = malloc(len + 1);
+	LSTAT(stats.string_bytes += len + 1);
+	memcpy(v->str, string, len);
+	v->str[len] = '\0';
+	return v;
+}
+
 //lval constructor for sexpr
 lval* lval_sexpr(void) {
-	lval* v = malloc(sizeof(lval));
-	v->type = LVAL_SEXPR;
+	lval* v = lval_new(LVAL_SEXPR);
 	v->count = 0;
 	v->cell = NULL;
 	return v;
@@ -118,8 +186,7 @@ lval* lval_sexpr(void) {
 
 //lval constructor for qexpr
 lval* lval_qexpr(void) {
-	lval* v = malloc(sizeof(lval));
-	v->type = LVAL_QEXPR;
+	lval* v = lval_new(LVAL_QEXPR);
 	v->count = 0;
 	v->cell = NULL;
 	return v;
@@ -127,22 +194,22 @@ lval* lval_qexpr(void) {
 
 //lval constructor for builtin
 lval* lval_builtin(lbuiltin func) {
-	lval* v = malloc(sizeof(lval));
-	v->type = LVAL_FUN;
+	lval* v = lval_new(LVAL_FUN);
 	v->builtin = func;
 	return v;
 }
 
 //lval constructor for lambda
 lval* lval_lambda(lval* formals, lval* body) {
-	lval* v = malloc(sizeof(lval));
-	v->type = LVAL_FUN;
+	lval* v = lval_new(LVAL_FUN);
 	v->builtin = NULL;
 	
 	v->env = lenv_new();
 	
 	v->formals = formals;
 	v->body = body;
+	v->jit = ljit_new();
+	lglobals_lambda(v);
 	return v;
 }
 
@@ -150,6 +217,7 @@ lval* lval_lambda(lval* formals, lval* body) {
 //lenv constructor
 lenv* lenv_new(void) {
 	lenv* e = malloc(sizeof(lenv));
+	LSTAT(stats.env_bytes += sizeof(lenv));
 	e->parent = NULL;
 	e->count = 0;
 	e->syms = NULL;
@@ -162,11 +230,15 @@ lenv* lenv_new(void) {
 
 //lval destructor
 void lval_del(lval* v) {
+	LSTAT(stats.frees[v->type]++);
 
 	switch(v->type) {
 		case LVAL_NUM: break;
 		case LVAL_ERR: free(v->err); break;
-		case LVAL_SYM: free(v->sym); break;
+		case LVAL_SYM:
+			free(v->sym);
+			if (v->site) lsite_del(v->site);
+			break;
 		case LVAL_STR: free(v->str); break;
 		case LVAL_QEXPR:
 		case LVAL_SEXPR:
@@ -179,6 +251,7 @@ void lval_del(lval* v) {
 				lenv_del(v->env);
 				lval_del(v->formals);
 				lval_del(v->body);
+				ljit_del(v->jit);
 			} break;
 	}
 
@@ -200,27 +273,38 @@ void lenv_del(lenv* e) {
 /* Utilities */
 
 lval* lval_copy(lval* v) {
-	lval* x = malloc(sizeof(lval));
-	x->type = v->type;
+	LSTAT(if (!lstats_depth++) stats.lval_copies++; stats.lval_copy_nodes++);
+	lval* x = lval_new(v->type);
 
 	switch(v->type) {
 		case LVAL_NUM: x->num = v->num; break;
 		case LVAL_ERR:
 			x->err = malloc(strlen(v->err)+1);
+			LSTAT(stats.string_bytes += strlen(v->err) + 1);
 			strcpy(x->err, v->err);
 			break;
 		case LVAL_SYM:
 			x->sym = malloc(strlen(v->sym)+1);
+			LSTAT(stats.string_bytes += strlen(v->sym) + 1);
 			strcpy(x->sym, v->sym);
+			x->site = v->site;
+			if (x->site) x->site->refs++;
 			break;
 		case LVAL_STR:
-			x->sym = malloc(strlen(v->str)+1);
+			x->str = malloc(strlen(v->str)+1);
+			LSTAT(stats.string_bytes += strlen(v->str) + 1);
 			strcpy(x->str, v->str);
 			break;
 		case LVAL_SEXPR:
 		case LVAL_QEXPR:
 			x->count = v->count;
 			x->cell = malloc(sizeof(lval*) * x->count);
+			LSTAT(stats.cell_bytes += sizeof(lval*) * x->count);
+
+			// Code is copied to be run, so a list's head symbol gets a cache its copies share
+			if (v->count && v->cell[0]->type == LVAL_SYM && !v->cell[0]->site)
+				v->cell[0]->site = lsite_new();
+
 			for(int i = 0; i < x->count; i++)
 				x->cell[i] = lval_copy(v->cell[i]);
 			break;
@@ -232,16 +316,20 @@ lval* lval_copy(lval* v) {
 				x->env = lenv_copy(v->env);
 				x->formals = lval_copy(v->formals);
 				x->body = lval_copy(v->body);
+				x->jit = v->jit;
+				x->jit->refs++;
 			}
 			break;
 	}
 	
+	LSTAT(lstats_depth--);
 	return x;
 }
 
 lval* lval_add(lval* v, lval* x) {
 	v->count++;
 	v->cell = realloc(v->cell, sizeof(lval*) * v->count);
+	LSTAT(stats.cell_bytes += sizeof(lval*));
 	v->cell[v->count-1] = x;
 	return v;
 }
@@ -358,22 +446,32 @@ void lval_println(lval* v) { lval_print(v); printf("\n"); }
 /* Lisp Environment */
 
 lval* lenv_get(lenv* e, lval* k) {
+	LSTAT(stats.lookups++);
+
+	// A symbol with a cache of its global binding, as compiled code's are, skips the walk there
+	lval* g = k->site ? lsite_get(e, k) : NULL;
+	if (g) return lval_copy(g);
+
+	for (int depth = 0; e; depth++) {
+		// Sesarch current environment
+		for (int i = 0; i < e->count; i++) {
+			if (strcmp(e->syms[i], k->sym) == 0) {
+				LSTAT(stats.lookup_depth += depth; lstats_max(&stats.lookup_depth_max, depth));
+				return lval_copy(e->vals[i]);
+			}
+		}
 
-	// Sesarch current environment
-	for (int i = 0; i < e->count; i++)
-		if (strcmp(e->syms[i], k->sym) == 0)
-			return lval_copy(e->vals[i]);
-			
-	// Search parent environment, if symbol not found in current one
-	// This searches straight upwards, won't search in another func
-	// environment.
-	if(e->parent)
-		return lenv_get(e->parent, k);
-	else
-		return lval_err("Unbound symbol '%s'", k->sym);
+		// Search parent environment, if symbol not found in current one
+		// This searches straight upwards, won't search in another func
+		// environment.
+		e = e->parent;
+	}
+
+	return lval_err("Unbound symbol '%s'", k->sym);
 }
 
-void lenv_put(lenv* e, lval* k, lval* v) {
+// Bind k in e itself, for lval_call binding arguments to names lglobals_lambda has already seen
+void lenv_bind(lenv* e, lval* k, lval* v) {
 	
 	// Update value if already in environment
 	for (int i = 0; i < e->count; i++) {
@@ -387,23 +485,37 @@ void lenv_put(lenv* e, lval* k, lval* v) {
 	e->count++;
 	e->vals = realloc(e->vals, sizeof(lval*) * e->count);
 	e->syms = realloc(e->syms, sizeof(lval*) * e->count);
+	LSTAT(stats.env_bytes += sizeof(char*) + sizeof(lval*));
 
 	e->vals[e->count-1] = lval_copy(v);
 	e->syms[e->count-1] = malloc(strlen(k->sym)+1);
+	LSTAT(stats.string_bytes += strlen(k->sym) + 1);
 	strcpy(e->syms[e->count-1], k->sym);
 }
 
+// Bindings cached on head symbols go stale once the global environment changes, or a name is bound in another
+void lenv_put(lenv* e, lval* k, lval* v) {
+	if (!e->parent) globals.version++;
+	else lglobals_add(k->sym);
+
+	lenv_bind(e, k, v);
+}
+
 lenv* lenv_copy(lenv* e) {
+	LSTAT(if (!lstats_depth++) stats.lenv_copies++; stats.lenv_copy_entries += e->count);
 	lenv* n = malloc(sizeof(lenv));
 	n->parent = e->parent;
 	n->count = e->count;
 	n->syms = malloc(sizeof(char*) * n->count);
 	n->vals = malloc(sizeof(lval*) * n->count);
+	LSTAT(stats.env_bytes += sizeof(lenv) + (sizeof(char*) + sizeof(lval*)) * n->count);
 	for (int i = 0; i < e->count; i++) {
 		n->syms[i] = malloc(strlen(e->syms[i]) + 1);
+		LSTAT(stats.string_bytes += strlen(e->syms[i]) + 1);
 		strcpy(n->syms[i], e->syms[i]);
 		n->vals[i] = lval_copy(e->vals[i]);
 	}
+	LSTAT(lstats_depth--);
 	return n;
 }
 
@@ -413,6 +525,85 @@ void lenv_def(lenv* e, lval* k, lval* v) {
 	lenv_put(e, k ,v);
 }
 
+/* Caches of global bindings */
+
+lsite* lsite_new(void) {
+	lsite* s = calloc(1, sizeof(lsite));
+	s->refs = 1;
+	return s;
+}
+
+void lsite_del(lsite* s) {
+	if (--s->refs == 0) free(s);
+}
+
+int lglobals_local(char* name) {
+	if (!globals.locals_slots) return 0;
+
+	int mask = globals.locals_slots - 1;
+	for (int i = lcache_hash(name, strlen(name)) & mask; globals.locals[i]; i = (i + 1) & mask)
+		if (strcmp(globals.locals[i], name) == 0) return 1;
+	return 0;
+}
+
+// Note a name bound outside the global environment, which no cache may then hold
+void lglobals_add(char* name) {
+	if (lglobals_local(name)) return;
+
+	// Kept at most half full, so every probe ends at an empty slot
+	if (2 * (globals.locals_count + 1) > globals.locals_slots) {
+		char** old = globals.locals;
+		int slots = globals.locals_slots;
+
+		globals.locals_slots = slots ? 2 * slots : 64;
+		globals.locals = calloc(globals.locals_slots, sizeof(char*));
+		globals.locals_count = 0;
+
+		for (int i = 0; i < slots; i++)
+			if (old[i]) {
+				int mask = globals.locals_slots - 1;
+				int k = lcache_hash(old[i], strlen(old[i])) & mask;
+				while (globals.locals[k]) k = (k + 1) & mask;
+				globals.locals[k] = old[i];
+				globals.locals_count++;
+			}
+		free(old);
+	}
+
+	int mask = globals.locals_slots - 1;
+	int i = lcache_hash(name, strlen(name)) & mask;
+	while (globals.locals[i]) i = (i + 1) & mask;
+
+	globals.locals[i] = malloc(strlen(name) + 1);
+	strcpy(globals.locals[i], name);
+	globals.locals_count++;
+	globals.version++;
+}
+
+// A lambda's formals, and what it has been given of them, are bound in its own environment when it is called
+void lglobals_lambda(lval* f) {
+	for (int i = 0; i < f->formals->count; i++)
+		if (f->formals->cell[i]->type == LVAL_SYM) lglobals_add(f->formals->cell[i]->sym);
+	for (int i = 0; i < f->env->count; i++)
+		lglobals_add(f->env->syms[i]);
+}
+
+// The global binding of head symbol k, straight from its cache when nothing has changed since it was filled.
+// NULL when k is unbound or may be bound outside the global environment, which lenv_get then sorts out
+lval* lsite_get(lenv* e, lval* k) {
+	lsite* s = k->site;
+	if (s->version == globals.version) return s->value;
+
+	s->version = globals.version;
+	s->value = NULL;
+	if (lglobals_local(k->sym)) return NULL;
+
+	while (e->parent) e = e->parent;
+	for (int i = 0; i < e->count; i++)
+		if (strcmp(e->syms[i], k->sym) == 0) return s->value = e->vals[i];
+	return NULL;
+}
+
 /* Builtins */
 
 lval* builtin_print(lenv* e, lval* a) {
@@ -437,281 +628,2046 @@ lval* builtin_error(lenv* e, lval*a) {
 	return err;
 }
 
-lval* builtin_load(lenv* e, lval* a) {
-	LASSERT_NUM("load", a, 1);
-	LASSERT_TYPE("load", a, 0, LVAL_STR);
-
-	// Parse file given by string name
+// Read and evaluate the forms of a stream one at a time
+lval* lval_load(lenv* e, mpc_stream_t* s, mpc_arena_t* arena, lcache* c) {
 	mpc_result_t r;
-	if (mpc_parse_contents(a->cell[0]->str, Lipl, &r)) {
-		// Read content
-		lval* expr = lval_read(r.output);
-		mpc_ast_delete(r.output);
 
-		// Evaluate each expression
-		while (expr->count) {
-			lval* x = lval_eval(e, lval_pop(expr, 0));
+	while (!mpc_stream_done(s)) {
+		if (tracer.on) ltrace_emit(LTRACE_PARSE_START, 0);
+		int parsed = mpc_stream_next(s, Expr, &r);
+		if (tracer.on) ltrace_emit(LTRACE_PARSE_END, 0);
 
-			// Print errors
-			if (x->type == LVAL_ERR) lval_println(x);
+		if (!parsed) {
+			mpc_arena_clear(arena);
 
-			// Clean up
-			lval_del(x);
+			char* err_msg = mpc_err_string(r.error);
+			mpc_err_delete(r.error);
+
+			lval* err = lval_err("Could not load library: %s", err_msg);
+			free(err_msg);
+
+			// A file that does not parse is never cached
+			if (c) c->failed = 1;
+
+			return err;
 		}
 
-		lval_del(expr);
-		lval_del(a);
+		// Comments read as nothing
+		mpc_ast_t* t = r.output;
+		if (strstr(t->tag, "comment")) {
+			mpc_arena_clear(arena);
+			continue;
+		}
 
-		return lval_sexpr();
-	} else {
-		char* err_msg = mpc_err_string(r.error);
-		mpc_err_delete(r.error);
+		// Only this form's tree is alive, drop it once read
+		lval* x = lval_read(t);
+		mpc_arena_clear(arena);
 
-		lval* err = lval_err("Could not load library: %s", err_msg);
-		free(err_msg);
-		lval_del(a);
-		
-		return err;
-	}
-}
+		// Encode it before evaluation takes it apart
+		if (c) lcache_add(c, x);
 
-lval* builtin_if(lenv* e, lval* a) {
-	LASSERT_NUM("if", a, 3);
-	LASSERT_TYPE("if", a, 0, LVAL_NUM);
-	LASSERT_TYPE("if", a, 1, LVAL_QEXPR);
-	LASSERT_TYPE("if", a, 2, LVAL_QEXPR);
+		x = lval_eval(e, x);
 
-	lval* x;
-	a->cell[1]->type = LVAL_SEXPR;
-	a->cell[2]->type = LVAL_SEXPR;
+		// Print errors
+		if (x->type == LVAL_ERR) {
+			lval_println(x);
+			ltrace_error();
+		}
 
-	if (a->cell[0]->num) { x = lval_eval(e, lval_pop(a, 1)); }
-	else { x = lval_eval(e, lval_pop(a, 2)); }
+		// Clean up
+		lval_del(x);
+	}
 
-	lval_del(a);
-	return x;
+	return lval_sexpr();
 }
 
-lval* builtin_cmp(lenv* e, lval* a, char* op) {
-	LASSERT_NUM(op, a, 2);
+/* Binary cache */
 
-	int r;
-	if (strcmp(op, "==") == 0) r = lval_eq(a->cell[0], a->cell[1]);
-	if (strcmp(op, "!=") == 0) r = ! lval_eq(a->cell[0], a->cell[1]);
+enum { LCACHE_VERSION = 1, LCACHE_ORDER = 0x01020304 };
 
-	lval_del(a);
-	return lval_num(r);
+// FNV-1a over the source text
+uint64_t lcache_hash(const char* text, long size) {
+	uint64_t h = 14695981039346656037ULL;
+	for (long i = 0; i < size; i++) {
+		h ^= (unsigned char)text[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
 }
 
-lval* builtin_eq(lenv* e, lval* a) { return builtin_cmp(e, a, "=="); }
-lval* builtin_ne(lenv* e, lval* a) { return builtin_cmp(e, a, "!="); }
+// The cache is named after the hash, in $LIPL_CACHE or else the user's cache directory
+char* lcache_path(uint64_t hash) {
+	char* dir = getenv("LIPL_CACHE");
+	char* sub = "";
+
+	if (!dir || !*dir) {
+		dir = getenv("XDG_CACHE_HOME");
+		sub = "/lipl";
+		if (!dir || !*dir) {
+			dir = getenv("HOME");
+			sub = "/.cache/lipl";
+		}
+	}
 
-lval* builtin_ord(lenv* e, lval* a, char* op) {
-	LASSERT_NUM(op, a, 2);
-	LASSERT_TYPE(op, a, 0, LVAL_NUM);
-	LASSERT_TYPE(op, a, 1, LVAL_NUM);
+	// With nowhere to put it nothing is cached
+	if (!dir || !*dir) return NULL;
 
-	int r;
+	char* path = malloc(strlen(dir) + strlen(sub) + 24);
+	sprintf(path, "%s%s/%016llx.lplc", dir, sub, (unsigned long long)hash);
+	return path;
+}
 
-	if (strcmp(op, ">") == 0) r = (a->cell[0]->num > a->cell[1]->num);
-	if (strcmp(op, "<") == 0) r = (a->cell[0]->num < a->cell[1]->num);
-	if (strcmp(op, "<=") == 0) r = (a->cell[0]->num <= a->cell[1]->num);
-	if (strcmp(op, ">=") == 0) r = (a->cell[0]->num >= a->cell[1]->num);
+// Decode the forms cached for a file, NULL on a miss. Either way c is ready to write the cache
+lval* lcache_open(lcache* c, char* filename) {
+	*c = (lcache){ 0 };
 
-	lval_del(a);
-	return lval_num(r);
-}
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) return NULL;
 
-lval* builtin_gt(lenv* e, lval* a) { return builtin_ord(e, a, ">"); }
-lval* builtin_lt(lenv* e, lval* a) { return builtin_ord(e, a, "<"); }
-lval* builtin_ge(lenv* e, lval* a) { return builtin_ord(e, a, ">="); }
-lval* builtin_le(lenv* e, lval* a) { return builtin_ord(e, a, ">="); }
+	// Only regular files are cached
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+		close(fd);
+		return NULL;
+	}
 
-lval* builtin_lambda(lenv* e, lval* a) {
-	LASSERT_NUM("\\", a, 2);
-	LASSERT_TYPE("\\", a, 0, LVAL_QEXPR);
-	LASSERT_TYPE("\\", a, 1, LVAL_QEXPR);
-	
-	for(int i = 0; i < a->cell[0]->count; i++)
-		LASSERT(a, (a->cell[0]->cell[i]->type == LVAL_SYM),
-			"Cannot define non-symbol. Got %s, expected %s.",
-			ltype_name(a->cell[0]->cell[i]->type), ltype_name(LVAL_SYM));
+	// Hash the source as it is now, a miss parses this same mapping so the two always agree
+	char* text = "";
+	if (st.st_size > 0) text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
 
-	lval* formals = lval_pop(a, 0);
-	lval* body = lval_pop(a, 0);
-	lval_del(a);
-	
-	return lval_lambda(formals, body);
-}
+	if (text == MAP_FAILED) return NULL;
 
-lval* builtin_var(lenv* e, lval* a, char* func) {
-	LASSERT_TYPE("def", a, 0, LVAL_QEXPR);
-	
-	// First argument is a symbol list
-	lval* syms = a->cell[0];
-	
-	// Ensure first list only contain elements that are symbols
-	for (int i = 0; i < syms->count; i++) {
-		LASSERT(a, (syms->cell[i]->type == LVAL_SYM),
-			"Function '%s' cannot define non-symbols! "
-			"Got %s, expected %s.",
-			func,
-			ltype_name(syms->cell[i]->type),
-			ltype_name(LVAL_SYM));
-	}
-	
-	// Check correct number of symbols and values
-	LASSERT(a, (syms->count == a->count-1),
-		"Function '%s' passed too many arguments for symbols. "
-		"Got %i, expected %i.",
-		func, syms->count, a->count-1);
-	
-	for (int i = 0; i < syms->count; i++) {
-		// def: define globally
-		// put: define locally
-		if(strcmp(func, "def") == 0)
-			lenv_def(e, syms->cell[i], a->cell[i+1]);
-		if(strcmp(func, "=") == 0)
-			lenv_put(e, syms->cell[i], a->cell[i+1]);
-	}
+	c->text = text;
+	c->size = st.st_size;
+	c->hash = lcache_hash(text, c->size);
 
-	lval_del(a);
-	return lval_sexpr();
+	c->path = lcache_path(c->hash);
+	return c->path ? lcache_read(c) : NULL;
 }
 
-lval* builtin_def(lenv* e, lval* v) { return builtin_var(e, v, "def"); }
-lval* builtin_put(lenv* e, lval* v) { return builtin_var(e, v, "="); }
+// Map the cache and decode it if it was written for this very source
+lval* lcache_read(lcache* c) {
+	int fd = open(c->path, O_RDONLY);
+	if (fd < 0) return NULL;
+
+	struct stat st;
+	char* data = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(lcache_header))
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED) return NULL;
+
+	lcache_header h;
+	memcpy(&h, data, sizeof(h));
+
+	lval* expr = NULL;
+	if (memcmp(h.magic, "LPLC", 4) == 0 && h.order == LCACHE_ORDER && h.version == LCACHE_VERSION
+		&& h.hash == c->hash && h.size == c->size && h.length == st.st_size - (off_t)sizeof(h)) {
+		char* p = data + sizeof(h);
+		char* end = p + h.length;
+
+		expr = lval_sexpr();
+		for (int i = 0; i < h.count; i++) {
+			lval* x = lcache_decode(&p, end);
+			if (!x) break;
+			expr = lval_add(expr, x);
+		}
 
-lval* builtin_list(lenv* e, lval* a) {
-	a->type = LVAL_QEXPR;
-	return a;
-}
+		// Anything short of the whole cache is a miss
+		if (expr->count != h.count || p != end) {
+			lval_del(expr);
+			expr = NULL;
+		}
+	}
 
-lval* builtin_head(lenv* e, lval* a) {
-	LASSERT_NUM("head", a, 1);
-	LASSERT_TYPE("head", a, 0, LVAL_QEXPR);
-	LASSERT_NOT_EMPTY("head", a, 0);
+	munmap(data, st.st_size);
+	return expr;
+}
 
-	lval* v = lval_take(a, 0);
-	while(v->count > 1) {lval_del(lval_pop(v, 1));}
-	return v;
+// Lengths, counts and numbers are stored 7 bits a byte
+int lcache_decode_varint(char** p, char* end, uint64_t* x) {
+	*x = 0;
+	for (int shift = 0; *p < end && shift < 64; shift += 7) {
+		unsigned char b = *(*p)++;
+		*x |= (uint64_t)(b & 0x7f) << shift;
+		if (!(b & 0x80)) return 1;
+	}
+	return 0;
 }
 
-lval* builtin_tail(lenv* e, lval* a) {
-	LASSERT_NUM("tail", a, 1);
-	LASSERT_TYPE("tail", a, 0, LVAL_QEXPR);
-	LASSERT_NOT_EMPTY("tail", a, 0);
+// Decode one form, NULL if the data is cut short or is not a form
+lval* lcache_decode(char** p, char* end) {
+	if (*p >= end) return NULL;
+	int type = (unsigned char)*(*p)++;
 
-	lval* v = lval_take(a, 0);
-	lval_del(lval_pop(v, 0));
-	return v;
-}
+	uint64_t x;
+	if (!lcache_decode_varint(p, end, &x)) return NULL;
 
-lval* builtin_eval(lenv* e, lval* a) {
-	LASSERT_NUM("eval", a, 1);
-	LASSERT_TYPE("eval", a, 0, LVAL_QEXPR);
+	switch (type) {
+		// Numbers are zigzagged so small negatives stay short
+		case LVAL_NUM: return lval_num((long)((x >> 1) ^ -(x & 1)));
+		case LVAL_ERR:
+		case LVAL_SYM:
+		case LVAL_STR: {
+			if (x > (uint64_t)(end - *p)) return NULL;
+			char* text = *p;
+			*p += x;
 
-	lval* x = lval_take(a, 0);
-	x->type = LVAL_SEXPR;
-	return lval_eval(e, x);
-}
+			if (type == LVAL_ERR) return lval_err("%.*s", (int)x, text);
+			return type == LVAL_SYM ? lval_sym_len(text, x) : lval_str_len(text, x);
+		}
+		case LVAL_SEXPR:
+		case LVAL_QEXPR: {
+			// Every form takes at least a byte, which bounds the count
+			if (x > (uint64_t)(end - *p)) return NULL;
+
+			lval* v = type == LVAL_SEXPR ? lval_sexpr() : lval_qexpr();
+			if (x) v->cell = malloc(sizeof(lval*) * x);
+			LSTAT(stats.cell_bytes += sizeof(lval*) * x);
+
+			for (uint64_t i = 0; i < x; i++) {
+				lval* y = lcache_decode(p, end);
+				if (!y) {
+					lval_del(v);
+					return NULL;
+				}
+				v->cell[v->count++] = y;
+			}
 
-lval* builtin_join(lenv* e, lval* a) {
-	for(int i = 0; i < a->count; i++) {
-		LASSERT_TYPE("join", a, i, LVAL_QEXPR);
-	}
+			return v;
+		}
+		// Builtins go by their place in the table, lambdas come with their environment
+		case LVAL_FUN: {
+			if (x) {
+				lbuiltin func = lbuiltin_get(x - 1);
+				return func ? lval_builtin(func) : NULL;
+			}
 
-	lval* x = lval_pop(a, 0);
+			lenv* env = lcache_decode_env(p, end);
+			if (!env) return NULL;
 
-	while(a->count) {
-		lval* y = lval_pop(a, 0);
-		x = lval_join(x, y);
+			lval* formals = lcache_decode(p, end);
+			lval* body = formals ? lcache_decode(p, end) : NULL;
+			if (!body) {
+				if (formals) lval_del(formals);
+				lenv_del(env);
+				return NULL;
+			}
+
+			lval* v = lval_new(LVAL_FUN);
+			v->builtin = NULL;
+			v->env = env;
+			v->formals = formals;
+			v->body = body;
+			v->jit = ljit_new();
+			lglobals_lambda(v);
+			return v;
+		}
 	}
 
-	lval_del(a);
-	return x;
+	return NULL;
 }
 
-lval* builtin_op(lenv* e, lval* a, char* op) {
+lenv* lcache_decode_env(char** p, char* end) {
+	uint64_t count;
+	if (!lcache_decode_varint(p, end, &count) || count > (uint64_t)(end - *p)) return NULL;
 
-	for (int i = 0; i < a->count; i++) {
-		LASSERT_TYPE(op, a, i, LVAL_NUM);
+	lenv* e = lenv_new();
+	if (count) {
+		e->syms = malloc(sizeof(char*) * count);
+		e->vals = malloc(sizeof(lval*) * count);
+		LSTAT(stats.env_bytes += (sizeof(char*) + sizeof(lval*)) * count);
 	}
 
-	lval* x = lval_pop(a, 0);
-
-	if ((strcmp(op, "-") == 0) && a->count == 0)
-		x->num *= -1; // = -x->num;
-
-	while(a->count > 0) {
+	for (uint64_t i = 0; i < count; i++) {
+		uint64_t len;
+		if (!lcache_decode_varint(p, end, &len) || len > (uint64_t)(end - *p)) {
+			lenv_del(e);
+			return NULL;
+		}
 
-		lval* y = lval_pop(a, 0);
+		char* sym = *p;
+		*p += len;
 
-		if (strcmp(op, "+") == 0) { x->num += y->num;}
-		if (strcmp(op, "-") == 0) { x->num -= y->num;}
-		if (strcmp(op, "*") == 0) { x->num *= y->num;}
-		if (strcmp(op, "/") == 0) {
-			if(y->num == 0) {
-				lval_del(x);
-				lval_del(y);
-				x = lval_err("Division by Zero!");
-				break;
-			} else
-				x->num /= y->num;
+		lval* v = lcache_decode(p, end);
+		if (!v) {
+			lenv_del(e);
+			return NULL;
 		}
 
-		lval_del(y);
+		e->syms[e->count] = malloc(len + 1);
+		LSTAT(stats.string_bytes += len + 1);
+		memcpy(e->syms[e->count], sym, len);
+		e->syms[e->count][len] = '\0';
+		e->vals[e->count++] = v;
 	}
-	
-	lval_del(a);
-	return x;
+
+	return e;
 }
 
-lval* builtin_add(lenv* e, lval* a) { return builtin_op(e, a, "+"); }
+// Make room for n more bytes of encoded forms
+char* lcache_reserve(lcache* c, long n) {
+	if (c->length + n > c->slots) {
+		c->slots = (c->length + n) * 2;
+		c->data = realloc(c->data, c->slots);
+	}
+
+	char* p = c->data + c->length;
+	c->length += n;
+	return p;
+}
+
+void lcache_encode_varint(lcache* c, uint64_t x) {
+	while (x >= 0x80) {
+		*lcache_reserve(c, 1) = (char)(x | 0x80);
+		x >>= 7;
+	}
+	*lcache_reserve(c, 1) = (char)x;
+}
+
+void lcache_encode_text(lcache* c, char* s) {
+	long len = strlen(s);
+	lcache_encode_varint(c, len);
+	memcpy(lcache_reserve(c, len), s, len);
+}
+
+void lcache_encode(lcache* c, lval* v) {
+	*lcache_reserve(c, 1) = (char)v->type;
+
+	switch (v->type) {
+		case LVAL_NUM: {
+			int64_t num = v->num;
+			lcache_encode_varint(c, ((uint64_t)num << 1) ^ (uint64_t)(num >> 63));
+			break;
+		}
+		case LVAL_ERR: lcache_encode_text(c, v->err); break;
+		case LVAL_SYM: lcache_encode_text(c, v->sym); break;
+		case LVAL_STR: lcache_encode_text(c, v->str); break;
+		case LVAL_SEXPR:
+		case LVAL_QEXPR:
+			lcache_encode_varint(c, v->count);
+			for (int i = 0; i < v->count; i++)
+				lcache_encode(c, v->cell[i]);
+			break;
+		case LVAL_FUN:
+			if (v->builtin) {
+				int i = lbuiltin_index(v->builtin);
+				if (i < 0) c->failed = 1;
+				else lcache_encode_varint(c, i + 1);
+			} else {
+				lcache_encode_varint(c, 0);
+				lcache_encode_env(c, v->env);
+				lcache_encode(c, v->formals);
+				lcache_encode(c, v->body);
+			}
+			break;
+	}
+}
+
+// Parents are left out, they are only set for the duration of a call
+void lcache_encode_env(lcache* c, lenv* e) {
+	lcache_encode_varint(c, e->count);
+	for (int i = 0; i < e->count; i++) {
+		lcache_encode_text(c, e->syms[i]);
+		lcache_encode(c, e->vals[i]);
+	}
+}
+
+// Add a form read from the file to the cache
+void lcache_add(lcache* c, lval* x) {
+	if (!c->path || c->failed) return;
+
+	lcache_encode(c, x);
+	c->count++;
+}
+
+// Write a header and data out, a half written file is never seen as it is renamed into place
+int lcache_write(char* path, void* header, long size, char* data, long length) {
+	char* tmp = malloc(strlen(path) + 8);
+	sprintf(tmp, "%s.XXXXXX", path);
+
+	int ok = 0;
+	int fd = mkstemp(tmp);
+	if (fd >= 0) {
+		fchmod(fd, 0644);
+
+		ok = write(fd, header, size) == size
+			&& (length == 0 || write(fd, data, length) == length);
+		close(fd);
+
+		ok = ok && rename(tmp, path) == 0;
+		if (!ok) unlink(tmp);
+	}
+
+	free(tmp);
+	return ok;
+}
+
+// Make each directory leading up to path
+void lcache_mkdirs(char* path) {
+	for (char* p = strchr(path + 1, '/'); p; p = strchr(p + 1, '/')) {
+		*p = '\0';
+		mkdir(path, 0755);
+		*p = '/';
+	}
+}
+
+void lcache_save(lcache* c) {
+	if (!c->path || c->failed) return;
+
+	lcache_header h = { { 'L', 'P', 'L', 'C' }, LCACHE_ORDER, c->hash, c->size, c->length, c->count, LCACHE_VERSION };
+
+	// The directory is only made once a write fails, a cache that still cannot be written is simply skipped
+	if (!lcache_write(c->path, &h, sizeof(h), c->data, c->length)) {
+		lcache_mkdirs(c->path);
+		lcache_write(c->path, &h, sizeof(h), c->data, c->length);
+	}
+}
+
+void lcache_delete(lcache* c) {
+	if (c->size > 0) munmap(c->text, c->size);
+	free(c->path);
+	free(c->data);
+}
+
+/* Split loading */
+
+enum { LOAD_SPLIT_MIN = 8 << 20, LOAD_SPLIT_CHUNK_MIN = 1 << 20 };
+
+// Find up to chunks places to split text, each at the start of a line between top level forms
+int lload_scan(char* text, long size, int chunks, mpc_state_t* starts) {
+	int depth = 0, n = 1;
+	long row = 0;
+
+	starts[0] = (mpc_state_t){ 0, 0, 0 };
+
+	for (long i = 0; i < size && n < chunks; i++) {
+		switch (text[i]) {
+			case '"':
+				// Skip the string, escapes included
+				for (i++; i < size && text[i] != '"'; i++) {
+					if (text[i] == '\\' && i + 1 < size) i++;
+					if (text[i] == '\n') row++;
+				}
+				break;
+			case ';':
+				// Comments run to the end of the line
+				while (i + 1 < size && text[i+1] != '\n') i++;
+				break;
+			case '(': case '{': depth++; break;
+			case ')': case '}': if (depth > 0) depth--; break;
+			case '\n':
+				row++;
+				if (depth == 0 && i + 1 < size && i + 1 >= size / chunks * n)
+					starts[n++] = (mpc_state_t){ i + 1, row, 0 };
+				break;
+		}
+	}
+
+	return n;
+}
+
+// Whether a form could end in this line of a piped stream, by the same rules for strings, comments and brackets
+int lload_bound(const char* text, long size, void* state) {
+	lbound* b = state;
+	int end = 0;
+
+	for (long i = 0; i < size; i++) {
+		char c = text[i];
+		if (b->in == '\\') b->in = '"';
+		else if (b->in == '"') b->in = c == '\\' ? '\\' : c == '"' ? 0 : '"';
+		else if (b->in == ';') b->in = c == '\n' || c == '\r' ? 0 : ';';
+		else if (c == '"' || c == ';') b->in = c;
+		else if (c == '(' || c == '{') b->depth++;
+		else if ((c == ')' || c == '}') && b->depth > 0) b->depth--;
+
+		if (b->depth == 0 && b->in != '"' && b->in != '\\') end = 1;
+	}
+
+	return end;
+}
+
+// Read the forms of a stream up to a parse error, which is left in err, adding them to the cache c if given
+lval* lload_forms(mpc_stream_t* s, mpc_arena_t* arena, lcache* c, lval** err) {
+	mpc_result_t r;
+	lval* expr = lval_sexpr();
+	*err = NULL;
+
+	while (!mpc_stream_done(s)) {
+		if (!mpc_stream_next(s, Expr, &r)) {
+			char* err_msg = mpc_err_string(r.error);
+			mpc_err_delete(r.error);
+
+			*err = lval_err("Could not load library: %s", err_msg);
+			free(err_msg);
+
+			// A file that does not parse is never cached
+			if (c) c->failed = 1;
+			break;
+		}
+
+		// Comments read as nothing
+		mpc_ast_t* t = r.output;
+		if (!strstr(t->tag, "comment")) {
+			lval* x = lval_read(t);
+			if (c) lcache_add(c, x);
+			expr = lval_add(expr, x);
+		}
+		mpc_arena_clear(arena);
+	}
+
+	return expr;
+}
+
+void* lload_chunk(void* arg) {
+	lchunk* c = arg;
+	mpc_arena_t* arena = mpc_arena_new();
+	mpc_stream_t* s = mpc_stream_view_range(c->filename, c->text, c->start, c->end, arena);
+
+	uint32_t id = tracer.on ? ltrace_intern(c->filename, strlen(c->filename)) : 0;
+	if (tracer.on) ltrace_emit(LTRACE_PARSE_START, id);
+	c->expr = lload_forms(s, arena, NULL, &c->err);
+	if (tracer.on) ltrace_emit(LTRACE_PARSE_END, id);
+
+	mpc_stream_delete(s);
+	mpc_arena_delete(arena);
+	return NULL;
+}
+
+// Parse a large file in chunks on several threads, NULL when it is not worth it.
+// Chunks are read form by form as the file would be streamed, so a parse error in
+// one leaves the forms before it, of its own chunk and the ones before, and is left in err
+lval* lload_split(char* filename, char* text, long size, lval** err) {
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	long chunks = size / LOAD_SPLIT_CHUNK_MIN;
+	if (chunks > cores) chunks = cores;
+
+	if (size < LOAD_SPLIT_MIN || chunks < 2) return NULL;
+
+	mpc_state_t* starts = malloc(sizeof(mpc_state_t) * chunks);
+	int n = lload_scan(text, size, (int)chunks, starts);
+
+	lchunk* parts = malloc(sizeof(lchunk) * n);
+	pthread_t* threads = malloc(sizeof(pthread_t) * n);
+
+	for (int i = 0; i < n; i++) {
+		parts[i].filename = filename;
+		parts[i].text = text;
+		parts[i].start = starts[i];
+		parts[i].end = i + 1 < n ? starts[i+1].pos : size;
+
+		// The first chunk is parsed on this thread, as is any that fails to start
+		if (i == 0 || pthread_create(&threads[i], NULL, lload_chunk, &parts[i]) != 0) {
+			threads[i] = pthread_self();
+			lload_chunk(&parts[i]);
+		}
+	}
+
+	// Splice the forms together, up to the first error in the file
+	lval* expr = lval_sexpr();
+	*err = NULL;
+	for (int i = 0; i < n; i++) {
+		if (!pthread_equal(threads[i], pthread_self()))
+			pthread_join(threads[i], NULL);
+
+		if (*err) {
+			lval_del(parts[i].expr);
+			if (parts[i].err) lval_del(parts[i].err);
+		} else {
+			expr = lval_join(expr, parts[i].expr);
+			*err = parts[i].err;
+		}
+	}
+
+	free(threads);
+	free(parts);
+	free(starts);
+
+	return expr;
+}
+
+lval* builtin_load(lenv* e, lval* a) {
+	LASSERT_NUM("load", a, 1);
+	LASSERT_TYPE("load", a, 0, LVAL_STR);
+
+	char* filename = a->cell[0]->str;
+	lcache c;
+
+	uint32_t id = tracer.on ? ltrace_intern(filename, strlen(filename)) : 0;
+	if (tracer.on) ltrace_emit(LTRACE_LOAD_START, id);
+
+	// Forms read before from the same source come straight from the cache
+	lval* expr = lcache_open(&c, filename);
+	lval* err = NULL;
+
+	// Large files are parsed in parallel chunks instead of streamed, from the text the cache hashed
+	if (!expr && c.text && (expr = lload_split(filename, c.text, c.size, &err)) && !err) {
+		for (int i = 0; i < expr->count; i++) lcache_add(&c, expr->cell[i]);
+		lcache_save(&c);
+	}
+
+	if (expr) {
+		lcache_delete(&c);
+		lval_del(a);
+
+		lval* x = lload_eval(e, expr, err);
+		if (tracer.on) ltrace_emit(LTRACE_LOAD_END, id);
+		return x;
+	}
+
+	// Stream the file given by string name, each form is evaluated as soon as it is parsed
+	mpc_arena_t* arena = mpc_arena_new();
+	mpc_stream_t* s = c.text
+		? mpc_stream_view(filename, c.text, c.size, arena)
+		: mpc_stream_contents(filename, arena);
+	lbound b = { 0, 0 };
+	mpc_stream_bound(s, lload_bound, &b);
+
+	lval* x = lval_load(e, s, arena, &c);
+	lcache_save(&c);
+
+	mpc_stream_delete(s);
+	mpc_arena_delete(arena);
+	lcache_delete(&c);
+	lval_del(a);
+
+	if (tracer.on) ltrace_emit(LTRACE_LOAD_END, id);
+	return x;
+}
+
+// (load-native "path.so") adds the builtins of a native module to the global environment, see LIPL.h
+lval* builtin_load_native(lenv* e, lval* a) {
+	LASSERT_NUM("load-native", a, 1);
+	LASSERT_TYPE("load-native", a, 0, LVAL_STR);
+
+	char* filename = a->cell[0]->str;
+	lval* err = NULL;
+
+	// A module is never closed, its builtins may be held anywhere once added
+	void* module = dlopen(filename, RTLD_NOW | RTLD_LOCAL);
+	if (!module) {
+		err = lval_err("Could not load native module: %s", dlerror());
+		lval_del(a);
+		return err;
+	}
+
+	const int* abi = dlsym(module, "lipl_abi");
+	lipl_init_func init = (lipl_init_func)dlsym(module, "lipl_init");
+
+	while (e->parent) e = e->parent;
+
+	// One that fails to start may have added some of its builtins already, so stays open too
+	if (!abi || !init) {
+		err = lval_err("Native module %s has no lipl_init, see LIPL.h.", filename);
+		dlclose(module);
+	} else if (*abi != LIPL_ABI) {
+		err = lval_err("Native module %s was built for version %i of LIPL.h, not %i.", filename, *abi, LIPL_ABI);
+		dlclose(module);
+	} else if (init(e) != 0) {
+		err = lval_err("Native module %s could not start.", filename);
+	}
+
+	lval_del(a);
+	return err ? err : lval_sexpr();
+}
+
+// Evaluate standard input as it arrives
+lval* lval_load_stdin(lenv* e) {
+	mpc_arena_t* arena = mpc_arena_new();
+	mpc_stream_t* s = mpc_stream_pipe("<stdin>", stdin, arena);
+	lbound b = { 0, 0 };
+	mpc_stream_bound(s, lload_bound, &b);
+
+	lval* x = lval_load(e, s, arena, NULL);
+
+	mpc_stream_delete(s);
+	mpc_arena_delete(arena);
+
+	return x;
+}
+
+/* Parallel loading */
+
+// Parse and read a whole file, this runs on a loader thread so it must not touch any environment.
+// Forms are read one at a time as builtin_load streams them, so on a parse error the forms before
+// it are still returned, to be evaluated before the error is reported in err
+lval* lload_read(char* filename, lval** err) {
+	lcache c;
+	lval* expr = lcache_open(&c, filename);
+	*err = NULL;
+	if (expr) {
+		lcache_delete(&c);
+		return expr;
+	}
+
+	mpc_arena_t* arena = mpc_arena_new();
+	mpc_stream_t* s = c.text
+		? mpc_stream_view(filename, c.text, c.size, arena)
+		: mpc_stream_contents(filename, arena);
+
+	uint32_t id = tracer.on ? ltrace_intern(filename, strlen(filename)) : 0;
+	if (tracer.on) ltrace_emit(LTRACE_PARSE_START, id);
+	expr = lload_forms(s, arena, &c, err);
+	if (tracer.on) ltrace_emit(LTRACE_PARSE_END, id);
+
+	lcache_save(&c);
+
+	mpc_stream_delete(s);
+	mpc_arena_delete(arena);
+	lcache_delete(&c);
+	return expr;
+}
+
+// Evaluate the forms read from a file in order, then return the error that ended them if there was one
+lval* lload_eval(lenv* e, lval* expr, lval* err) {
+	for (int i = 0; i < expr->count; i++) {
+		lval* x = lval_eval(e, expr->cell[i]);
+
+		// Print errors
+		if (x->type == LVAL_ERR) {
+			lval_println(x);
+			ltrace_error();
+		}
+
+		lval_del(x);
+	}
+
+	expr->count = 0;
+	lval_del(expr);
+
+	return err ? err : lval_sexpr();
+}
+
+void* lload_worker(void* arg) {
+	lpool* p = arg;
+
+	while (1) {
+		pthread_mutex_lock(&p->lock);
+		int i = p->next++;
+		pthread_mutex_unlock(&p->lock);
+
+		if (i >= p->count) return NULL;
+
+		// Standard input is left to the main thread, which streams it in turn
+		lval* err = NULL;
+		lval* expr = strcmp(p->loads[i].filename, "-") == 0
+			? NULL : lload_read(p->loads[i].filename, &err);
+
+		pthread_mutex_lock(&p->lock);
+		p->loads[i].expr = expr;
+		p->loads[i].err = err;
+		p->loads[i].ready = 1;
+		pthread_cond_broadcast(&p->ready);
+		pthread_mutex_unlock(&p->lock);
+	}
+}
+
+// Parse files on a pool of threads while evaluating them in the order given
+void lload_files(lenv* e, int count, char** filenames) {
+
+	// A single file is streamed instead
+	if (count == 1) {
+		lval* x = strcmp(filenames[0], "-") == 0
+			? lval_load_stdin(e)
+			: builtin_load(e, lval_add(lval_sexpr(), lval_str(filenames[0])));
+		if (x->type == LVAL_ERR) {
+			lval_println(x);
+			ltrace_error();
+		}
+		lval_del(x);
+		return;
+	}
+
+	lpool p;
+	p.loads = malloc(sizeof(lload) * count);
+	p.count = count;
+	p.next = 0;
+	pthread_mutex_init(&p.lock, NULL);
+	pthread_cond_init(&p.ready, NULL);
+
+	for (int i = 0; i < count; i++) {
+		p.loads[i].filename = filenames[i];
+		p.loads[i].expr = NULL;
+		p.loads[i].err = NULL;
+		p.loads[i].ready = 0;
+	}
+
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	int threads_max = cores < 1 ? 1 : cores < count ? (int)cores : count;
+	pthread_t* threads = malloc(sizeof(pthread_t) * threads_max);
+
+	int threads_num = 0;
+	while (threads_num < threads_max
+	&& pthread_create(&threads[threads_num], NULL, lload_worker, &p) == 0)
+		threads_num++;
+
+	// Without any threads everything is read up front
+	if (threads_num == 0) lload_worker(&p);
+
+	for (int i = 0; i < count; i++) {
+		pthread_mutex_lock(&p.lock);
+		while (!p.loads[i].ready)
+			pthread_cond_wait(&p.ready, &p.lock);
+		pthread_mutex_unlock(&p.lock);
+
+		uint32_t id = tracer.on ? ltrace_intern(filenames[i], strlen(filenames[i])) : 0;
+		if (tracer.on) ltrace_emit(LTRACE_LOAD_START, id);
+
+		lval* x = p.loads[i].expr
+			? lload_eval(e, p.loads[i].expr, p.loads[i].err)
+			: lval_load_stdin(e);
+
+		if (tracer.on) ltrace_emit(LTRACE_LOAD_END, id);
+
+		if (x->type == LVAL_ERR) {
+			lval_println(x);
+			ltrace_error();
+		}
+		lval_del(x);
+	}
+
+	for (int i = 0; i < threads_num; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+	free(p.loads);
+	pthread_mutex_destroy(&p.lock);
+	pthread_cond_destroy(&p.ready);
+}
+
+lval* builtin_if(lenv* e, lval* a) {
+	LASSERT_NUM("if", a, 3);
+	LASSERT_TYPE("if", a, 0, LVAL_NUM);
+	LASSERT_TYPE("if", a, 1, LVAL_QEXPR);
+	LASSERT_TYPE("if", a, 2, LVAL_QEXPR);
+
+	lval* x;
+	a->cell[1]->type = LVAL_SEXPR;
+	a->cell[2]->type = LVAL_SEXPR;
+
+	if (a->cell[0]->num) { x = lval_eval(e, lval_pop(a, 1)); }
+	else { x = lval_eval(e, lval_pop(a, 2)); }
+
+	lval_del(a);
+	return x;
+}
+
+lval* builtin_cmp(lenv* e, lval* a, char* op) {
+	LASSERT_NUM(op, a, 2);
+
+	int r;
+	if (strcmp(op, "==") == 0) r = lval_eq(a->cell[0], a->cell[1]);
+	if (strcmp(op, "!=") == 0) r = ! lval_eq(a->cell[0], a->cell[1]);
+
+	lval_del(a);
+	return lval_num(r);
+}
+
+lval* builtin_eq(lenv* e, lval* a) { return builtin_cmp(e, a, "=="); }
+lval* builtin_ne(lenv* e, lval* a) { return builtin_cmp(e, a, "!="); }
+
+lval* builtin_ord(lenv* e, lval* a, char* op) {
+	LASSERT_NUM(op, a, 2);
+	LASSERT_TYPE(op, a, 0, LVAL_NUM);
+	LASSERT_TYPE(op, a, 1, LVAL_NUM);
+
+	int r;
+
+	if (strcmp(op, ">") == 0) r = (a->cell[0]->num > a->cell[1]->num);
+	if (strcmp(op, "<") == 0) r = (a->cell[0]->num < a->cell[1]->num);
+	if (strcmp(op, "<=") == 0) r = (a->cell[0]->num <= a->cell[1]->num);
+	if (strcmp(op, ">=") == 0) r = (a->cell[0]->num >= a->cell[1]->num);
+
+	lval_del(a);
+	return lval_num(r);
+}
+
+lval* builtin_gt(lenv* e, lval* a) { return builtin_ord(e, a, ">"); }
+lval* builtin_lt(lenv* e, lval* a) { return builtin_ord(e, a, "<"); }
+lval* builtin_ge(lenv* e, lval* a) { return builtin_ord(e, a, ">="); }
+lval* builtin_le(lenv* e, lval* a) { return builtin_ord(e, a, ">="); }
+
+lval* builtin_lambda(lenv* e, lval* a) {
+	LASSERT_NUM("\\", a, 2);
+	LASSERT_TYPE("\\", a, 0, LVAL_QEXPR);
+	LASSERT_TYPE("\\", a, 1, LVAL_QEXPR);
+	
+	for(int i = 0; i < a->cell[0]->count; i++)
+		LASSERT(a, (a->cell[0]->cell[i]->type == LVAL_SYM),
+			"Cannot define non-symbol. Got %s, expected %s.",
+			ltype_name(a->cell[0]->cell[i]->type), ltype_name(LVAL_SYM));
+
+	lval* formals = lval_pop(a, 0);
+	lval* body = lval_pop(a, 0);
+	lval_del(a);
+	
+	return lval_lambda(formals, body);
+}
+
+lval* builtin_var(lenv* e, lval* a, char* func) {
+	LASSERT_TYPE("def", a, 0, LVAL_QEXPR);
+	
+	// First argument is a symbol list
+	lval* syms = a->cell[0];
+	
+	// Ensure first list only contain elements that are symbols
+	for (int i = 0; i < syms->count; i++) {
+		LASSERT(a, (syms->cell[i]->type == LVAL_SYM),
+			"Function '%s' cannot define non-symbols! "
+			"Got %s, expected %s.",
+			func,
+			ltype_name(syms->cell[i]->type),
+			ltype_name(LVAL_SYM));
+	}
+	
+	// Check correct number of symbols and values
+	LASSERT(a, (syms->count == a->count-1),
+		"Function '%s' passed too many arguments for symbols. "
+		"Got %i, expected %i.",
+		func, syms->count, a->count-1);
+	
+	for (int i = 0; i < syms->count; i++) {
+		// def: define globally
+		// put: define locally
+		if(strcmp(func, "def") == 0)
+			lenv_def(e, syms->cell[i], a->cell[i+1]);
+		if(strcmp(func, "=") == 0)
+			lenv_put(e, syms->cell[i], a->cell[i+1]);
+	}
+
+	lval_del(a);
+	return lval_sexpr();
+}
+
+lval* builtin_def(lenv* e, lval* v) { return builtin_var(e, v, "def"); }
+lval* builtin_put(lenv* e, lval* v) { return builtin_var(e, v, "="); }
+
+lval* builtin_list(lenv* e, lval* a) {
+	a->type = LVAL_QEXPR;
+	return a;
+}
+
+lval* builtin_head(lenv* e, lval* a) {
+	LASSERT_NUM("head", a, 1);
+	LASSERT_TYPE("head", a, 0, LVAL_QEXPR);
+	LASSERT_NOT_EMPTY("head", a, 0);
+
+	lval* v = lval_take(a, 0);
+	while(v->count > 1) {lval_del(lval_pop(v, 1));}
+	return v;
+}
+
+lval* builtin_tail(lenv* e, lval* a) {
+	LASSERT_NUM("tail", a, 1);
+	LASSERT_TYPE("tail", a, 0, LVAL_QEXPR);
+	LASSERT_NOT_EMPTY("tail", a, 0);
+
+	lval* v = lval_take(a, 0);
+	lval_del(lval_pop(v, 0));
+	return v;
+}
+
+lval* builtin_eval(lenv* e, lval* a) {
+	LASSERT_NUM("eval", a, 1);
+	LASSERT_TYPE("eval", a, 0, LVAL_QEXPR);
+
+	lval* x = lval_take(a, 0);
+	x->type = LVAL_SEXPR;
+	return lval_eval(e, x);
+}
+
+lval* builtin_join(lenv* e, lval* a) {
+	for(int i = 0; i < a->count; i++) {
+		LASSERT_TYPE("join", a, i, LVAL_QEXPR);
+	}
+
+	lval* x = lval_pop(a, 0);
+
+	while(a->count) {
+		lval* y = lval_pop(a, 0);
+		x = lval_join(x, y);
+	}
+
+	lval_del(a);
+	return x;
+}
+
+lval* builtin_op(lenv* e, lval* a, char* op) {
+
+	for (int i = 0; i < a->count; i++) {
+		LASSERT_TYPE(op, a, i, LVAL_NUM);
+	}
+
+	lval* x = lval_pop(a, 0);
+
+	if ((strcmp(op, "-") == 0) && a->count == 0)
+		x->num *= -1; // = -x->num;
+
+	while(a->count > 0) {
+
+		lval* y = lval_pop(a, 0);
+
+		if (strcmp(op, "+") == 0) { x->num += y->num;}
+		if (strcmp(op, "-") == 0) { x->num -= y->num;}
+		if (strcmp(op, "*") == 0) { x->num *= y->num;}
+		if (strcmp(op, "/") == 0) {
+			if(y->num == 0) {
+				lval_del(x);
+				lval_del(y);
+				x = lval_err("Division by Zero!");
+				break;
+			} else
+				x->num /= y->num;
+		}
+
+		lval_del(y);
+	}
+	
+	lval_del(a);
+	return x;
+}
+
+lval* builtin_add(lenv* e, lval* a) { return builtin_op(e, a, "+"); }
 lval* builtin_sub(lenv* e, lval* a) { return builtin_op(e, a, "-"); }
 lval* builtin_mul(lenv* e, lval* a) { return builtin_op(e, a, "*"); }
 lval* builtin_div(lenv* e, lval* a) { return builtin_op(e, a, "/"); }
 
-void lenv_add_builtin(lenv* e, char* name, lbuiltin func) {
-	lval* k = lval_sym(name);
-	lval* v = lval_builtin(func);
-	lenv_put(e, k, v);
-	lval_del(k);
-	lval_del(v);
+void lenv_add_builtin(lenv* e, char* name, lbuiltin func) {
+	lval* k = lval_sym(name);
+	lval* v = lval_builtin(func);
+	lenv_put(e, k, v);
+	lval_del(k);
+	lval_del(v);
+}
+
+// Every builtin, images refer to them by their place here
+lbuiltin_name lbuiltins[] = {
+	/* Variable functions */
+	{ "def", builtin_def },
+	{ "=", builtin_put },
+	{ "\\", builtin_lambda },
+
+	/* List functions */
+	{ "list", builtin_list },
+	{ "head", builtin_head },
+	{ "tail", builtin_tail },
+	{ "eval", builtin_eval },
+	{ "join", builtin_join },
+
+	/* Math functions */
+	{ "+", builtin_add },
+	{ "-", builtin_sub },
+	{ "*", builtin_mul },
+	{ "/", builtin_div },
+
+	/* Comparison functions */
+	{ "if", builtin_if },
+	{ "==", builtin_eq },
+	{ "!=", builtin_ne },
+	{ ">", builtin_gt },
+	{ "<", builtin_lt },
+	{ ">=", builtin_ge },
+	{ "<=", builtin_le },
+
+	/* String functions */
+	{ "load", builtin_load },
+	{ "load-native", builtin_load_native },
+	{ "error", builtin_error },
+	{ "print", builtin_print },
+
+	/* Profiling and statistics */
+	{ "profile", builtin_profile },
+	{ "memstats", builtin_memstats },
+	{ "time", builtin_time },
+	{ "trace-dump", builtin_trace_dump },
+};
+
+enum { LBUILTINS_NUM = sizeof(lbuiltins) / sizeof(lbuiltins[0]) };
+
+void lenv_add_builtins(lenv* e) {
+	for (int i = 0; i < LBUILTINS_NUM; i++)
+		lenv_add_builtin(e, lbuiltins[i].name, lbuiltins[i].func);
+}
+
+int lbuiltin_index(lbuiltin func) {
+	for (int i = 0; i < LBUILTINS_NUM; i++)
+		if (lbuiltins[i].func == func) return i;
+	return -1;
+}
+
+lbuiltin lbuiltin_get(uint64_t i) {
+	return i < LBUILTINS_NUM ? lbuiltins[i].func : NULL;
+}
+
+char* lbuiltin_get_name(lbuiltin func) {
+	int i = lbuiltin_index(func);
+	return i < 0 ? "builtin" : lbuiltins[i].name;
+}
+
+// An image is only good for the table of builtins it was dumped with
+uint64_t lbuiltins_hash(void) {
+	uint64_t h = 0;
+	for (int i = 0; i < LBUILTINS_NUM; i++)
+		h = (h ^ lcache_hash(lbuiltins[i].name, strlen(lbuiltins[i].name) + 1)) * 1099511628211ULL;
+	return h;
+}
+
+/* Heap images */
+
+enum { LIMAGE_VERSION = 1 };
+
+// Write the global environment with all its definitions to an image
+lval* limage_dump(lenv* e, char* filename) {
+	lcache c = { 0 };
+	lcache_encode_env(&c, e);
+
+	limage_header h = { { 'L', 'P', 'L', 'I' }, LCACHE_ORDER, lbuiltins_hash(), c.length, LIMAGE_VERSION, 0 };
+
+	int ok = !c.failed && lcache_write(filename, &h, sizeof(h), c.data, c.length);
+	lcache_delete(&c);
+
+	if (!ok) return lval_err("Could not dump image: %s", filename);
+	return lval_sexpr();
+}
+
+// Map an image back as a global environment, NULL if it cannot be used
+lenv* limage_load(char* filename) {
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) return NULL;
+
+	struct stat st;
+	char* data = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(limage_header))
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED) return NULL;
+
+	limage_header h;
+	memcpy(&h, data, sizeof(h));
+
+	lenv* e = NULL;
+	if (memcmp(h.magic, "LPLI", 4) == 0 && h.order == LCACHE_ORDER && h.version == LIMAGE_VERSION
+		&& h.builtins == lbuiltins_hash() && h.length == st.st_size - (off_t)sizeof(h)) {
+		char* p = data + sizeof(h);
+		char* end = p + h.length;
+
+		e = lcache_decode_env(&p, end);
+		if (e && p != end) {
+			lenv_del(e);
+			e = NULL;
+		}
+	}
+
+	munmap(data, st.st_size);
+	return e;
+}
+
+/* Profiling */
+
+enum { LPROF_OFF, LPROF_EXACT, LPROF_SAMPLE };
+
+// Microseconds of CPU time between samples
+enum { LPROF_INTERVAL = 1000 };
+
+lprof profiler;
+
+double lprof_now(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Runs on SIGPROF, the node it counts against is never freed while the timer is set
+void lprof_sample(int sig) {
+	profiler.current->samples++;
+}
+
+// Start a profile afresh. Exact mode times every call, sampling mode only keeps the stack for SIGPROF to look at
+void lprof_start(int mode) {
+	profiler = (lprof){ 0 };
+	profiler.root.func = -1;
+	profiler.current = &profiler.root;
+	profiler.mode = mode;
+	profiler.sampled = mode == LPROF_SAMPLE;
+
+	if (mode == LPROF_SAMPLE) {
+		struct sigaction sa = { 0 };
+		sa.sa_handler = lprof_sample;
+		sa.sa_flags = SA_RESTART;
+		sigemptyset(&sa.sa_mask);
+		sigaction(SIGPROF, &sa, NULL);
+
+		struct itimerval t = { { 0, LPROF_INTERVAL }, { 0, LPROF_INTERVAL } };
+		setitimer(ITIMER_PROF, &t, NULL);
+	}
+}
+
+void lprof_stop(void) {
+	if (profiler.mode == LPROF_SAMPLE) {
+		struct itimerval t = { { 0, 0 }, { 0, 0 } };
+		setitimer(ITIMER_PROF, &t, NULL);
+		signal(SIGPROF, SIG_DFL);
+	}
+
+	profiler.mode = LPROF_OFF;
+}
+
+void lprof_node_del(lprof_node* n) {
+	while (n) {
+		lprof_node* next = n->next;
+		lprof_node_del(n->child);
+		free(n);
+		n = next;
+	}
+}
+
+void lprof_clear(void) {
+	lprof_node_del(profiler.root.child);
+	for (int i = 0; i < profiler.names_count; i++) free(profiler.names[i]);
+	free(profiler.names);
+	free(profiler.frames);
+	profiler = (lprof){ 0 };
+}
+
+int lprof_intern(char* name) {
+	for (int i = 0; i < profiler.names_count; i++)
+		if (strcmp(profiler.names[i], name) == 0) return i;
+
+	profiler.names = realloc(profiler.names, sizeof(char*) * (profiler.names_count + 1));
+	profiler.names[profiler.names_count] = malloc(strlen(name) + 1);
+	strcpy(profiler.names[profiler.names_count], name);
+	return profiler.names_count++;
+}
+
+// Push a call to f onto the shadow stack, name is the symbol it was looked up by if any
+void lprof_enter(lval* f, char* name) {
+	if (f->builtin) name = lbuiltin_get_name(f->builtin);
+	else if (!name) name = "lambda";
+
+	// Most calls repeat a path already seen, so look among the callees of this node first
+	lprof_node* parent = profiler.current;
+	lprof_node* n = parent->child;
+	while (n && strcmp(profiler.names[n->func], name) != 0) n = n->next;
+
+	if (!n) {
+		n = calloc(1, sizeof(lprof_node));
+		n->func = lprof_intern(name);
+		n->parent = parent;
+		n->next = parent->child;
+		parent->child = n;
+	}
+
+	if (profiler.depth == profiler.slots) {
+		profiler.slots = profiler.slots ? profiler.slots * 2 : 64;
+		profiler.frames = realloc(profiler.frames, sizeof(lprof_frame) * profiler.slots);
+	}
+
+	lprof_frame* t = &profiler.frames[profiler.depth++];
+	if (profiler.depth > profiler.deepest) profiler.deepest = profiler.depth;
+	t->node = n;
+	t->inner = 0;
+	n->calls++;
+	profiler.current = n;
+
+	if (profiler.mode == LPROF_EXACT) t->start = lprof_now();
+}
+
+void lprof_leave(void) {
+	lprof_frame* t = &profiler.frames[--profiler.depth];
+
+	if (profiler.mode == LPROF_EXACT) {
+		double elapsed = lprof_now() - t->start;
+		t->node->self += elapsed - t->inner;
+		if (profiler.depth) profiler.frames[profiler.depth-1].inner += elapsed;
+	}
+
+	profiler.current = t->node->parent;
+}
+
+// Time spent in a node itself, as measured or as sampled
+double lprof_self(lprof_node* n) {
+	return profiler.sampled ? n->samples * (LPROF_INTERVAL / 1e6) : n->self;
+}
+
+// Sum each node into its function, a function's inclusive time only counts its outermost calls
+double lprof_sum(lprof_node* n, long* calls, double* self, double* total, int* active) {
+	double sum = lprof_self(n);
+
+	if (n->func >= 0) {
+		calls[n->func] += n->calls;
+		self[n->func] += sum;
+		active[n->func]++;
+	}
+
+	for (lprof_node* c = n->child; c; c = c->next)
+		sum += lprof_sum(c, calls, self, total, active);
+
+	if (n->func >= 0 && --active[n->func] == 0) total[n->func] += sum;
+
+	return sum;
+}
+
+// Per function calls, inclusive and exclusive time, heaviest exclusive first
+void lprof_report(FILE* f) {
+	int n = profiler.names_count;
+	long* calls = calloc(n + 1, sizeof(long));
+	double* self = calloc(n + 1, sizeof(double));
+	double* total = calloc(n + 1, sizeof(double));
+	int* active = calloc(n + 1, sizeof(int));
+	int* order = malloc(sizeof(int) * (n + 1));
+
+	lprof_sum(&profiler.root, calls, self, total, active);
+
+	for (int i = 0; i < n; i++) {
+		int j = i;
+		while (j > 0 && self[order[j-1]] < self[i]) {
+			order[j] = order[j-1];
+			j--;
+		}
+		order[j] = i;
+	}
+
+	fprintf(f, "%-24s %12s %14s %14s\n", "function", "calls", "inclusive ms", "exclusive ms");
+	for (int i = 0; i < n; i++) {
+		int k = order[i];
+		fprintf(f, "%-24s %12ld %14.3f %14.3f\n", profiler.names[k], calls[k], total[k] * 1e3, self[k] * 1e3);
+	}
+
+	free(calls);
+	free(self);
+	free(total);
+	free(active);
+	free(order);
+}
+
+void lprof_folded_node(FILE* f, lprof_node* n, lprof_node** path, int depth) {
+	path[depth++] = n;
+
+	// Exact times are written in microseconds, samples as they are
+	long weight = profiler.sampled ? n->samples : (long)(n->self * 1e6 + 0.5);
+
+	if (weight > 0) {
+		for (int i = 0; i < depth; i++)
+			fprintf(f, "%s%s", i ? ";" : "", profiler.names[path[i]->func]);
+		fprintf(f, " %ld\n", weight);
+	}
+
+	for (lprof_node* c = n->child; c; c = c->next)
+		lprof_folded_node(f, c, path, depth);
+}
+
+// One line per stack, its functions joined by ';' and then its weight, as flame graph tools read
+void lprof_folded(FILE* f) {
+	lprof_node** path = malloc(sizeof(lprof_node*) * (profiler.deepest + 1));
+	for (lprof_node* c = profiler.root.child; c; c = c->next)
+		lprof_folded_node(f, c, path, 0);
+	free(path);
+}
+
+// Write the report to filename and the folded stacks next to it in filename.folded
+lval* lprof_save(char* filename) {
+	char* folded = malloc(strlen(filename) + 8);
+	sprintf(folded, "%s.folded", filename);
+
+	FILE* f = fopen(filename, "w");
+	if (f) {
+		lprof_report(f);
+		fclose(f);
+	}
+
+	FILE* g = f ? fopen(folded, "w") : NULL;
+	if (g) {
+		lprof_folded(g);
+		fclose(g);
+	}
+
+	free(folded);
+
+	if (!g) return lval_err("Could not write profile: %s", filename);
+	return lval_sexpr();
+}
+
+// (profile {expr}) prints where the time of evaluating expr went, (profile {expr} "file") also writes its folded stacks
+lval* builtin_profile(lenv* e, lval* a) {
+	LASSERT(a, a->count == 1 || a->count == 2,
+		"Function 'profile' passed incorrect number of arguments. "
+		"Got %i, expected 1 or 2.", a->count);
+	LASSERT_TYPE("profile", a, 0, LVAL_QEXPR);
+	if (a->count == 2) LASSERT_TYPE("profile", a, 1, LVAL_STR);
+
+	lval* x = lval_pop(a, 0);
+	x->type = LVAL_SEXPR;
+
+	// Under a profile started from the command line this is just evaluation
+	if (profiler.mode) {
+		lval_del(a);
+		return lval_eval(e, x);
+	}
+
+	lprof_start(LPROF_EXACT);
+	x = lval_eval(e, x);
+	lprof_stop();
+
+	lprof_report(stdout);
+
+	if (a->count == 1) {
+		FILE* f = fopen(a->cell[0]->str, "w");
+		if (f) {
+			lprof_folded(f);
+			fclose(f);
+		} else {
+			lval_del(x);
+			x = lval_err("Could not write profile: %s", a->cell[0]->str);
+		}
+	}
+
+	lprof_clear();
+	lval_del(a);
+	return x;
+}
+
+/* Memory statistics */
+
+// Name and value of every counter, in the order (memstats) lists them
+int lstats_read(char names[][LSTATS_NAME], unsigned long* values) {
+	int n = 0;
+#ifdef LIPL_STATS
+	static char* types[] = { "num", "err", "sym", "str", "sexpr", "qexpr", "fun" };
+	int count = sizeof(types) / sizeof(types[0]);
+
+	// Lists change between S- and Q-expressions in place, so their allocs and frees need not match
+	for (int t = 0; t < count; t++) {
+		snprintf(names[n], LSTATS_NAME, "allocs_%s", types[t]);
+		values[n++] = stats.allocs[t];
+	}
+	for (int t = 0; t < count; t++) {
+		snprintf(names[n], LSTATS_NAME, "frees_%s", types[t]);
+		values[n++] = stats.frees[t];
+	}
+
+	struct { char* name; unsigned long value; } totals[] = {
+		{ "string_bytes", stats.string_bytes },
+		{ "cell_bytes", stats.cell_bytes },
+		{ "env_bytes", stats.env_bytes },
+		{ "lval_copies", stats.lval_copies },
+		{ "lval_copy_nodes", stats.lval_copy_nodes },
+		{ "lenv_copies", stats.lenv_copies },
+		{ "lenv_copy_entries", stats.lenv_copy_entries },
+		{ "lookups", stats.lookups },
+		{ "lookup_depth", stats.lookup_depth },
+		{ "lookup_depth_max", stats.lookup_depth_max },
+	};
+
+	for (int i = 0; i < (int)(sizeof(totals) / sizeof(totals[0])); i++) {
+		snprintf(names[n], LSTATS_NAME, "%s", totals[i].name);
+		values[n++] = totals[i].value;
+	}
+#endif
+	return n;
+}
+
+// (memstats {}) gives every counter as a {name value} pair, (memstats {lookups lval_copies}) just those named
+lval* builtin_memstats(lenv* e, lval* a) {
+	LASSERT_NUM("memstats", a, 1);
+	LASSERT_TYPE("memstats", a, 0, LVAL_QEXPR);
+
+#ifdef LIPL_STATS
+	// Read them all before building the list changes them
+	char names[LSTATS_MAX][LSTATS_NAME];
+	unsigned long values[LSTATS_MAX];
+	int n = lstats_read(names, values);
+
+	lval* wanted = a->cell[0];
+	lval* x = lval_qexpr();
+
+	for (int i = 0; i < n; i++) {
+		int keep = wanted->count == 0;
+		for (int j = 0; j < wanted->count && !keep; j++)
+			keep = wanted->cell[j]->type == LVAL_SYM && strcmp(wanted->cell[j]->sym, names[i]) == 0;
+		if (!keep) continue;
+
+		lval* pair = lval_add(lval_qexpr(), lval_sym(names[i]));
+		x = lval_add(x, lval_add(pair, lval_num((long)values[i])));
+	}
+
+	lval_del(a);
+	return x;
+#else
+	lval_del(a);
+	return lval_err("Function 'memstats' needs a build with LIPL_STATS.");
+#endif
+}
+
+// Seconds on clock since start
+double ltime_since(clockid_t clock, struct timespec* start) {
+	struct timespec t;
+	clock_gettime(clock, &t);
+	return (t.tv_sec - start->tv_sec) + (t.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// (time {expr}) evaluates expr and prints its wall and CPU time, then what it allocated and copied when counted
+lval* builtin_time(lenv* e, lval* a) {
+	LASSERT_NUM("time", a, 1);
+	LASSERT_TYPE("time", a, 0, LVAL_QEXPR);
+
+	lval* x = lval_take(a, 0);
+	x->type = LVAL_SEXPR;
+
+#ifdef LIPL_STATS
+	// Bytes are the lvals themselves with their strings and cells, and the environments calls bind into
+	unsigned long allocs = 0;
+	for (int t = 0; t < LSTATS_TYPES; t++) allocs += stats.allocs[t];
+	unsigned long bytes = stats.string_bytes + stats.cell_bytes + stats.env_bytes;
+	unsigned long nodes = stats.lval_copy_nodes;
+#endif
+
+	struct timespec wall, cpu;
+	clock_gettime(CLOCK_MONOTONIC, &wall);
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+
+	x = lval_eval(e, x);
+
+	double wall_ms = ltime_since(CLOCK_MONOTONIC, &wall) * 1e3;
+	double cpu_ms = ltime_since(CLOCK_PROCESS_CPUTIME_ID, &cpu) * 1e3;
+
+#ifdef LIPL_STATS
+	unsigned long allocs_after = 0;
+	for (int t = 0; t < LSTATS_TYPES; t++) allocs_after += stats.allocs[t];
+	allocs = allocs_after - allocs;
+	bytes = stats.string_bytes + stats.cell_bytes + stats.env_bytes - bytes + allocs * sizeof(lval);
+	nodes = stats.lval_copy_nodes - nodes;
+
+	printf("time: %.3f ms wall, %.3f ms cpu, %lu allocs, %lu bytes, %lu copied nodes\n",
+		wall_ms, cpu_ms, allocs, bytes, nodes);
+#else
+	printf("time: %.3f ms wall, %.3f ms cpu\n", wall_ms, cpu_ms);
+#endif
+
+	return x;
+}
+
+char* lstats_file;
+
+// Runs at exit for --memstats, - writes to stderr
+void lstats_dump(void) {
+	char names[LSTATS_MAX][LSTATS_NAME];
+	unsigned long values[LSTATS_MAX];
+	int n = lstats_read(names, values);
+
+	FILE* f = strcmp(lstats_file, "-") == 0 ? stderr : fopen(lstats_file, "w");
+	if (!f) return;
+
+	for (int i = 0; i < n; i++) fprintf(f, "%s %lu\n", names[i], values[i]);
+
+	if (f != stderr) fclose(f);
+}
+
+/* Tracing */
+
+// The ring of the calling thread, made on its first event
+_Thread_local ltrace_ring* ltrace_local;
+
+// The cycle counter where there is one, the trace file holds what it takes to turn it into time
+uint64_t ltrace_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	return (uint64_t)ltrace_ns();
+#endif
+}
+
+int64_t ltrace_ns(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+ltrace_ring* ltrace_ring_new(void) {
+	ltrace_ring* r = calloc(1, sizeof(ltrace_ring));
+
+	pthread_mutex_lock(&tracer.lock);
+	r->thread = tracer.threads++;
+	r->link = tracer.rings;
+	tracer.rings = r;
+	pthread_mutex_unlock(&tracer.lock);
+
+	return ltrace_local = r;
+}
+
+// Only called while tracing, the oldest event is overwritten once the ring is full
+void ltrace_emit(int kind, uint32_t id) {
+	ltrace_ring* r = ltrace_local ? ltrace_local : ltrace_ring_new();
+	ltrace_event* ev = &r->events[r->next & (LTRACE_EVENTS - 1)];
+	ev->time = ltrace_ticks();
+	ev->id = id;
+	ev->kind = kind;
+	r->next++;
+}
+
+// The id of a name, kept in this thread's table the first time it is seen while there is room
+uint32_t ltrace_intern(char* text, long len) {
+	uint32_t id = (uint32_t)lcache_hash(text, len);
+	if (id == 0) id = 1;
+
+	ltrace_ring* r = ltrace_local ? ltrace_local : ltrace_ring_new();
+	uint32_t i = id & (LTRACE_NAMES - 1);
+	while (r->names[i].id && r->names[i].id != id) i = (i + 1) & (LTRACE_NAMES - 1);
+
+	if (!r->names[i].id && r->names_count < LTRACE_NAMES / 4 * 3) {
+		if (len >= LTRACE_NAME) len = LTRACE_NAME - 1;
+		memcpy(r->names[i].name, text, len);
+		r->names[i].name[len] = '\0';
+		r->names[i].id = id;
+		r->names_count++;
+	}
+
+	return id;
 }
 
-void lenv_add_builtins(lenv* e) {
-	/* Variable functions */
-	lenv_add_builtin(e, "def", builtin_def);
-	lenv_add_builtin(e, "="  , builtin_put);
-	lenv_add_builtin(e, "\\" , builtin_lambda);
+// The id of a head symbol, interned the first time its cache is traced and shared by the symbol's copies since
+uint32_t ltrace_site(lval* k) {
+	if (!k->site->trace) k->site->trace = ltrace_intern(k->sym, strlen(k->sym));
+	return k->site->trace;
+}
 
-	/* List functions */
-	lenv_add_builtin(e, "list", builtin_list);
-	lenv_add_builtin(e, "head", builtin_head);
-	lenv_add_builtin(e, "tail", builtin_tail);
-	lenv_add_builtin(e, "eval", builtin_eval);
-	lenv_add_builtin(e, "join", builtin_join);
-	
-	/* Math functions */
-	lenv_add_builtin(e, "+", builtin_add);
-	lenv_add_builtin(e, "-", builtin_sub);
-	lenv_add_builtin(e, "*", builtin_mul);
-	lenv_add_builtin(e, "/", builtin_div);
+int ltrace_write(int fd, void* data, long size) {
+	char* p = data;
+	while (size > 0) {
+		ssize_t n = write(fd, p, size);
+		if (n <= 0) return 0;
+		p += n;
+		size -= n;
+	}
+	return 1;
+}
 
-	/* Comparison functions */
-	lenv_add_builtin(e, "if", builtin_if);
-	lenv_add_builtin(e, "==", builtin_eq);
-	lenv_add_builtin(e, "!=", builtin_ne);
-	lenv_add_builtin(e, ">", builtin_gt);
-	lenv_add_builtin(e, "<", builtin_lt);
-	lenv_add_builtin(e, ">=", builtin_ge);
-	lenv_add_builtin(e, "<=", builtin_le);
+// Write every thread's ring to filename. This may run in a signal handler, so it only makes system calls
+int ltrace_save(char* filename) {
+	int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) return 0;
 
-	/* String functions */
-	lenv_add_builtin(e, "load", builtin_load);
-	lenv_add_builtin(e, "error", builtin_error);
-	lenv_add_builtin(e, "print", builtin_print);
+	int rings = 0;
+	for (ltrace_ring* r = tracer.rings; r; r = r->link) rings++;
+
+	ltrace_header h = { { 'L', 'P', 'L', 'T' }, LTRACE_ORDER, LTRACE_VERSION, rings,
+		{ tracer.ticks, ltrace_ticks() }, { tracer.ns, ltrace_ns() }, LTRACE_EVENTS, LTRACE_NAMES };
+
+	// A ring goes out as it is in memory from its thread on, the reader puts its events in order
+	int ok = ltrace_write(fd, &h, sizeof(h));
+	for (ltrace_ring* r = tracer.rings; r && ok; r = r->link)
+		ok = ltrace_write(fd, &r->thread, sizeof(ltrace_ring) - offsetof(ltrace_ring, thread));
+
+	close(fd);
+	return ok;
+}
+
+// SIGUSR1 writes the trace and carries on, the others write it and go on to do what they would have
+void ltrace_signal(int sig) {
+	ltrace_save(tracer.file);
+	if (sig == SIGUSR1) return;
+
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+// Trace from here on, writing to filename on errors reaching the top level and on signals
+void ltrace_start(char* filename) {
+	tracer.file = filename;
+	tracer.ticks = ltrace_ticks();
+	tracer.ns = ltrace_ns();
+	tracer.on = 1;
+
+	int signals[] = { SIGUSR1, SIGINT, SIGTERM, SIGSEGV, SIGBUS, SIGFPE, SIGABRT };
+	struct sigaction sa = { 0 };
+	sa.sa_handler = ltrace_signal;
+	sigemptyset(&sa.sa_mask);
+
+	for (int i = 0; i < (int)(sizeof(signals) / sizeof(signals[0])); i++) {
+		sa.sa_flags = signals[i] == SIGUSR1 ? SA_RESTART : 0;
+		sigaction(signals[i], &sa, NULL);
+	}
+}
+
+// An error reached the top level, keep the events that led to it
+void ltrace_error(void) {
+	if (tracer.on) ltrace_save(tracer.file);
+}
+
+// (trace-dump "file") writes the trace so far to file
+lval* builtin_trace_dump(lenv* e, lval* a) {
+	LASSERT_NUM("trace-dump", a, 1);
+	LASSERT_TYPE("trace-dump", a, 0, LVAL_STR);
+
+	if (!tracer.on) {
+		lval_del(a);
+		return lval_err("Function 'trace-dump' needs tracing started with --trace.");
+	}
+
+	lval* x = ltrace_save(a->cell[0]->str)
+		? lval_sexpr() : lval_err("Could not write trace: %s", a->cell[0]->str);
+	lval_del(a);
+	return x;
+}
+
+/* Native code for hot lambdas */
+
+// Calls between a lambda's copies before it is compiled, 0 leaves every lambda to the interpreter
+long ljit_threshold = LJIT_THRESHOLD;
+
+// Set by compiled code which met what only the interpreter can answer, such as division by zero
+int ljit_failed;
+
+// perf's map of compiled code to names, written when $LIPL_PERF_MAP is set
+FILE* ljit_perf_map;
+
+ljit* ljit_new(void) {
+	ljit* j = calloc(1, sizeof(ljit));
+	j->refs = 1;
+	return j;
+}
+
+void ljit_del(ljit* j) {
+	if (--j->refs > 0) return;
+
+	if (j->code) munmap(j->code, j->size);
+	for (int i = 0; i < j->syms_count; i++) free(j->syms[i]);
+	free(j->syms);
+	free(j->funcs);
+	free(j);
+}
+
+// The value sym is bound to as lenv_get would find it, without a copy, NULL if it is unbound
+lval* ljit_lookup(lenv* e, char* sym) {
+	for (; e; e = e->parent)
+		for (int i = 0; i < e->count; i++)
+			if (strcmp(e->syms[i], sym) == 0) return e->vals[i];
+	return NULL;
+}
+
+// Compiled code only stands while every symbol it calls is bound as it was when compiled
+int ljit_guard(lenv* e, ljit* j) {
+	for (int i = 0; i < j->syms_count; i++) {
+		lval* v = ljit_lookup(e, j->syms[i]);
+		if (!v || v->type != LVAL_FUN) return 0;
+
+		if (j->funcs[i]) {
+			if (v->builtin != j->funcs[i]) return 0;
+		} else if (v->builtin || v->jit != j || v->formals->count != j->arity || v->env->count != 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+void ljit_emit(ljit_code* c, int n, ...) {
+	if (c->size + n > c->slots) {
+		c->slots = c->slots * 2 + n + 64;
+		c->data = realloc(c->data, c->slots);
+	}
+
+	va_list va;
+	va_start(va, n);
+	for (int i = 0; i < n; i++) c->data[c->size++] = va_arg(va, int);
+	va_end(va);
+}
+
+void ljit_emit_32(ljit_code* c, uint32_t x) {
+	ljit_emit(c, 4, x & 0xff, (x >> 8) & 0xff, (x >> 16) & 0xff, x >> 24);
+}
+
+// Point the jump whose offset is at at to the end of the code so far
+void ljit_patch(ljit_code* c, long at) {
+	uint32_t x = c->size - (at + 4);
+	for (int i = 0; i < 4; i++) c->data[at + i] = x >> (8 * i);
+}
+
+// Jump on cond to the exit for failed calls, which goes at the end
+void ljit_fail(ljit_code* c, int cond) {
+	ljit_emit(c, 2, 0x0F, cond);
+	c->fails = realloc(c->fails, sizeof(long) * (c->fails_count + 1));
+	c->fails[c->fails_count++] = c->size;
+	ljit_emit_32(c, 0);
+}
+
+// A call to the lambda itself which failed fails this one too
+void ljit_check(ljit_code* c) {
+	uint64_t p = (uintptr_t)&ljit_failed;
+	ljit_emit(c, 2, 0x49, 0xBB);  // mov r11, &ljit_failed
+	ljit_emit_32(c, p);
+	ljit_emit_32(c, p >> 32);
+	ljit_emit(c, 4, 0x41, 0x83, 0x3B, 0x00);  // cmp dword [r11], 0
+	ljit_fail(c, 0x85);  // jne
+}
+
+// Where a symbol is among the formals of the lambda being compiled, -1 if it is not
+int ljit_param(ljit_code* c, char* name) {
+	for (int i = 0; i < c->formals->count; i++)
+		if (strcmp(c->formals->cell[i]->sym, name) == 0) return i;
+	return -1;
+}
+
+// The code assumes name is bound to func, or to the lambda itself when func is NULL
+void ljit_need(ljit_code* c, char* name, lbuiltin func) {
+	ljit* j = c->jit;
+	for (int i = 0; i < j->syms_count; i++)
+		if (strcmp(j->syms[i], name) == 0) return;
+
+	j->syms = realloc(j->syms, sizeof(char*) * (j->syms_count + 1));
+	j->funcs = realloc(j->funcs, sizeof(lbuiltin) * (j->syms_count + 1));
+	j->syms[j->syms_count] = malloc(strlen(name) + 1);
+	strcpy(j->syms[j->syms_count], name);
+	j->funcs[j->syms_count++] = func;
+}
+
+// Code leaving the number x evaluates to in rax, 0 if x is beyond what can be compiled
+int ljit_expr(ljit_code* c, lval* x) {
+	switch (x->type) {
+		case LVAL_NUM:
+			if (x->num >= INT32_MIN && x->num <= INT32_MAX) {
+				ljit_emit(c, 3, 0x48, 0xC7, 0xC0);  // mov rax, imm32
+				ljit_emit_32(c, x->num);
+			} else {
+				ljit_emit(c, 2, 0x48, 0xB8);  // mov rax, imm64
+				ljit_emit_32(c, x->num);
+				ljit_emit_32(c, (uint64_t)x->num >> 32);
+			}
+			return 1;
+		case LVAL_SYM: {
+			// Arguments are kept in the frame, the first at rbp - 8
+			int i = ljit_param(c, x->sym);
+			if (i < 0) return 0;
+			ljit_emit(c, 4, 0x48, 0x8B, 0x45, -8 * (i + 1) & 0xff);  // mov rax, [rbp - 8(i + 1)]
+			return 1;
+		}
+		case LVAL_SEXPR:
+			return ljit_sexpr(c, x);
+		default:
+			return 0;
+	}
+}
+
+// Code for the two arguments of x, leaving the first in rax and the second in rcx
+int ljit_args(ljit_code* c, lval* x) {
+	if (!ljit_expr(c, x->cell[1])) return 0;
+	ljit_emit(c, 1, 0x50);  // push rax
+	if (!ljit_expr(c, x->cell[2])) return 0;
+	ljit_emit(c, 4, 0x48, 0x89, 0xC1, 0x58);  // mov rcx, rax; pop rax
+	return 1;
+}
+
+// Code for an S-Expression, or a Q-Expression evaluated as one, as lval_eval_sexpr would evaluate it
+int ljit_sexpr(ljit_code* c, lval* x) {
+	if (x->count == 0) return 0;
+	if (x->count == 1) return ljit_expr(c, x->cell[0]);
+
+	lval* head = x->cell[0];
+	if (head->type != LVAL_SYM || ljit_param(c, head->sym) >= 0) return 0;
+
+	lval* f = ljit_lookup(c->env, head->sym);
+	if (!f || f->type != LVAL_FUN) return 0;
+
+	// Calls to the lambda itself take their arguments in registers, as the C calling convention has it
+	if (!f->builtin) {
+		ljit* j = c->jit;
+		if (f->jit != j || x->count - 1 != j->arity
+			|| f->formals->count != j->arity || f->env->count != 0) return 0;
+
+		for (int i = 1; i < x->count; i++) {
+			if (!ljit_expr(c, x->cell[i])) return 0;
+			ljit_emit(c, 1, 0x50);  // push rax
+		}
+
+		// pop r9, r8, rcx, rdx, rsi, rdi
+		static const int pops[LJIT_ARGS] = { 0x5F, 0x5E, 0x5A, 0x59, 0x58, 0x59 };
+		for (int i = j->arity - 1; i >= 0; i--) {
+			if (i >= 4) ljit_emit(c, 2, 0x41, pops[i]);
+			else ljit_emit(c, 1, pops[i]);
+		}
+
+		ljit_emit(c, 1, 0xE8);  // call back to the start
+		ljit_emit_32(c, -(c->size + 4));
+		ljit_check(c);
+
+		ljit_need(c, head->sym, NULL);
+		return 1;
+	}
+
+	lbuiltin b = f->builtin;
+	ljit_need(c, head->sym, b);
+
+	if (b == builtin_if) {
+		if (x->count != 4 || x->cell[2]->type != LVAL_QEXPR || x->cell[3]->type != LVAL_QEXPR) return 0;
+
+		if (!ljit_expr(c, x->cell[1])) return 0;
+		ljit_emit(c, 5, 0x48, 0x85, 0xC0, 0x0F, 0x84);  // test rax, rax; jz else
+		long other = c->size;
+		ljit_emit_32(c, 0);
+
+		if (!ljit_sexpr(c, x->cell[2])) return 0;
+		ljit_emit(c, 1, 0xE9);  // jmp end
+		long end = c->size;
+		ljit_emit_32(c, 0);
+
+		ljit_patch(c, other);
+		if (!ljit_sexpr(c, x->cell[3])) return 0;
+		ljit_patch(c, end);
+		return 1;
+	}
+
+	// Comparisons set al by the flags, <= compares as builtin_le does
+	int cond = b == builtin_lt ? 0x9C : b == builtin_gt ? 0x9F
+		: b == builtin_ge || b == builtin_le ? 0x9D
+		: b == builtin_eq ? 0x94 : b == builtin_ne ? 0x95 : 0;
+
+	if (cond) {
+		if (x->count != 3 || !ljit_args(c, x)) return 0;
+		ljit_emit(c, 9, 0x48, 0x39, 0xC8, 0x0F, cond, 0xC0, 0x0F, 0xB6, 0xC0);  // cmp rax, rcx; setcc al; movzx eax, al
+		return 1;
+	}
+
+	if (b != builtin_add && b != builtin_sub && b != builtin_mul && b != builtin_div) return 0;
+
+	// Arithmetic folds its arguments from the left, and - on its own negates
+	if (!ljit_expr(c, x->cell[1])) return 0;
+	if (x->count == 2 && b == builtin_sub) ljit_emit(c, 3, 0x48, 0xF7, 0xD8);  // neg rax
+
+	for (int i = 2; i < x->count; i++) {
+		ljit_emit(c, 1, 0x50);  // push rax
+		if (!ljit_expr(c, x->cell[i])) return 0;
+		ljit_emit(c, 4, 0x48, 0x89, 0xC1, 0x58);  // mov rcx, rax; pop rax
+
+		if (b == builtin_add) ljit_emit(c, 3, 0x48, 0x01, 0xC8);  // add rax, rcx
+		if (b == builtin_sub) ljit_emit(c, 3, 0x48, 0x29, 0xC8);  // sub rax, rcx
+		if (b == builtin_mul) ljit_emit(c, 4, 0x48, 0x0F, 0xAF, 0xC1);  // imul rax, rcx
+		if (b == builtin_div) {
+			ljit_emit(c, 3, 0x48, 0x85, 0xC9);  // test rcx, rcx
+			ljit_fail(c, 0x84);  // jz
+			ljit_emit(c, 5, 0x48, 0x99, 0x48, 0xF7, 0xF9);  // cqo; idiv rcx
+		}
+	}
+	return 1;
+}
+
+// The name a lambda is bound to, for profilers
+char* ljit_name(lenv* e, ljit* j) {
+	for (; e; e = e->parent)
+		for (int i = 0; i < e->count; i++)
+			if (e->vals[i]->type == LVAL_FUN && !e->vals[i]->builtin && e->vals[i]->jit == j)
+				return e->syms[i];
+	return "lambda";
+}
+
+// perf names code it finds no symbols for from /tmp/perf-<pid>.map
+void ljit_map(ljit* j, char* name) {
+	if (!ljit_perf_map) {
+		char path[64];
+		snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int)getpid());
+		ljit_perf_map = fopen(path, "w");
+		if (!ljit_perf_map) return;
+	}
+
+	fprintf(ljit_perf_map, "%lx %lx lipl:%s\n", (unsigned long)(uintptr_t)j->code, j->size, name);
+	fflush(ljit_perf_map);
+}
+
+// Compile f to x86-64 if it is made only of arithmetic, comparisons, if and calls to itself
+int ljit_compile(lenv* e, lval* f) {
+#if defined(__x86_64__) && defined(__linux__)
+	ljit* j = f->jit;
+	lval* formals = f->formals;
+	if (formals->count == 0 || formals->count > LJIT_ARGS || f->env->count != 0) return 0;
+
+	for (int i = 0; i < formals->count; i++) {
+		if (strcmp(formals->cell[i]->sym, "&") == 0) return 0;
+		for (int k = 0; k < i; k++)
+			if (strcmp(formals->cell[k]->sym, formals->cell[i]->sym) == 0) return 0;
+	}
+
+	j->arity = formals->count;
+	ljit_code c = { .env = e, .formals = formals, .jit = j };
+
+	// push rbp; mov rbp, rsp; sub rsp, n, keeping the stack to 16 bytes
+	ljit_emit(&c, 8, 0x55, 0x48, 0x89, 0xE5, 0x48, 0x83, 0xEC, (j->arity + 1) / 2 * 16);
+
+	// mov [rbp - 8(i + 1)], rdi, rsi, rdx, rcx, r8, r9
+	static const int spills[LJIT_ARGS][2] = {
+		{ 0x48, 0x7D }, { 0x48, 0x75 }, { 0x48, 0x55 }, { 0x48, 0x4D }, { 0x4C, 0x45 }, { 0x4C, 0x4D }
+	};
+	for (int i = 0; i < j->arity; i++)
+		ljit_emit(&c, 4, spills[i][0], 0x89, spills[i][1], -8 * (i + 1) & 0xff);
+
+	int ok = ljit_sexpr(&c, f->body);
+	ljit_emit(&c, 2, 0xC9, 0xC3);  // leave; ret
+
+	// The exit for failed calls sets ljit_failed, the frame goes whatever is pushed on it
+	for (int i = 0; i < c.fails_count; i++) ljit_patch(&c, c.fails[i]);
+	uint64_t p = (uintptr_t)&ljit_failed;
+	ljit_emit(&c, 2, 0x49, 0xBB);  // mov r11, &ljit_failed
+	ljit_emit_32(&c, p);
+	ljit_emit_32(&c, p >> 32);
+	ljit_emit(&c, 9, 0x41, 0xC7, 0x03, 0x01, 0x00, 0x00, 0x00, 0xC9, 0xC3);  // mov dword [r11], 1; leave; ret
+
+	// Written while the pages are writable, then only run
+	void* code = ok ? mmap(NULL, c.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) : MAP_FAILED;
+	if (code != MAP_FAILED) {
+		memcpy(code, c.data, c.size);
+		if (mprotect(code, c.size, PROT_READ | PROT_EXEC) != 0) {
+			munmap(code, c.size);
+			code = MAP_FAILED;
+		}
+	}
+
+	free(c.data);
+	free(c.fails);
+	if (code == MAP_FAILED) return 0;
+
+	j->code = code;
+	j->size = c.size;
+
+	char* map = getenv("LIPL_PERF_MAP");
+	if (map && *map) ljit_map(j, ljit_name(e, j));
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+// Make a call to f as native code, or NULL to leave it to the interpreter
+lval* ljit_call(lenv* e, lval* f, lval* a) {
+	ljit* j = f->jit;
+
+	// The profiler and tracer see every call, which only the interpreter shows them
+	if (j->state == LJIT_REJECTED || profiler.mode != LPROF_OFF || tracer.on) return NULL;
+
+	if (j->state == LJIT_COUNTING) {
+		if (++j->calls < ljit_threshold) return NULL;
+		j->state = ljit_compile(e, f) ? LJIT_COMPILED : LJIT_REJECTED;
+		if (j->state == LJIT_REJECTED) return NULL;
+	}
+
+	// Only whole calls on numbers, with every symbol still as compiled against
+	if (a->count != j->arity || f->formals->count != j->arity || f->env->count != 0) return NULL;
+
+	long args[LJIT_ARGS] = { 0 };
+	for (int i = 0; i < a->count; i++) {
+		if (a->cell[i]->type != LVAL_NUM) return NULL;
+		args[i] = a->cell[i]->num;
+	}
+
+	if (!ljit_guard(e, j)) return NULL;
+
+	// Nothing the code does can be seen, so a failed call is made again by the interpreter
+	long r = ((ljit_func)j->code)(args[0], args[1], args[2], args[3], args[4], args[5]);
+	if (ljit_failed) {
+		ljit_failed = 0;
+		return NULL;
+	}
+
+	lval_del(a);
+	return lval_num(r);
 }
 
 /* Evaluation */
@@ -720,6 +2676,12 @@ lval* lval_call(lenv* e, lval* f, lval* a){
 
 	if(f->builtin) {return f->builtin(e, a);}
 
+	// Hot lambdas run as native code where they can
+	if (f->jit && ljit_threshold > 0) {
+		lval* x = ljit_call(e, f, a);
+		if (x) return x;
+	}
+
 	int given = a->count;
 	int total = f->formals->count;
 	
@@ -740,7 +2702,7 @@ lval* lval_call(lenv* e, lval* f, lval* a){
 			}
 			
 			lval* nsym = lval_pop(f->formals, 0);
-			lenv_put(f->env, nsym, builtin_list(e, a));
+			lenv_bind(f->env, nsym, builtin_list(e, a));
 			lval_del(sym);
 			lval_del(nsym);
 			break;
@@ -748,7 +2710,7 @@ lval* lval_call(lenv* e, lval* f, lval* a){
 		
 		lval* val = lval_pop(a, 0);
 		
-		lenv_put(f->env, sym, val);
+		lenv_bind(f->env, sym, val);
 		
 		lval_del(sym);
 		lval_del(val);
@@ -767,7 +2729,7 @@ lval* lval_call(lenv* e, lval* f, lval* a){
 		lval* sym = lval_pop(f->formals, 0);
 		lval* val = lval_qexpr();
 		
-		lenv_put(f->env, sym, val);
+		lenv_bind(f->env, sym, val);
 		lval_del(sym);
 		lval_del(val);
 	}
@@ -784,12 +2746,46 @@ lval* lval_call(lenv* e, lval* f, lval* a){
 
 lval* lval_eval_sexpr(lenv* e, lval* v) {
 
-	for(int i = 0; i < v->count; i++) {
+	// The profiler names a function by the symbol it was looked up by, which is kept until the call, and so does the
+	// tracer for a symbol without a cache
+	lval* name = NULL;
+	if (v->count > 1 && v->cell[0]->type == LVAL_SYM && (profiler.mode || (tracer.on && !v->cell[0]->site))) {
+		name = v->cell[0];
+		v->cell[0] = lenv_get(e, name);
+	}
+
+	// Otherwise a head symbol with a cache goes straight to its global binding, and builtins are called without a copy
+	lbuiltin direct = NULL;
+	uint32_t id = 0;
+	int first = name ? 1 : 0;
+	if (!name && v->count > 1 && v->cell[0]->type == LVAL_SYM && v->cell[0]->site) {
+		if (tracer.on) id = ltrace_site(v->cell[0]);
+		lval* f = lsite_get(e, v->cell[0]);
+		if (f && f->builtin) {
+			direct = f->builtin;
+			first = 1;
+		} else if (f) {
+			lval_del(v->cell[0]);
+			v->cell[0] = lval_copy(f);
+			first = 1;
+		}
+	}
+
+	for(int i = first; i < v->count; i++) {
 		v->cell[i] = lval_eval(e, v->cell[i]);
 	}
 
 	for(int i = 0; i < v->count; i++) {
-		if(v->cell[i]->type == LVAL_ERR) return lval_take(v, i);
+		if(v->cell[i]->type == LVAL_ERR) {
+			if (name) lval_del(name);
+			return lval_take(v, i);
+		}
+	}
+
+	if (direct) {
+		if (tracer.on) ltrace_emit(LTRACE_BUILTIN, id);
+		lval_del(lval_pop(v, 0));
+		return direct(e, v);
 	}
 
 	if (v->count == 0) return v;
@@ -802,12 +2798,28 @@ lval* lval_eval_sexpr(lenv* e, lval* v) {
 			"S-Expression starts with incorrect type. "
 			"Got %s, expected %s.",
 			ltype_name(f->type), ltype_name(LVAL_FUN));
+		if (name) lval_del(name);
 		lval_del(f);
 		lval_del(v);
 		return err;
 	}
 
+	// Builtins and lambdas alike go on the profiler's shadow stack for the length of the call
+	int profiled = profiler.mode != LPROF_OFF;
+	if (profiled) lprof_enter(f, name ? name->sym : NULL);
+
+	// Lambdas are traced entering and leaving, builtins only as they are called
+	if (tracer.on) {
+		if (name) id = name->site ? ltrace_site(name) : ltrace_intern(name->sym, strlen(name->sym));
+		ltrace_emit(f->builtin ? LTRACE_BUILTIN : LTRACE_ENTER, id);
+	}
+
 	lval* result = lval_call(e, f, v);
+
+	if (tracer.on && !f->builtin) ltrace_emit(LTRACE_EXIT, id);
+	if (profiled) lprof_leave();
+	if (name) lval_del(name);
+
 	lval_del(f);
 	return result;
 }
@@ -826,31 +2838,41 @@ lval* lval_eval(lenv* e, lval* v) {
 
 /* Reading */
 
+// Token contents are slices of the input, not terminated strings
+
 lval* lval_read_num(mpc_ast_t* t) {
+	// Contents may end at the very end of a mapped file, so give strtol a terminated copy
+	char buf[32];
+	if (t->contents_len >= (long)sizeof(buf)) return lval_err("Invalid Number");
+	memcpy(buf, t->contents, t->contents_len);
+	buf[t->contents_len] = '\0';
+
 	errno = 0;
-	long x = strtol(t->contents, NULL, 10);
-	return errno != ERANGE ? lval_num(x) : lval_err("Invalid Number");
+	char* end;
+	long x = strtol(buf, &end, 10);
+	if (errno == ERANGE || *end != '\0')
+		return lval_err("Invalid Number");
+	return lval_num(x);
 }
 
 lval* lval_read_str(mpc_ast_t* t) {
-	//Cut off the final quote character
-	t->contents[strlen(t->contents)-1] = '\0';
-
-	//Copy the string without the first quote character
-	char* unescaped = malloc(strlen(t->contents+1)+1);
-	strcpy(unescaped, t->contents+1);
-
-	unescaped = mpcf_unescape(unescaped);
-	lval* str = lval_str(unescaped);
-
-	free(unescaped);
+	//Copy the string without the quote characters
+	long len = t->contents_len - 2;
+	char* unescaped = malloc(len + 1);
+	memcpy(unescaped, t->contents + 1, len);
+	unescaped[len] = '\0';
+
+	//The unescaped copy is handed to the lval as is
+	lval* str = lval_new(LVAL_STR);
+	str->str = mpcf_unescape(unescaped);
+	LSTAT(stats.string_bytes += strlen(str->str) + 1);
 	return str;
 }
 
 lval* lval_read(mpc_ast_t* t) {
 
 	if(strstr(t->tag, "number")) return lval_read_num(t);
-	if(strstr(t->tag, "symbol")) return lval_sym(t->contents);
+	if(strstr(t->tag, "symbol")) return lval_sym_len(t->contents, t->contents_len);
 	if(strstr(t->tag, "string")) return lval_read_str(t);
 	// in case of root (<), sexpr, or qexpr create empty list
 	lval* x = NULL;
@@ -861,10 +2883,10 @@ lval* lval_read(mpc_ast_t* t) {
 	
 	for (int i = 0; i < t->children_num; i++)
 	{
-		if (strcmp(t->children[i]->contents, "(") == 0) continue;
-		if (strcmp(t->children[i]->contents, ")") == 0) continue;
-		if (strcmp(t->children[i]->contents, "}") == 0) continue;
-		if (strcmp(t->children[i]->contents, "{") == 0) continue;
+		if (mpc_ast_contents_eq(t->children[i], "(")) continue;
+		if (mpc_ast_contents_eq(t->children[i], ")")) continue;
+		if (mpc_ast_contents_eq(t->children[i], "}")) continue;
+		if (mpc_ast_contents_eq(t->children[i], "{")) continue;
 		//"regex" tag does not seem to have been talked about earlier
 		if (strcmp(t->children[i]->tag,  "regex") == 0) continue;
 		if(strstr(t->children[i]->tag, "comment")) continue;
@@ -874,6 +2896,376 @@ lval* lval_read(mpc_ast_t* t) {
 	return x;
 }
 
+/* Compiling to C */
+
+// Runtime at the top of every compiled module
+char* lcompile_prologue =
+	"// As lval_eval_sexpr once the function and its arguments are evaluated, the first error among them wins\n"
+	"static lval* lc_call(lenv* e, lval* f, lval* a) {\n"
+	"\tif (f->type == LVAL_ERR) {\n"
+	"\t\tlval_del(a);\n"
+	"\t\treturn f;\n"
+	"\t}\n"
+	"\n"
+	"\tfor (int i = 0; i < a->count; i++) {\n"
+	"\t\tif (a->cell[i]->type == LVAL_ERR) {\n"
+	"\t\t\tlval_del(f);\n"
+	"\t\t\treturn lval_take(a, i);\n"
+	"\t\t}\n"
+	"\t}\n"
+	"\n"
+	"\tif (f->type != LVAL_FUN) {\n"
+	"\t\tlval* err = lval_err(\"S-Expression starts with incorrect type. Got %s, expected %s.\",\n"
+	"\t\t\tltype_name(f->type), ltype_name(LVAL_FUN));\n"
+	"\t\tlval_del(f);\n"
+	"\t\tlval_del(a);\n"
+	"\t\treturn err;\n"
+	"\t}\n"
+	"\n"
+	"\tlval* x = lval_call(e, f, a);\n"
+	"\tlval_del(f);\n"
+	"\treturn x;\n"
+	"}\n"
+	"\n"
+	"// Calls a compiled function cannot take whole go to the lambda it was compiled from\n"
+	"static lval* lc_fallback(lenv* e, lval* f, lval* a) {\n"
+	"\tlval* g = lval_copy(f);\n"
+	"\tlval* x = lval_call(e, g, a);\n"
+	"\tlval_del(g);\n"
+	"\treturn x;\n"
+	"}\n";
+
+void lcompile_indent(FILE* f, int depth) {
+	for (int i = 0; i < depth; i++) fputc('\t', f);
+}
+
+// Text as a C string literal, anything but plain characters escaped in octal
+void lcompile_text(FILE* f, char* s) {
+	fputc('"', f);
+	for (unsigned char* p = (unsigned char*)s; *p; p++) {
+		if (*p == '"' || *p == '\\' || *p == '?' || *p < ' ' || *p > '~') fprintf(f, "\\%03o", *p);
+		else fputc(*p, f);
+	}
+	fputc('"', f);
+}
+
+int lcompile_sym(lcompile* c, char* name) {
+	for (int i = 0; i < c->syms_count; i++)
+		if (strcmp(c->syms[i], name) == 0) return i;
+
+	c->syms = realloc(c->syms, sizeof(char*) * (c->syms_count + 1));
+	c->syms[c->syms_count] = malloc(strlen(name) + 1);
+	strcpy(c->syms[c->syms_count], name);
+	return c->syms_count++;
+}
+
+// Where a symbol is among the formals of the function being compiled, -1 if it is not
+int lcompile_param(lcompile* c, char* name) {
+	if (!c->formals) return -1;
+	for (int i = 0; i < c->formals->count; i++)
+		if (strcmp(c->formals->cell[i]->sym, name) == 0) return i;
+	return -1;
+}
+
+// Emit code building v as read, returning the temporary holding it
+int lcompile_build(lcompile* c, FILE* f, lval* v, int depth) {
+	int t = c->temps++;
+	lcompile_indent(f, depth);
+
+	switch (v->type) {
+		case LVAL_NUM:
+			// The most negative number has no literal of its own
+			if (v->num == LONG_MIN) fprintf(f, "lval* t%d = lval_num(-%ldL - 1);\n", t, LONG_MAX);
+			else fprintf(f, "lval* t%d = lval_num(%ldL);\n", t, v->num);
+			break;
+		case LVAL_ERR:
+			fprintf(f, "lval* t%d = lval_err(\"%%s\", ", t);
+			lcompile_text(f, v->err);
+			fprintf(f, ");\n");
+			break;
+		case LVAL_SYM:
+			fprintf(f, "lval* t%d = lval_sym(", t);
+			lcompile_text(f, v->sym);
+			fprintf(f, ");\n");
+			break;
+		case LVAL_STR:
+			fprintf(f, "lval* t%d = lval_str(", t);
+			lcompile_text(f, v->str);
+			fprintf(f, ");\n");
+			break;
+		case LVAL_SEXPR:
+		case LVAL_QEXPR:
+			fprintf(f, "lval* t%d = %s;\n", t, v->type == LVAL_SEXPR ? "lval_sexpr()" : "lval_qexpr()");
+			for (int i = 0; i < v->count; i++) {
+				int x = lcompile_build(c, f, v->cell[i], depth);
+				lcompile_indent(f, depth);
+				fprintf(f, "lval_add(t%d, t%d);\n", t, x);
+			}
+			break;
+		default:
+			fprintf(f, "lval* t%d = lval_err(\"Function cannot be compiled.\");\n", t);
+			break;
+	}
+
+	return t;
+}
+
+// A constant built once when the module starts and copied where it is used
+int lcompile_const(lcompile* c, lval* v) {
+	FILE* f = c->out[LCOMPILE_CONSTS];
+	int k = c->consts_count++;
+
+	fprintf(f, "\t{\n");
+	int t = lcompile_build(c, f, v, 2);
+	fprintf(f, "\t\tlc_const[%d] = t%d;\n\t}\n", k, t);
+
+	return k;
+}
+
+
+// Emit code evaluating x in env, returning the temporary holding its value
+int lcompile_expr(lcompile* c, FILE* f, lval* x, int depth) {
+	if (x->type == LVAL_SEXPR) return lcompile_sexpr(c, f, x, depth);
+
+	if (x->type == LVAL_QEXPR) {
+		int k = lcompile_const(c, x);
+		int t = c->temps++;
+		lcompile_indent(f, depth);
+		fprintf(f, "lval* t%d = lval_copy(lc_const[%d]);\n", t, k);
+		return t;
+	}
+
+	if (x->type != LVAL_SYM) return lcompile_build(c, f, x, depth);
+
+	// A compiled function's formals are the first entries of its environment, in order
+	int t = c->temps++;
+	int i = lcompile_param(c, x->sym);
+	lcompile_indent(f, depth);
+	if (i >= 0) fprintf(f, "lval* t%d = lval_copy(env->vals[%d]);\n", t, i);
+	else fprintf(f, "lval* t%d = lenv_get(env, lc_sym[%d]);\n", t, lcompile_sym(c, x->sym));
+	return t;
+}
+
+// (if c {a} {b}) runs the branch taken in line, as long as if is still the builtin it was at the start
+int lcompile_if(lcompile* c, FILE* f, lval* x, int depth) {
+	int r = c->temps++;
+	lcompile_indent(f, depth);
+	fprintf(f, "lval* t%d;\n", r);
+
+	int fn = lcompile_expr(c, f, x->cell[0], depth);
+	int cond = lcompile_expr(c, f, x->cell[1], depth);
+
+	lcompile_indent(f, depth);
+	fprintf(f, "if (t%d->type == LVAL_FUN && t%d->builtin == lc_if && t%d->type == LVAL_NUM) {\n", fn, fn, cond);
+	lcompile_indent(f, depth + 1);
+	fprintf(f, "lval_del(t%d);\n", fn);
+
+	for (int b = 0; b < 2; b++) {
+		lcompile_indent(f, depth + 1);
+		fprintf(f, b == 0 ? "if (t%d->num) {\n" : "} else {\n", cond);
+		lcompile_indent(f, depth + 2);
+		fprintf(f, "lval_del(t%d);\n", cond);
+
+		// A branch is evaluated as an S-expression of its cells
+		int t = lcompile_sexpr(c, f, x->cell[2 + b], depth + 2);
+		lcompile_indent(f, depth + 2);
+		fprintf(f, "t%d = t%d;\n", r, t);
+	}
+	lcompile_indent(f, depth + 1);
+	fprintf(f, "}\n");
+
+	// Anything else goes to whatever if is now, with the branches as they were written
+	int a = c->temps++;
+	int then = lcompile_const(c, x->cell[2]);
+	int otherwise = lcompile_const(c, x->cell[3]);
+	lcompile_indent(f, depth);
+	fprintf(f, "} else {\n");
+	lcompile_indent(f, depth + 1);
+	fprintf(f, "lval* t%d = lval_add(lval_sexpr(), t%d);\n", a, cond);
+	lcompile_indent(f, depth + 1);
+	fprintf(f, "lval_add(t%d, lval_copy(lc_const[%d]));\n", a, then);
+	lcompile_indent(f, depth + 1);
+	fprintf(f, "lval_add(t%d, lval_copy(lc_const[%d]));\n", a, otherwise);
+	lcompile_indent(f, depth + 1);
+	fprintf(f, "t%d = lc_call(env, t%d, t%d);\n", r, fn, a);
+	lcompile_indent(f, depth);
+	fprintf(f, "}\n");
+
+	return r;
+}
+
+// The cells of x evaluated as an S-expression, as lval_eval_sexpr would
+int lcompile_sexpr(lcompile* c, FILE* f, lval* x, int depth) {
+	if (x->count == 0) {
+		int t = c->temps++;
+		lcompile_indent(f, depth);
+		fprintf(f, "lval* t%d = lval_sexpr();\n", t);
+		return t;
+	}
+
+	// A single cell is evaluated again, which leaves any value but an S-expression as it is
+	if (x->count == 1) {
+		int t = lcompile_expr(c, f, x->cell[0], depth);
+		lcompile_indent(f, depth);
+		fprintf(f, "t%d = lval_eval(env, t%d);\n", t, t);
+		return t;
+	}
+
+	if (x->count == 4 && x->cell[0]->type == LVAL_SYM && strcmp(x->cell[0]->sym, "if") == 0
+		&& lcompile_param(c, "if") < 0 && x->cell[2]->type == LVAL_QEXPR && x->cell[3]->type == LVAL_QEXPR)
+		return lcompile_if(c, f, x, depth);
+
+	int fn = lcompile_expr(c, f, x->cell[0], depth);
+	int a = c->temps++;
+	lcompile_indent(f, depth);
+	fprintf(f, "lval* t%d = lval_sexpr();\n", a);
+
+	for (int i = 1; i < x->count; i++) {
+		int t = lcompile_expr(c, f, x->cell[i], depth);
+		lcompile_indent(f, depth);
+		fprintf(f, "lval_add(t%d, t%d);\n", a, t);
+	}
+
+	int r = c->temps++;
+	lcompile_indent(f, depth);
+	fprintf(f, "lval* t%d = lc_call(env, t%d, t%d);\n", r, fn, a);
+	return r;
+}
+
+// (def {name} (\ {formals} {body})) with plain, distinct formals is compiled to a function
+int lcompile_is_function(lval* x) {
+	if (x->type != LVAL_SEXPR || x->count != 3) return 0;
+	if (x->cell[0]->type != LVAL_SYM || strcmp(x->cell[0]->sym, "def") != 0) return 0;
+	if (x->cell[1]->type != LVAL_QEXPR || x->cell[1]->count != 1 || x->cell[1]->cell[0]->type != LVAL_SYM) return 0;
+
+	lval* l = x->cell[2];
+	if (l->type != LVAL_SEXPR || l->count != 3) return 0;
+	if (l->cell[0]->type != LVAL_SYM || strcmp(l->cell[0]->sym, "\\") != 0) return 0;
+	if (l->cell[1]->type != LVAL_QEXPR || l->cell[2]->type != LVAL_QEXPR) return 0;
+
+	lval* formals = l->cell[1];
+	for (int i = 0; i < formals->count; i++) {
+		if (formals->cell[i]->type != LVAL_SYM || strcmp(formals->cell[i]->sym, "&") == 0) return 0;
+		for (int j = 0; j < i; j++)
+			if (strcmp(formals->cell[i]->sym, formals->cell[j]->sym) == 0) return 0;
+	}
+
+	return 1;
+}
+
+// Emit a function for a lambda, taking its arguments as a builtin does, bound as lval_call would since lc_lambda has the formals
+void lcompile_function(lcompile* c, lval* x) {
+	FILE* f = c->out[LCOMPILE_CODE];
+	char* name = x->cell[1]->cell[0]->sym;
+	lval* formals = x->cell[2]->cell[1];
+	int k = c->fns_count++;
+
+	fprintf(f, "\n// %s\nstatic lval* lc_fn%d(lenv* e, lval* a) {\n", name, k);
+	fprintf(f, "\tif (a->count != %d) return lc_fallback(e, lc_lambda[%d], a);\n\n", formals->count, k);
+	fprintf(f, "\tlenv* env = lenv_new();\n\tenv->parent = e;\n");
+	for (int i = 0; i < formals->count; i++)
+		fprintf(f, "\tlenv_bind(env, lc_sym[%d], a->cell[%d]);\n", lcompile_sym(c, formals->cell[i]->sym), i);
+	fprintf(f, "\tlval_del(a);\n\n");
+
+	c->formals = formals;
+	int t = lcompile_sexpr(c, f, x->cell[2]->cell[2], 1);
+	c->formals = NULL;
+
+	fprintf(f, "\n\tlenv_del(env);\n\treturn t%d;\n}\n", t);
+
+	// It is defined where the lambda was, which is kept for calls with too few or too many arguments
+	FILE* g = c->out[LCOMPILE_INIT];
+	fprintf(g, "\n\t// %s\n", name);
+	fprintf(g, "\tlc_lambda[%d] = lval_eval(env, lval_copy(lc_const[%d]));\n", k, lcompile_const(c, x->cell[2]));
+	fprintf(g, "\tlenv_add_builtin(env, ");
+	lcompile_text(g, name);
+	fprintf(g, ", lc_fn%d);\n", k);
+}
+
+// Any other top level form is evaluated when the module starts, printing errors as load does
+void lcompile_form(lcompile* c, lval* x) {
+
+	// Forms read as a file streams in come wrapped in an S-expression of their own
+	while (x->type == LVAL_SEXPR && x->count == 1 && x->cell[0]->type == LVAL_SEXPR) x = x->cell[0];
+
+	if (lcompile_is_function(x)) {
+		lcompile_function(c, x);
+		return;
+	}
+
+	FILE* f = c->out[LCOMPILE_INIT];
+	fprintf(f, "\n\t{\n");
+	int t = lcompile_expr(c, f, x, 2);
+	fprintf(f, "\t\tif (t%d->type == LVAL_ERR) lval_println(t%d);\n", t, t);
+	fprintf(f, "\t\tlval_del(t%d);\n\t}\n", t);
+}
+
+// Compile the forms of the files, in order, into a native module written to out, see LIPL.h
+lval* lcompile_files(char* out, int count, char** filenames) {
+	lcompile c = { 0 };
+	for (int s = 0; s < LCOMPILE_STREAMS; s++)
+		c.out[s] = open_memstream(&c.text[s], &c.size[s]);
+
+	lval* err = NULL;
+	for (int i = 0; i < count && !err; i++) {
+		lval* expr = lload_read(filenames[i], &err);
+		if (err) {
+			lval_del(expr);
+			break;
+		}
+
+		for (int j = 0; j < expr->count; j++) lcompile_form(&c, expr->cell[j]);
+		lval_del(expr);
+	}
+
+	int ifs = lcompile_sym(&c, "if");
+	for (int s = 0; s < LCOMPILE_STREAMS; s++) fclose(c.out[s]);
+
+	FILE* f = err ? NULL : fopen(out, "w");
+	if (!err && !f) err = lval_err("Could not write compiled program: %s", out);
+
+	if (f) {
+		fprintf(f, "/*\n** Generated by load --compile from");
+		for (int i = 0; i < count; i++) fprintf(f, " %s", filenames[i]);
+		fprintf(f, ", do not edit.\n**\n"
+			"**     cc -O2 -shared -fPIC -I<lipl> %s -o program.so\n"
+			"**     (load-native \"./program.so\")\n*/\n\n", out);
+		fprintf(f, "#include \"LIPL.h\"\n\n");
+
+		fprintf(f, "static lval* lc_sym[%d];\n", c.syms_count);
+		fprintf(f, "static lval* lc_const[%d];\n", c.consts_count + 1);
+		fprintf(f, "static lval* lc_lambda[%d];\n", c.fns_count + 1);
+		fprintf(f, "static lbuiltin lc_if;\n\n");
+
+		fputs(lcompile_prologue, f);
+		fwrite(c.text[LCOMPILE_CODE], 1, c.size[LCOMPILE_CODE], f);
+
+		fprintf(f, "\nstatic void lc_constants(void) {\n");
+		for (int i = 0; i < c.syms_count; i++) {
+			fprintf(f, "\tlc_sym[%d] = lval_sym(", i);
+			lcompile_text(f, c.syms[i]);
+			fprintf(f, ");\n");
+		}
+		fprintf(f, "\tfor (int i = 0; i < %d; i++) lc_sym[i]->site = lsite_new();\n", c.syms_count);
+		fwrite(c.text[LCOMPILE_CONSTS], 1, c.size[LCOMPILE_CONSTS], f);
+		fprintf(f, "}\n\n");
+
+		fprintf(f, "LIPL_MODULE {\n\tlenv* env = e;\n\tlc_constants();\n\n");
+		fprintf(f, "\tlval* f = lenv_get(env, lc_sym[%d]);\n", ifs);
+		fprintf(f, "\tlc_if = f->type == LVAL_FUN ? f->builtin : NULL;\n\tlval_del(f);\n");
+		fwrite(c.text[LCOMPILE_INIT], 1, c.size[LCOMPILE_INIT], f);
+		fprintf(f, "\n\treturn 0;\n}\n");
+
+		if (fclose(f) != 0) err = lval_err("Could not write compiled program: %s", out);
+	}
+
+	for (int s = 0; s < LCOMPILE_STREAMS; s++) free(c.text[s]);
+	for (int i = 0; i < c.syms_count; i++) free(c.syms[i]);
+	free(c.syms);
+
+	return err ? err : lval_sexpr();
+}
+
 /* main */
 int main (int argc, char **argv) {
 
@@ -887,51 +3279,116 @@ int main (int argc, char **argv) {
 	Expr   = mpc_new("expr");
 	Lipl   = mpc_new("lipl");
 
-	/* MPC Grammar */
-	mpca_lang(MPCA_LANG_DEFAULT,
-	  " number	: /-?[0-9]+/ ;				\
-	    symbol	: /[a-zA-Z0-9_+\\-*\\/\\\\=<>!&]+/ ;	\
-	    string	: /\"(\\\\.|[^\"])*\"/ ;		\
-	    comment	: /;[^\\r\\n]*/ ;			\
-	    sexpr	: '(' <expr>* ')' ;			\
-	    qexpr	: '{' <expr>* '}' ;			\
-	    expr	: <number> | <string> | <comment> 	\
-	    		| <symbol> | <sexpr> | <qexpr> ;	\
-	    lipl	: /^/ <expr>* /$/ ;" ,
-	  Number, Symbol, String, Comment, Sexpr, Qexpr, Expr, Lipl);
+	/* MPC Grammar, generated from lipl.mpca at build time */
+	lipl_grammar(Number, Symbol, String, Comment, Sexpr, Qexpr, Expr, Lipl);
 
 	/* REPL */
 	puts("lipl version 0.0.0.0.9");
 	puts("Press ctrl+c to exit");
 	//puts("");
 
-	/* build environment */
-	lenv* e = lenv_new();
-	lenv_add_builtins(e);
-
-	if (argc > 1) {
-		for (int i = 1; i < argc; i++) {
-			lval* args = lval_add(lval_sexpr(), lval_str(argv[i]));
+	/* options come before the files */
+	char* image = NULL;
+	char* dump = NULL;
+	char* profile = NULL;
+	int profile_mode = LPROF_OFF;
+	char* trace = NULL;
+	char* compile = NULL;
+	int arg = 1;
+	for (; arg + 1 < argc; arg += 2) {
+		if (strcmp(argv[arg], "--image") == 0) image = argv[arg+1];
+		else if (strcmp(argv[arg], "--dump-image") == 0) dump = argv[arg+1];
+		else if (strcmp(argv[arg], "--profile") == 0) {
+			profile = argv[arg+1];
+			profile_mode = LPROF_EXACT;
+		} else if (strcmp(argv[arg], "--profile-sample") == 0) {
+			profile = argv[arg+1];
+			profile_mode = LPROF_SAMPLE;
+		} else if (strcmp(argv[arg], "--memstats") == 0) lstats_file = argv[arg+1];
+		else if (strcmp(argv[arg], "--trace") == 0) trace = argv[arg+1];
+		else if (strcmp(argv[arg], "--compile") == 0) compile = argv[arg+1];
+		else if (strcmp(argv[arg], "--jit") == 0) ljit_threshold = atol(argv[arg+1]);
+		else break;
+	}
 
-			lval* x = builtin_load(e, args);
+	/* the event trace goes to its file on errors and signals from here on */
+	if (trace) ltrace_start(trace);
+
+	/* memory statistics are written out however the program exits */
+#ifdef LIPL_STATS
+	if (lstats_file) atexit(lstats_dump);
+#else
+	if (lstats_file) puts("--memstats needs a build with LIPL_STATS");
+#endif
+
+	/* build environment, straight from an image when given one */
+	lenv* e = image ? limage_load(image) : NULL;
+	if (image && !e) {
+		lval* err = lval_err("Could not load image: %s", image);
+		lval_println(err);
+		lval_del(err);
+	}
+	if (!e) {
+		e = lenv_new();
+		lenv_add_builtins(e);
+	}
 
-			if (x->type == LVAL_ERR) lval_println(x);
+	/* parse trees of the REPL are read once and then dropped */
+	mpc_arena_t* arena = mpc_arena_new();
 
-			lval_del(x);
+	/* files named on the command line are compiled to C instead of run when asked, failing the exit status if they can't be */
+	int status = 0;
+	if (compile) {
+		lval* x = lcompile_files(compile, argc - arg, argv + arg);
+		if (x->type == LVAL_ERR) {
+			lval_println(x);
+			status = 1;
 		}
+		lval_del(x);
 	}
-	
-	while(1) {
+
+	/* or parsed in parallel, evaluated and profiled when asked */
+	if (profile) lprof_start(profile_mode);
+	if (arg < argc && !compile) lload_files(e, argc - arg, argv + arg);
+
+	if (profile) {
+		lprof_stop();
+		lval* x = lprof_save(profile);
+		if (x->type == LVAL_ERR) lval_println(x);
+		lval_del(x);
+		lprof_clear();
+	}
+
+	/* dump the environment built so far instead of starting the REPL */
+	if (dump) {
+		lval* x = limage_dump(e, dump);
+		if (x->type == LVAL_ERR) lval_println(x);
+		lval_del(x);
+	}
+
+	while(!dump && !compile) {
 		char* input = readline("lipl>>> ");
+
+		// End of input
+		if (!input) break;
+
 		add_history(input);
 
 		mpc_result_t r;
-		if (mpc_parse("<stdin>", input, Lipl, &r)) {
-			lval* x = lval_eval(e, lval_read(r.output));
+		if (tracer.on) ltrace_emit(LTRACE_PARSE_START, 0);
+		int parsed = mpc_parse_view("<stdin>", input, strlen(input), Lipl, arena, &r);
+		if (tracer.on) ltrace_emit(LTRACE_PARSE_END, 0);
+
+		if (parsed) {
+			lval* x = lval_read(r.output);
+			mpc_arena_clear(arena);
+
+			x = lval_eval(e, x);
 			lval_println(x);
+			if (x->type == LVAL_ERR) ltrace_error();
 			lval_del(x);
-			mpc_ast_delete(r.output);
 		} else {
+			mpc_arena_clear(arena);
 			mpc_err_print(r.error);
 			mpc_err_delete(r.error);
 		}
@@ -940,7 +3397,8 @@ int main (int argc, char **argv) {
 	}
 
 	/* Clean Up and Exit*/
+	mpc_arena_delete(arena);
 	lenv_del(e);
 	mpc_cleanup(8, Number, Symbol, String, Comment, Sexpr, Qexpr, Expr, Lipl);
-	return 0;
+	return status;
 }
@@ -1,4 +1,27 @@
+/* Regular files are mapped into memory where POSIX is available */
+#if defined(__unix__) || defined(__APPLE__)
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+#define MPC_USE_MMAP
+#endif
+
 #include "mpc.h"
+#include <time.h>
+
+#ifdef MPC_USE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* Counters shared between inputs on different threads */
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+#define MPC_ATOMIC _Atomic
+#else
+#define MPC_ATOMIC
+#endif
 
 /*
 ** State Type
@@ -20,6 +43,208 @@ static mpc_state_t mpc_state_new(void) {
   return s;
 }
 
+/*
+** Arena Type
+*/
+
+/*
+** An arena hands out memory by bumping a
+** pointer through a chain of large blocks.
+** Nothing allocated from it is ever freed
+** on its own - clearing or deleting the
+** arena releases everything in one go.
+**
+** When a parse is given an arena every AST
+** node, tag, contents string and children
+** array of the result is placed inside it,
+** so a tree which is only read once and then
+** thrown away costs a handful of mallocs
+** instead of several per node.
+*/
+
+enum {
+  MPC_ARENA_BLOCK_SIZE = 65536,
+  MPC_ARENA_ALIGN      = 16
+};
+
+typedef struct mpc_arena_block_t {
+  struct mpc_arena_block_t *next;
+  size_t size;
+  size_t used;
+} mpc_arena_block_t;
+
+typedef struct mpc_arena_map_t {
+  struct mpc_arena_map_t *next;
+  void *addr;
+  size_t size;
+} mpc_arena_map_t;
+
+struct mpc_arena_t {
+  mpc_arena_block_t *blocks;
+  mpc_arena_map_t *maps;
+};
+
+static size_t mpc_arena_header(void) {
+  return (sizeof(mpc_arena_block_t) + MPC_ARENA_ALIGN - 1) & ~(size_t)(MPC_ARENA_ALIGN - 1);
+}
+
+static mpc_arena_block_t *mpc_arena_block_new(size_t size) {
+  mpc_arena_block_t *b = malloc(mpc_arena_header() + size);
+  b->next = NULL;
+  b->size = size;
+  b->used = 0;
+  return b;
+}
+
+mpc_arena_t *mpc_arena_new(void) {
+  mpc_arena_t *a = malloc(sizeof(mpc_arena_t));
+  a->blocks = mpc_arena_block_new(MPC_ARENA_BLOCK_SIZE);
+  a->maps = NULL;
+  return a;
+}
+
+static void mpc_arena_unmap(mpc_arena_t *a) {
+#ifdef MPC_USE_MMAP
+  mpc_arena_map_t *m;
+  for (m = a->maps; m; m = m->next) { munmap(m->addr, m->size); }
+#endif
+  a->maps = NULL;
+}
+
+void mpc_arena_clear(mpc_arena_t *a) {
+
+  /* The head is always a regular block - keep it for the next parse */
+  mpc_arena_block_t *b = a->blocks->next, *n;
+
+  mpc_arena_unmap(a);
+
+  while (b) {
+    n = b->next;
+    free(b);
+    b = n;
+  }
+
+  a->blocks->next = NULL;
+  a->blocks->used = 0;
+}
+
+void mpc_arena_delete(mpc_arena_t *a) {
+  mpc_arena_block_t *b = a->blocks, *n;
+  mpc_arena_unmap(a);
+  while (b) {
+    n = b->next;
+    free(b);
+    b = n;
+  }
+  free(a);
+}
+
+/*
+** A mark remembers how far an arena has been filled,
+** so a parse which is thrown away can hand back what
+** it took without clearing what came before it.
+*/
+
+typedef struct {
+  mpc_arena_block_t *block;
+  mpc_arena_block_t *next;
+  size_t used;
+} mpc_arena_mark_t;
+
+static mpc_arena_mark_t mpc_arena_mark(mpc_arena_t *a) {
+  mpc_arena_mark_t m;
+  m.block = a->blocks;
+  m.next = a->blocks->next;
+  m.used = a->blocks->used;
+  return m;
+}
+
+static void mpc_arena_rewind(mpc_arena_t *a, mpc_arena_mark_t m) {
+  
+  mpc_arena_block_t *b = a->blocks, *n;
+  
+  /* Blocks begun since are in front, oversized ones behind whichever block was in front then */
+  while (b != m.block) {
+    n = b->next;
+    free(b);
+    b = n;
+  }
+  
+  for (b = m.block->next; b != m.next; b = n) {
+    n = b->next;
+    free(b);
+  }
+  
+  m.block->next = m.next;
+  m.block->used = m.used;
+  a->blocks = m.block;
+}
+
+void *mpc_arena_alloc(mpc_arena_t *a, size_t n) {
+
+  mpc_arena_block_t *b = a->blocks;
+
+  n = (n + MPC_ARENA_ALIGN - 1) & ~(size_t)(MPC_ARENA_ALIGN - 1);
+
+  if (b->used + n <= b->size) {
+    b->used += n;
+    return (char*)b + mpc_arena_header() + b->used - n;
+  }
+
+  /* Oversized requests get a block of their own behind the current one */
+  if (n > MPC_ARENA_BLOCK_SIZE / 4) {
+    b = mpc_arena_block_new(n);
+    b->next = a->blocks->next;
+    a->blocks->next = b;
+  } else {
+    b = mpc_arena_block_new(MPC_ARENA_BLOCK_SIZE);
+    b->next = a->blocks;
+    a->blocks = b;
+  }
+
+  b->used = n;
+  return (char*)b + mpc_arena_header();
+}
+
+/*
+** File Mapping
+**
+** Regular files are parsed from a read-only
+** mapping through the string input rather than
+** a `FILE`, which would cost a `fgetc` per
+** character and a `fseek` per peek and rewind.
+** Anything that cannot be mapped - pipes,
+** terminals, empty files - returns `NULL` and
+** is read the old way.
+*/
+
+static char *mpc_file_map(FILE *f, size_t *size) {
+#ifdef MPC_USE_MMAP
+  struct stat st;
+  void *addr;
+  
+  if (fstat(fileno(f), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) { return NULL; }
+  
+  addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+  if (addr == MAP_FAILED) { return NULL; }
+  
+  posix_madvise(addr, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+  *size = (size_t)st.st_size;
+  return addr;
+#else
+  (void)f; (void)size;
+  return NULL;
+#endif
+}
+
+static void mpc_file_unmap(char *addr, size_t size) {
+#ifdef MPC_USE_MMAP
+  munmap(addr, size);
+#else
+  (void)addr; (void)size;
+#endif
+}
+
 /*
 ** Input Type
 */
@@ -48,6 +273,9 @@ static mpc_state_t mpc_state_new(void) {
 ** This means that if we are requested to seek
 ** back we can simply start reading from the
 ** buffer instead of the input.
+** The buffer keeps its own length rather than
+** being terminated, so NUL bytes read from the
+** pipe come back out of it like any other.
 **
 ** Of course using `mpc_predictive` will disable
 ** backtracking and make LL(1) grammars easy
@@ -65,14 +293,119 @@ enum {
   MPC_INPUT_MARKS_MIN = 32
 };
 
+/*
+** The parse engine does not recurse. It keeps its
+** own stack of frames, one per running parser,
+** and a stack of results which a frame reserves
+** slots on for its children. Both live with the
+** input and are reused for the whole parse, so
+** nesting depth is limited only by memory.
+*/
+
 enum {
-  MPC_INPUT_MEM_NUM = 512
+  MPC_PARSE_FRAMES_MIN  = 64,
+  MPC_PARSE_RESULTS_MIN = 64
 };
 
+typedef struct mpc_fail_t mpc_fail_t;
+
+typedef union {
+  mpc_fail_t *error;
+  mpc_val_t *output;
+} mpc_presult_t;
+
+typedef struct {
+  mpc_parser_t *p;
+  int r;
+  int base;
+  int ef;
+  int j;
+  int c;
+  long pos;
+  unsigned char *dispatch;
+  mpc_fail_t *sub;
+} mpc_frame_t;
+
+/*
+** Profiling counts are kept per named parser. While
+** one runs the input holds a record of where it
+** started, so that on return its time and rewinds
+** can be split from those of the named parsers it
+** called.
+*/
+
+typedef struct mpc_profile_t {
+  mpc_parser_t *p;
+  char *name;
+  struct mpc_profile_t *next;
+  unsigned long calls;
+  unsigned long successes;
+  unsigned long failures;
+  unsigned long rewinds;
+  unsigned long bytes;
+  double self;
+  double total;
+  int active;
+} mpc_profile_t;
+
 typedef struct {
-  char mem[64];
+  mpc_profile_t *x;
+  int depth;
+  long pos;
+  double start;
+  double inner;
+  unsigned long rewinds;
+  unsigned long inner_rewinds;
+} mpc_profile_frame_t;
+
+/*
+** Small values produced during a parse come from
+** per-input free lists, one per size class of 16,
+** 32, 64 and 128 bytes. Each class starts with a
+** slab carved out of the input itself and when
+** that runs dry grows by slabs of doubling size,
+** so allocation and release are a list push or
+** pop. Only requests above the largest class go
+** to `malloc`.
+**
+** Slabs stop doubling at a megabyte, so a large
+** parse may grow many. To find the slab a block
+** came from, each slab is entered in a hash table
+** under every `MPC_MEM_SLAB_KEY` sized stretch of
+** address space it covers. No slab is smaller than
+** that, so at most two share a key, and a block is
+** placed in constant time however many there are.
+*/
+
+enum {
+  MPC_MEM_CLASSES   = 4,
+  MPC_MEM_CLASS_MIN = 16,
+  MPC_MEM_CLASS_MAX = 128,
+  MPC_MEM_SLAB_MIN  = 8192,
+  MPC_MEM_SLAB_MAX  = 1048576,
+  MPC_MEM_SLAB_KEY  = MPC_MEM_SLAB_MIN * 2
+};
+
+typedef union mpc_mem_t {
+  union mpc_mem_t *next;
+  char mem[MPC_MEM_CLASS_MIN];
+  double align;
 } mpc_mem_t;
 
+enum {
+  MPC_INPUT_MEM_NUM = (MPC_MEM_CLASSES * MPC_MEM_SLAB_MIN) / sizeof(mpc_mem_t)
+};
+
+typedef struct mpc_mem_slab_t {
+  struct mpc_mem_slab_t *next;
+  char *end;
+  int cls;
+} mpc_mem_slab_t;
+
+static MPC_ATOMIC unsigned long mpc_mem_allocs_total = 0;
+static MPC_ATOMIC unsigned long mpc_mem_fallbacks_total = 0;
+static MPC_ATOMIC unsigned long mpc_mem_slabs_total = 0;
+
 typedef struct {
 
   int type;
@@ -81,10 +414,15 @@ typedef struct {
   
   char *string;
   char *buffer;
+  long buffered;
   FILE *file;
+  long length;
+  int borrowed;
+  int view;
   
   int suppress;
   int backtrack;
+  int scan;
   int marks_slots;
   int marks_num;
   mpc_state_t *marks;
@@ -92,12 +430,79 @@ typedef struct {
   char *lasts;
   char last;
   
-  size_t mem_index;
-  char mem_full[MPC_INPUT_MEM_NUM];
+  mpc_frame_t *frames;
+  int frames_num;
+  int frames_slots;
+  mpc_presult_t *results;
+  int results_num;
+  int results_slots;
+  
+  mpc_profile_frame_t *profs;
+  int profs_num;
+  int profs_slots;
+  unsigned long rewinds;
+  
+  mpc_mem_t *mem_free[MPC_MEM_CLASSES];
+  char *mem_next[MPC_MEM_CLASSES];
+  char *mem_end[MPC_MEM_CLASSES];
+  size_t mem_slab_size[MPC_MEM_CLASSES];
+  mpc_mem_slab_t *mem_slabs;
+  mpc_mem_slab_t **mem_table;
+  size_t mem_table_slots;
+  size_t mem_table_num;
+  unsigned long mem_allocs;
+  unsigned long mem_fallbacks;
+  unsigned long mem_slabs_num;
   mpc_mem_t mem[MPC_INPUT_MEM_NUM];
   
+  mpc_arena_t *arena;
+  
 } mpc_input_t;
 
+/*
+** On a view input the values passed between
+** parsers are not strings but slices of the
+** input. Every character parser produces one
+** and `mpcf_strfold` just widens the first to
+** cover the rest, so a token is never copied
+** until `mpcf_str_ast` points an AST at it.
+*/
+
+typedef struct {
+  long pos;
+  long len;
+} mpc_slice_t;
+
+static void mpc_mem_init(mpc_input_t *i) {
+  int c;
+  for (c = 0; c < MPC_MEM_CLASSES; c++) {
+    i->mem_free[c] = NULL;
+    i->mem_next[c] = (char*)i->mem + c * MPC_MEM_SLAB_MIN;
+    i->mem_end[c] = i->mem_next[c] + MPC_MEM_SLAB_MIN;
+    i->mem_slab_size[c] = MPC_MEM_SLAB_MIN * 2;
+  }
+  i->mem_slabs = NULL;
+  i->mem_table = NULL;
+  i->mem_table_slots = 0;
+  i->mem_table_num = 0;
+  i->mem_allocs = 0;
+  i->mem_fallbacks = 0;
+  i->mem_slabs_num = 0;
+}
+
+static void mpc_stack_init(mpc_input_t *i) {
+  i->frames = NULL;
+  i->frames_num = 0;
+  i->frames_slots = 0;
+  i->results = NULL;
+  i->results_num = 0;
+  i->results_slots = 0;
+  i->profs = NULL;
+  i->profs_num = 0;
+  i->profs_slots = 0;
+  i->rewinds = 0;
+}
+
 static mpc_input_t *mpc_input_new_string(const char *filename, const char *string) {
 
   mpc_input_t *i = malloc(sizeof(mpc_input_t));
@@ -108,10 +513,13 @@ static mpc_input_t *mpc_input_new_string(const char *filename, const char *strin
   
   i->state = mpc_state_new();
   
-  i->string = malloc(strlen(string) + 1);
-  strcpy(i->string, string);
+  i->length = strlen(string);
+  i->string = malloc(i->length + 1);
+  memcpy(i->string, string, i->length + 1);
   i->buffer = NULL;
   i->file = NULL;
+  i->borrowed = 0;
+  i->view = 0;
   
   i->suppress = 0;
   i->backtrack = 1;
@@ -121,8 +529,10 @@ static mpc_input_t *mpc_input_new_string(const char *filename, const char *strin
   i->lasts = malloc(sizeof(char) * i->marks_slots);
   i->last = '\0';
   
-  i->mem_index = 0;
-  memset(i->mem_full, 0, sizeof(char) * MPC_INPUT_MEM_NUM);
+  mpc_mem_init(i);
+  mpc_stack_init(i);
+  
+  i->arena = NULL;
   
   return i;
 }
@@ -140,6 +550,52 @@ static mpc_input_t *mpc_input_new_nstring(const char *filename, const char *stri
   i->string = malloc(length + 1);
   strncpy(i->string, string, length);
   i->string[length] = '\0';
+  i->length = strlen(i->string);
+  i->buffer = NULL;
+  i->file = NULL;
+  i->borrowed = 0;
+  i->view = 0;
+  
+  i->suppress = 0;
+  i->backtrack = 1;
+  i->marks_num = 0;
+  i->marks_slots = MPC_INPUT_MARKS_MIN;
+  i->marks = malloc(sizeof(mpc_state_t) * i->marks_slots);
+  i->lasts = malloc(sizeof(char) * i->marks_slots);
+  i->last = '\0';
+  
+  mpc_mem_init(i);
+  mpc_stack_init(i);
+  
+  i->arena = NULL;
+  
+  return i;
+
+}
+
+/*
+** A borrowed input is a string input which uses
+** the caller's buffer instead of copying it. The
+** buffer need not be NUL terminated and must
+** outlive the parse. A view is a borrowed input
+** whose AST contents also point into the buffer,
+** so it must outlive the tree as well.
+*/
+
+static mpc_input_t *mpc_input_new_borrowed(const char *filename, const char *string, size_t length) {
+
+  mpc_input_t *i = malloc(sizeof(mpc_input_t));
+  
+  i->filename = malloc(strlen(filename) + 1);
+  strcpy(i->filename, filename);
+  i->type = MPC_INPUT_STRING;
+  
+  i->state = mpc_state_new();
+  
+  i->string = (char*)string;
+  i->length = length;
+  i->borrowed = 1;
+  i->view = 0;
   i->buffer = NULL;
   i->file = NULL;
   
@@ -151,11 +607,18 @@ static mpc_input_t *mpc_input_new_nstring(const char *filename, const char *stri
   i->lasts = malloc(sizeof(char) * i->marks_slots);
   i->last = '\0';
   
-  i->mem_index = 0;
-  memset(i->mem_full, 0, sizeof(char) * MPC_INPUT_MEM_NUM);
+  mpc_mem_init(i);
+  mpc_stack_init(i);
+  
+  i->arena = NULL;
   
   return i;
+}
 
+static mpc_input_t *mpc_input_new_view(const char *filename, const char *string, size_t length) {
+  mpc_input_t *i = mpc_input_new_borrowed(filename, string, length);
+  i->view = 1;
+  return i;
 }
 
 static mpc_input_t *mpc_input_new_pipe(const char *filename, FILE *pipe) {
@@ -171,6 +634,9 @@ static mpc_input_t *mpc_input_new_pipe(const char *filename, FILE *pipe) {
   i->string = NULL;
   i->buffer = NULL;
   i->file = pipe;
+  i->length = 0;
+  i->borrowed = 0;
+  i->view = 0;
   
   i->suppress = 0;
   i->backtrack = 1;
@@ -180,8 +646,10 @@ static mpc_input_t *mpc_input_new_pipe(const char *filename, FILE *pipe) {
   i->lasts = malloc(sizeof(char) * i->marks_slots);
   i->last = '\0';
   
-  i->mem_index = 0;
-  memset(i->mem_full, 0, sizeof(char) * MPC_INPUT_MEM_NUM);
+  mpc_mem_init(i);
+  mpc_stack_init(i);
+  
+  i->arena = NULL;
   
   return i;
   
@@ -199,6 +667,9 @@ static mpc_input_t *mpc_input_new_file(const char *filename, FILE *file) {
   i->string = NULL;
   i->buffer = NULL;
   i->file = file;
+  i->length = 0;
+  i->borrowed = 0;
+  i->view = 0;
   
   i->suppress = 0;
   i->backtrack = 1;
@@ -208,48 +679,173 @@ static mpc_input_t *mpc_input_new_file(const char *filename, FILE *file) {
   i->lasts = malloc(sizeof(char) * i->marks_slots);
   i->last = '\0';
   
-  i->mem_index = 0;
-  memset(i->mem_full, 0, sizeof(char) * MPC_INPUT_MEM_NUM);
+  mpc_mem_init(i);
+  mpc_stack_init(i);
+  
+  i->arena = NULL;
   
   return i;
 }
 
+static void mpc_mem_release(mpc_input_t *i) {
+  
+  mpc_mem_slab_t *s = i->mem_slabs, *n;
+  
+  while (s) {
+    n = s->next;
+    free(s);
+    s = n;
+  }
+  free(i->mem_table);
+  
+  mpc_mem_allocs_total += i->mem_allocs;
+  mpc_mem_fallbacks_total += i->mem_fallbacks;
+  mpc_mem_slabs_total += i->mem_slabs_num;
+}
+
 static void mpc_input_delete(mpc_input_t *i) {
   
   free(i->filename);
   
-  if (i->type == MPC_INPUT_STRING) { free(i->string); }
+  if (i->type == MPC_INPUT_STRING && !i->borrowed) { free(i->string); }
   if (i->type == MPC_INPUT_PIPE) { free(i->buffer); }
   
+  mpc_mem_release(i);
+  
   free(i->marks);
   free(i->lasts);
+  free(i->frames);
+  free(i->results);
+  free(i->profs);
   free(i);
 }
 
-static int mpc_mem_ptr(mpc_input_t *i, void *p) {
-  return
-    (char*)p >= (char*)(i->mem) &&
-    (char*)p <  (char*)(i->mem) + (MPC_INPUT_MEM_NUM * sizeof(mpc_mem_t));
+static size_t mpc_mem_class_size(int c) {
+  return (size_t)MPC_MEM_CLASS_MIN << c;
 }
 
-static void *mpc_malloc(mpc_input_t *i, size_t n) {
+static int mpc_mem_class(size_t n) {
+  if (n <= 16) { return 0; }
+  if (n <= 32) { return 1; }
+  if (n <= 64) { return 2; }
+  return 3;
+}
+
+static size_t mpc_mem_key_slot(mpc_input_t *i, size_t key) {
+  return (key * 2654435761u) & (i->mem_table_slots - 1);
+}
+
+static void mpc_mem_table_add(mpc_input_t *i, mpc_mem_slab_t *s) {
+  
+  size_t key, j;
+  
+  for (key = (size_t)s / MPC_MEM_SLAB_KEY; key <= ((size_t)s->end - 1) / MPC_MEM_SLAB_KEY; key++) {
+    j = mpc_mem_key_slot(i, key);
+    while (i->mem_table[j]) { j = (j + 1) & (i->mem_table_slots - 1); }
+    i->mem_table[j] = s;
+    i->mem_table_num++;
+  }
+}
+
+/* Enters a new slab, first growing the table so it stays at most half full */
+static int mpc_mem_table_put(mpc_input_t *i, mpc_mem_slab_t *s) {
+  
+  size_t keys = ((size_t)s->end - 1) / MPC_MEM_SLAB_KEY - (size_t)s / MPC_MEM_SLAB_KEY + 1;
+  size_t slots = i->mem_table_slots ? i->mem_table_slots : 64;
+  mpc_mem_slab_t **table, *t;
+  
+  while (2 * (i->mem_table_num + keys) > slots) { slots *= 2; }
+  
+  if (slots != i->mem_table_slots) {
+    table = calloc(slots, sizeof(mpc_mem_slab_t*));
+    if (table == NULL) { return 0; }
+    free(i->mem_table);
+    i->mem_table = table;
+    i->mem_table_slots = slots;
+    i->mem_table_num = 0;
+    for (t = i->mem_slabs; t; t = t->next) { mpc_mem_table_add(i, t); }
+  }
+  
+  mpc_mem_table_add(i, s);
+  return 1;
+}
+
+/* Returns the size class of a block from the pool or -1 for heap memory */
+static int mpc_mem_owner(mpc_input_t *i, void *p) {
+  
   size_t j;
+  mpc_mem_slab_t *s;
+  
+  if ((char*)p >= (char*)i->mem && (char*)p < (char*)(i->mem + MPC_INPUT_MEM_NUM)) {
+    return (int)(((char*)p - (char*)i->mem) / MPC_MEM_SLAB_MIN);
+  }
+  
+  if (i->mem_table == NULL) { return -1; }
+  
+  /* A half full table keeps the probe for a key short */
+  j = mpc_mem_key_slot(i, (size_t)p / MPC_MEM_SLAB_KEY);
+  while ((s = i->mem_table[j])) {
+    if ((char*)p > (char*)s && (char*)p < s->end) { return s->cls; }
+    j = (j + 1) & (i->mem_table_slots - 1);
+  }
+  
+  return -1;
+}
+
+static int mpc_mem_grow(mpc_input_t *i, int c) {
+  
+  size_t size = i->mem_slab_size[c];
+  mpc_mem_slab_t *s = malloc(sizeof(mpc_mem_slab_t) + size);
+  
+  if (s == NULL) { return 0; }
+  
+  s->end = (char*)(s + 1) + size;
+  s->cls = c;
+  
+  if (!mpc_mem_table_put(i, s)) {
+    free(s);
+    return 0;
+  }
+  
+  s->next = i->mem_slabs;
+  i->mem_slabs = s;
+  i->mem_slabs_num++;
+  
+  i->mem_next[c] = (char*)(s + 1);
+  i->mem_end[c] = s->end;
+  if (size < MPC_MEM_SLAB_MAX) { i->mem_slab_size[c] = size * 2; }
+  
+  return 1;
+}
+
+static void *mpc_malloc(mpc_input_t *i, size_t n) {
+  
+  int c;
   char *p;
   
-  if (n > sizeof(mpc_mem_t)) { return malloc(n); }
+  i->mem_allocs++;
   
-  j = i->mem_index;
-  do {
-    if (!i->mem_full[i->mem_index]) {
-      p = (void*)(i->mem + i->mem_index);
-      i->mem_full[i->mem_index] = 1;
-      i->mem_index = (i->mem_index+1) % MPC_INPUT_MEM_NUM;
-      return p;
-    }
-    i->mem_index = (i->mem_index+1) % MPC_INPUT_MEM_NUM;
-  } while (j != i->mem_index);
+  if (n > MPC_MEM_CLASS_MAX) {
+    i->mem_fallbacks++;
+    return malloc(n);
+  }
+  
+  c = mpc_mem_class(n);
+  
+  if (i->mem_free[c]) {
+    p = (char*)i->mem_free[c];
+    i->mem_free[c] = i->mem_free[c]->next;
+    return p;
+  }
   
-  return malloc(n);
+  if (i->mem_next[c] == i->mem_end[c] && !mpc_mem_grow(i, c)) {
+    i->mem_fallbacks++;
+    return malloc(n);
+  }
+  
+  p = i->mem_next[c];
+  i->mem_next[c] += mpc_mem_class_size(c);
+  return p;
 }
 
 static void *mpc_calloc(mpc_input_t *i, size_t n, size_t m) {
@@ -259,21 +855,24 @@ static void *mpc_calloc(mpc_input_t *i, size_t n, size_t m) {
 }
 
 static void mpc_free(mpc_input_t *i, void *p) {
-  size_t j;
-  if (!mpc_mem_ptr(i, p)) { free(p); return; }
-  j = ((size_t)(((char*)p) - ((char*)i->mem))) / sizeof(mpc_mem_t);
-  i->mem_full[j] = 0;
+  mpc_mem_t *b;
+  int c = mpc_mem_owner(i, p);
+  if (c < 0) { free(p); return; }
+  b = p;
+  b->next = i->mem_free[c];
+  i->mem_free[c] = b;
 }
 
 static void *mpc_realloc(mpc_input_t *i, void *p, size_t n) {
   
   char *q = NULL;
+  int c = mpc_mem_owner(i, p);
   
-  if (!mpc_mem_ptr(i, p)) { return realloc(p, n); }
+  if (c < 0) { return realloc(p, n); }
   
-  if (n > sizeof(mpc_mem_t)) {
-    q = malloc(n);
-    memcpy(q, p, sizeof(mpc_mem_t));
+  if (n > mpc_mem_class_size(c)) {
+    q = mpc_malloc(i, n);
+    memcpy(q, p, mpc_mem_class_size(c));
     mpc_free(i, p);
     return q;
   }
@@ -283,13 +882,20 @@ static void *mpc_realloc(mpc_input_t *i, void *p, size_t n) {
 
 static void *mpc_export(mpc_input_t *i, void *p) {
   char *q = NULL;
-  if (!mpc_mem_ptr(i, p)) { return p; }
-  q = malloc(sizeof(mpc_mem_t));
-  memcpy(q, p, sizeof(mpc_mem_t));
+  int c = mpc_mem_owner(i, p);
+  if (c < 0) { return p; }
+  q = malloc(mpc_mem_class_size(c));
+  memcpy(q, p, mpc_mem_class_size(c));
   mpc_free(i, p);
   return q; 
 }
 
+void mpc_mem_stats(mpc_mem_stats_t *s) {
+  s->allocs = mpc_mem_allocs_total;
+  s->fallbacks = mpc_mem_fallbacks_total;
+  s->slabs = mpc_mem_slabs_total;
+}
+
 static void mpc_input_backtrack_disable(mpc_input_t *i) { i->backtrack--; }
 static void mpc_input_backtrack_enable(mpc_input_t *i) { i->backtrack++; }
 
@@ -313,6 +919,7 @@ static void mpc_input_mark(mpc_input_t *i) {
   
   if (i->type == MPC_INPUT_PIPE && i->marks_num == 1) {
     i->buffer = calloc(1, 1);
+    i->buffered = 0;
   }
   
 }
@@ -343,6 +950,8 @@ static void mpc_input_rewind(mpc_input_t *i) {
   
   if (i->backtrack < 1) { return; }
   
+  if (i->marks[i->marks_num-1].pos != i->state.pos) { i->rewinds++; }
+  
   i->state = i->marks[i->marks_num-1];
   i->last  = i->lasts[i->marks_num-1];
   
@@ -354,7 +963,7 @@ static void mpc_input_rewind(mpc_input_t *i) {
 }
 
 static int mpc_input_buffer_in_range(mpc_input_t *i) {
-  return i->state.pos < (long)(strlen(i->buffer) + i->marks[0].pos);
+  return i->state.pos < i->buffered + i->marks[0].pos;
 }
 
 static char mpc_input_buffer_get(mpc_input_t *i) {
@@ -362,9 +971,11 @@ static char mpc_input_buffer_get(mpc_input_t *i) {
 }
 
 static int mpc_input_terminated(mpc_input_t *i) {
-  if (i->type == MPC_INPUT_STRING && i->state.pos == (long)strlen(i->string)) { return 1; }
+  if (i->type == MPC_INPUT_STRING && i->state.pos >= i->length) { return 1; }
   if (i->type == MPC_INPUT_FILE && feof(i->file)) { return 1; }
-  if (i->type == MPC_INPUT_PIPE && feof(i->file)) { return 1; }
+  /* A pipe stays at end of file while the buffer is read back */
+  if (i->type == MPC_INPUT_PIPE && feof(i->file)
+  &&  !(i->buffer && mpc_input_buffer_in_range(i))) { return 1; }
   return 0;
 }
 
@@ -374,7 +985,7 @@ static char mpc_input_getc(mpc_input_t *i) {
   
   switch (i->type) {
     
-    case MPC_INPUT_STRING: return i->string[i->state.pos];
+    case MPC_INPUT_STRING: return i->state.pos < i->length ? i->string[i->state.pos] : '\0';
     case MPC_INPUT_FILE: c = fgetc(i->file); return c;
     case MPC_INPUT_PIPE:
     
@@ -397,7 +1008,7 @@ static char mpc_input_peekc(mpc_input_t *i) {
   char c = '\0';
   
   switch (i->type) {
-    case MPC_INPUT_STRING: return i->string[i->state.pos];
+    case MPC_INPUT_STRING: return i->state.pos < i->length ? i->string[i->state.pos] : '\0';
     case MPC_INPUT_FILE: 
       
       c = fgetc(i->file);
@@ -449,13 +1060,19 @@ static int mpc_input_failure(mpc_input_t *i, char c) {
   return 0;
 }
 
+static mpc_slice_t *mpc_slice_new(mpc_input_t *i, long pos, long len) {
+  mpc_slice_t *s = mpc_malloc(i, sizeof(mpc_slice_t));
+  s->pos = pos;
+  s->len = len;
+  return s;
+}
+
 static int mpc_input_success(mpc_input_t *i, char c, char **o) {
   
   if (i->type == MPC_INPUT_PIPE
   &&  i->buffer && !mpc_input_buffer_in_range(i)) {
-    i->buffer = realloc(i->buffer, strlen(i->buffer) + 2);
-    i->buffer[strlen(i->buffer) + 1] = '\0';
-    i->buffer[strlen(i->buffer) + 0] = c;
+    i->buffer = realloc(i->buffer, i->buffered + 1);
+    i->buffer[i->buffered++] = c;
   }
   
   i->last = c;
@@ -467,7 +1084,9 @@ static int mpc_input_success(mpc_input_t *i, char c, char **o) {
     i->state.row++;
   }
   
-  if (o) {
+  if (o && i->view) {
+    (*o) = (char*)mpc_slice_new(i, i->state.pos-1, 1);
+  } else if (o) {
     (*o) = mpc_malloc(i, 2);
     (*o)[0] = c;
     (*o)[1] = '\0';
@@ -512,7 +1131,13 @@ static int mpc_input_satisfy(mpc_input_t *i, int(*cond)(char), char **o) {
   return cond(x) ? mpc_input_success(i, x, o) : mpc_input_failure(i, x);  
 }
 
-static int mpc_input_string(mpc_input_t *i, const char *c, char **o) {
+static int mpc_input_charset(mpc_input_t *i, const unsigned char *s, char **o) {
+  char x = mpc_input_getc(i);
+  if (mpc_input_terminated(i)) { return 0; }
+  return s[(unsigned char)x] ? mpc_input_success(i, x, o) : mpc_input_failure(i, x);
+}
+
+static int mpc_input_literal(mpc_input_t *i, const char *c) {
   
   const char *x = c;
 
@@ -525,12 +1150,84 @@ static int mpc_input_string(mpc_input_t *i, const char *c, char **o) {
     x++;
   }
   mpc_input_unmark(i);
+  return 1;
+}
+
+static int mpc_input_string(mpc_input_t *i, const char *c, char **o) {
+  
+  long n = (long)strlen(c);
+  
+  if (!mpc_input_literal(i, c)) { return 0; }
+  
+  if (i->view) {
+    *o = (char*)mpc_slice_new(i, i->state.pos - n, n);
+    return 1;
+  }
   
-  *o = mpc_malloc(i, strlen(c) + 1);
+  *o = mpc_malloc(i, n + 1);
   strcpy(*o, c);
   return 1;
 }
 
+/*
+** Matches the longest run of bytes in the set and
+** returns it as one string, or one slice on a view,
+** just as folding them one by one would. Strings
+** are scanned in place, other inputs go through the
+** usual byte functions so pipes keep their buffer.
+*/
+
+static int mpc_input_span(mpc_input_t *i, const unsigned char *s, int min, char **o) {
+  
+  long start = i->state.pos, n = 0, size = MPC_MEM_CLASS_MIN;
+  char c, *buffer;
+  
+  if (i->type == MPC_INPUT_STRING) {
+    
+    while (i->state.pos < i->length && s[(unsigned char)i->string[i->state.pos]]) {
+      c = i->string[i->state.pos];
+      i->last = c;
+      i->state.pos++;
+      i->state.col++;
+      if (c == '\n') {
+        i->state.col = 0;
+        i->state.row++;
+      }
+    }
+    
+    n = i->state.pos - start;
+    if (n < min) { return 0; }
+    
+    if (i->view) {
+      *o = (char*)mpc_slice_new(i, start, n);
+      return 1;
+    }
+    
+    *o = mpc_malloc(i, n + 1);
+    memcpy(*o, i->string + start, n);
+    (*o)[n] = '\0';
+    return 1;
+  }
+  
+  buffer = mpc_malloc(i, size);
+  while (mpc_input_charset(i, s, NULL)) {
+    if (n + 1 == size) {
+      size *= 2;
+      buffer = mpc_realloc(i, buffer, size);
+    }
+    buffer[n++] = i->last;
+  }
+  buffer[n] = '\0';
+  
+  if (n < min) {
+    mpc_free(i, buffer);
+    return 0;
+  }
+  
+  *o = buffer;
+  return 1;
+}
+
 static int mpc_input_anchor(mpc_input_t* i, int(*f)(char,char), char **o) {
   *o = NULL;
   return f(i->last, mpc_input_peekc(i));
@@ -575,14 +1272,12 @@ static void mpc_err_string_cat(char *buffer, int *pos, int *max, char const *fmt
   va_end(va);
 }
 
-static char char_unescape_buffer[4];
-
-static const char *mpc_err_char_unescape(char c) {
+static const char *mpc_err_char_unescape(char c, char *buffer) {
   
-  char_unescape_buffer[0] = '\'';
-  char_unescape_buffer[1] = ' ';
-  char_unescape_buffer[2] = '\'';
-  char_unescape_buffer[3] = '\0';
+  buffer[0] = '\'';
+  buffer[1] = ' ';
+  buffer[2] = '\'';
+  buffer[3] = '\0';
   
   switch (c) {
     case '\a': return "bell";
@@ -595,8 +1290,8 @@ static const char *mpc_err_char_unescape(char c) {
     case '\t': return "tab";
     case ' ' : return "space";
     default:
-      char_unescape_buffer[1] = c;
-      return char_unescape_buffer;
+      buffer[1] = c;
+      return buffer;
   }
   
 }
@@ -607,6 +1302,7 @@ char *mpc_err_string(mpc_err_t *x) {
   int pos = 0; 
   int max = 1023;
   char *buffer = calloc(1, 1024);
+  char unescaped[4];
   
   if (x->failure) {
     mpc_err_string_cat(buffer, &pos, &max,
@@ -631,40 +1327,67 @@ char *mpc_err_string(mpc_err_t *x) {
   }
   
   mpc_err_string_cat(buffer, &pos, &max, " at ");
-  mpc_err_string_cat(buffer, &pos, &max, mpc_err_char_unescape(x->recieved));
+  mpc_err_string_cat(buffer, &pos, &max, mpc_err_char_unescape(x->recieved, unescaped));
   mpc_err_string_cat(buffer, &pos, &max, "\n");
   
   return realloc(buffer, strlen(buffer) + 1);
 }
 
-static mpc_err_t *mpc_err_new(mpc_input_t *i, const char *expected) {
-  mpc_err_t *x;
-  if (i->suppress) { return NULL; }
-  x = mpc_malloc(i, sizeof(mpc_err_t));
-  x->filename = mpc_malloc(i, strlen(i->filename) + 1);
-  strcpy(x->filename, i->filename);
-  x->state = i->state;
-  x->expected_num = 1;
-  x->expected = mpc_malloc(i, sizeof(char*));
-  x->expected[0] = mpc_malloc(i, strlen(expected) + 1);
-  strcpy(x->expected[0], expected);
-  x->failure = NULL;
-  x->recieved = mpc_input_peekc(i);
-  return x;
-}
-
-static mpc_err_t *mpc_err_fail(mpc_input_t *i, const char *failure) {
-  mpc_err_t *x;
-  if (i->suppress) { return NULL; }
-  x = mpc_malloc(i, sizeof(mpc_err_t));
-  x->filename = mpc_malloc(i, strlen(i->filename) + 1);
-  strcpy(x->filename, i->filename);
-  x->state = i->state;
-  x->expected_num = 0;
-  x->expected = NULL;
-  x->failure = mpc_malloc(i, strlen(failure) + 1);
-  strcpy(x->failure, failure);
+/*
+** While parsing, a failure only records where it
+** happened, what was expected there and the byte
+** found instead, pointing at strings the parsers
+** own. Only failures furthest into the input can
+** end up in the message, so merging keeps the one
+** further along and joins those at the same place
+** into a tree. The `mpc_err_t` and its strings are
+** only built from that tree once the whole parse
+** has failed.
+*/
+
+enum {
+  MPC_FAIL_EXPECT  = 0,
+  MPC_FAIL_FAILURE = 1,
+  MPC_FAIL_OR      = 2,
+  MPC_FAIL_REPEAT  = 3
+};
+
+struct mpc_fail_t {
+  mpc_state_t state;
+  char type;
+  char recieved;
+  int n;
+  const char *m;
+  mpc_fail_t *x;
+  mpc_fail_t *y;
+};
+
+static mpc_fail_t *mpc_err_node(mpc_input_t *i, int type, mpc_state_t s) {
+  mpc_fail_t *x = mpc_malloc(i, sizeof(mpc_fail_t));
+  x->state = s;
+  x->type = type;
   x->recieved = ' ';
+  x->n = 0;
+  x->m = NULL;
+  x->x = NULL;
+  x->y = NULL;
+  return x;
+}
+
+static mpc_fail_t *mpc_err_new(mpc_input_t *i, const char *expected) {
+  mpc_fail_t *x;
+  if (i->suppress) { return NULL; }
+  x = mpc_err_node(i, MPC_FAIL_EXPECT, i->state);
+  x->m = expected;
+  x->recieved = mpc_input_peekc(i);
+  return x;
+}
+
+static mpc_fail_t *mpc_err_fail(mpc_input_t *i, const char *failure) {
+  mpc_fail_t *x;
+  if (i->suppress) { return NULL; }
+  x = mpc_err_node(i, MPC_FAIL_FAILURE, i->state);
+  x->m = failure;
   return x;
 }
 
@@ -682,172 +1405,165 @@ static mpc_err_t *mpc_err_file(const char *filename, const char *failure) {
   return x;
 }
 
-static void mpc_err_delete_internal(mpc_input_t *i, mpc_err_t *x) {
-  int j;
-  if (x == NULL) { return; }
-  for (j = 0; j < x->expected_num; j++) { mpc_free(i, x->expected[j]); }
-  mpc_free(i, x->expected);
-  mpc_free(i, x->filename);
-  mpc_free(i, x->failure);
-  mpc_free(i, x);
-}
-
-static mpc_err_t *mpc_err_export(mpc_input_t *i, mpc_err_t *x) {
-  int j;
-  for (j = 0; j < x->expected_num; j++) {
-    x->expected[j] = mpc_export(i, x->expected[j]);
+/* Rotates left children up so the tree goes without recursion */
+static void mpc_err_delete_internal(mpc_input_t *i, mpc_fail_t *x) {
+  mpc_fail_t *y;
+  while (x) {
+    if (x->x == NULL) {
+      y = x->y;
+      mpc_free(i, x);
+      x = y;
+    } else {
+      y = x->x;
+      x->x = y->y;
+      y->y = x;
+      x = y;
+    }
   }
-  x->expected = mpc_export(i, x->expected);
-  x->filename = mpc_export(i, x->filename);
-  x->failure = mpc_export(i, x->failure);
-  return mpc_export(i, x);
 }
 
-static int mpc_err_contains_expected(mpc_input_t *i, mpc_err_t *x, char *expected) {
+static void mpc_err_add_expected(mpc_err_t *x, const char *expected) {
   int j;
-  (void)i;
   for (j = 0; j < x->expected_num; j++) {
-    if (strcmp(x->expected[j], expected) == 0) { return 1; }
+    if (strcmp(x->expected[j], expected) == 0) { return; }
   }
-  return 0;
-}
-
-static void mpc_err_add_expected(mpc_input_t *i, mpc_err_t *x, char *expected) {
-  (void)i;
   x->expected_num++;
-  x->expected = mpc_realloc(i, x->expected, sizeof(char*) * x->expected_num);
-  x->expected[x->expected_num-1] = mpc_malloc(i, strlen(expected) + 1);
+  x->expected = realloc(x->expected, sizeof(char*) * x->expected_num);
+  x->expected[x->expected_num-1] = malloc(strlen(expected) + 1);
   strcpy(x->expected[x->expected_num-1], expected);
 }
 
-static mpc_err_t *mpc_err_or(mpc_input_t *i, mpc_err_t** x, int n) {
-  
-  int j, k, fst;
-  mpc_err_t *e;
+static char *mpc_err_repeat(mpc_err_t *x, const char *prefix) {
+
+  int j = 0;
+  size_t l = 0;
+  char *expect = NULL;
   
-  fst = -1;
-  for (j = 0; j < n; j++) {
-    if (x[j] != NULL) { fst = j; }
+  if (x->expected_num == 0) {
+    return calloc(1, 1);
   }
   
-  if (fst == -1) { return NULL; }
-  
-  e = mpc_malloc(i, sizeof(mpc_err_t));
-  e->state = mpc_state_invalid();
-  e->expected_num = 0;
-  e->expected = NULL;
-  e->failure = NULL;
-  e->filename = mpc_malloc(i, strlen(x[fst]->filename)+1);
-  strcpy(e->filename, x[fst]->filename);
-  
-  for (j = 0; j < n; j++) {
-    if (x[j] == NULL) { continue; }
-    if (x[j]->state.pos > e->state.pos) { e->state = x[j]->state; }
+  l += strlen(prefix);
+  for (j = 0; j < x->expected_num-2; j++) {
+    l += strlen(x->expected[j]) + strlen(", ");
   }
-  
-  for (j = 0; j < n; j++) {
-    if (x[j] == NULL) { continue; }
-    if (x[j]->state.pos < e->state.pos) { continue; }
-    
-    if (x[j]->failure) {
-      e->failure = mpc_malloc(i, strlen(x[j]->failure)+1);
-      strcpy(e->failure, x[j]->failure);
-      break;
-    }
-    
-    e->recieved = x[j]->recieved;
-    
-    for (k = 0; k < x[j]->expected_num; k++) {
-      if (!mpc_err_contains_expected(i, e, x[j]->expected[k])) {
-        mpc_err_add_expected(i, e, x[j]->expected[k]);
-      }
-    }
+  if (x->expected_num > 1) {
+    l += strlen(x->expected[x->expected_num-2]);
+    l += strlen(" or ");
   }
+  l += strlen(x->expected[x->expected_num-1]);
   
-  for (j = 0; j < n; j++) {
-    if (x[j] == NULL) { continue; }
-    mpc_err_delete_internal(i, x[j]);
+  expect = malloc(l + 1);
+  
+  strcpy(expect, prefix);
+  for (j = 0; j < x->expected_num-2; j++) {
+    strcat(expect, x->expected[j]); strcat(expect, ", ");
+  }
+  if (x->expected_num > 1) {
+    strcat(expect, x->expected[x->expected_num-2]);
+    strcat(expect, " or ");
   }
+  strcat(expect, x->expected[x->expected_num-1]);
   
-  return e;
+  return expect;
 }
 
-static mpc_err_t *mpc_err_repeat(mpc_input_t *i, mpc_err_t *x, const char *prefix) {
+/*
+** Adds the failures of a tree to `e` in the order
+** they were merged, stopping at the first one with
+** a message of its own, which is then all that is
+** reported.
+*/
 
-  int j = 0;
-  size_t l = 0;
-  char *expect = NULL;
+static int mpc_err_collect(mpc_err_t *e, mpc_fail_t *x) {
   
-  if (x == NULL) { return NULL; }
-  
-  if (x->expected_num == 0) {
-    expect = mpc_calloc(i, 1, 1);
-    x->expected_num = 1;
-    x->expected = mpc_realloc(i, x->expected, sizeof(char*) * x->expected_num);
-    x->expected[0] = expect;
-    return x;
-  }
+  int j, failed;
+  char prefix[32];
+  char *expect;
+  mpc_err_t r;
   
-  else if (x->expected_num == 1) {
-    expect = mpc_malloc(i, strlen(prefix) + strlen(x->expected[0]) + 1);
-    strcpy(expect, prefix);
-    strcat(expect, x->expected[0]);
-    mpc_free(i, x->expected[0]);
-    x->expected[0] = expect;
-    return x;
-  }
-  
-  else if (x->expected_num > 1) {
+  switch (x->type) {
     
-    l += strlen(prefix);
-    for (j = 0; j < x->expected_num-2; j++) {
-      l += strlen(x->expected[j]) + strlen(", ");
-    }
-    l += strlen(x->expected[x->expected_num-2]);
-    l += strlen(" or ");
-    l += strlen(x->expected[x->expected_num-1]);
+    case MPC_FAIL_EXPECT:
+      mpc_err_add_expected(e, x->m);
+      e->recieved = x->recieved;
+      return 0;
     
-    expect = mpc_malloc(i, l + 1);
+    case MPC_FAIL_FAILURE:
+      e->failure = malloc(strlen(x->m) + 1);
+      strcpy(e->failure, x->m);
+      return 1;
     
-    strcpy(expect, prefix);
-    for (j = 0; j < x->expected_num-2; j++) {
-      strcat(expect, x->expected[j]); strcat(expect, ", ");
-    }
-    strcat(expect, x->expected[x->expected_num-2]);
-    strcat(expect, " or ");
-    strcat(expect, x->expected[x->expected_num-1]);
-
-    for (j = 0; j < x->expected_num; j++) { mpc_free(i, x->expected[j]); }
+    case MPC_FAIL_OR:
+      return mpc_err_collect(e, x->x) || mpc_err_collect(e, x->y);
     
-    x->expected_num = 1;
-    x->expected = mpc_realloc(i, x->expected, sizeof(char*) * x->expected_num);
-    x->expected[0] = expect;
-    return x;
+    default:
+      r.expected_num = 0;
+      r.expected = NULL;
+      r.failure = NULL;
+      r.recieved = ' ';
+      failed = mpc_err_collect(&r, x->x);
+      
+      if (failed) {
+        e->failure = r.failure;
+      } else {
+        if (x->n < 0) { strcpy(prefix, "one or more of "); }
+        else { sprintf(prefix, "%i of ", x->n); }
+        expect = mpc_err_repeat(&r, prefix);
+        mpc_err_add_expected(e, expect);
+        e->recieved = r.recieved;
+        free(expect);
+      }
+      
+      for (j = 0; j < r.expected_num; j++) { free(r.expected[j]); }
+      free(r.expected);
+      return failed;
   }
   
-  return NULL;
 }
 
-static mpc_err_t *mpc_err_many1(mpc_input_t *i, mpc_err_t *x) {
-  return mpc_err_repeat(i, x, "one or more of ");
+static mpc_err_t *mpc_err_export(mpc_input_t *i, mpc_fail_t *x) {
+  mpc_err_t *e = malloc(sizeof(mpc_err_t));
+  e->filename = malloc(strlen(i->filename) + 1);
+  strcpy(e->filename, i->filename);
+  e->state = x->state;
+  e->expected_num = 0;
+  e->expected = NULL;
+  e->failure = NULL;
+  e->recieved = ' ';
+  mpc_err_collect(e, x);
+  mpc_err_delete_internal(i, x);
+  return e;
+}
+
+static mpc_fail_t *mpc_err_many1(mpc_input_t *i, mpc_fail_t *x) {
+  mpc_fail_t *e;
+  if (x == NULL) { return NULL; }
+  e = mpc_err_node(i, MPC_FAIL_REPEAT, x->state);
+  e->n = -1;
+  e->x = x;
+  return e;
 }
 
-static mpc_err_t *mpc_err_count(mpc_input_t *i, mpc_err_t *x, int n) {
-  mpc_err_t *y;
-  int digits = n/10 + 1;
-  char *prefix;
-  prefix = mpc_malloc(i, digits + strlen(" of ") + 1);
-  sprintf(prefix, "%i of ", n);
-  y = mpc_err_repeat(i, x, prefix);
-  mpc_free(i, prefix);
-  return y;
+static mpc_fail_t *mpc_err_count(mpc_input_t *i, mpc_fail_t *x, int n) {
+  mpc_fail_t *e;
+  if (x == NULL) { return NULL; }
+  e = mpc_err_node(i, MPC_FAIL_REPEAT, x->state);
+  e->n = n;
+  e->x = x;
+  return e;
 }
 
-static mpc_err_t *mpc_err_merge(mpc_input_t *i, mpc_err_t *x, mpc_err_t *y) {
-  mpc_err_t *errs[2];
-  errs[0] = x;
-  errs[1] = y;
-  return mpc_err_or(i, errs, 2);
+static mpc_fail_t *mpc_err_merge(mpc_input_t *i, mpc_fail_t *x, mpc_fail_t *y) {
+  mpc_fail_t *e;
+  if (x == NULL) { return y; }
+  if (y == NULL) { return x; }
+  if (x->state.pos > y->state.pos) { mpc_err_delete_internal(i, y); return x; }
+  if (y->state.pos > x->state.pos) { mpc_err_delete_internal(i, x); return y; }
+  e = mpc_err_node(i, MPC_FAIL_OR, x->state);
+  e->x = x;
+  e->y = y;
+  return e;
 }
 
 /*
@@ -882,7 +1598,9 @@ enum {
   MPC_TYPE_COUNT     = 22,
   
   MPC_TYPE_OR        = 23,
-  MPC_TYPE_AND       = 24
+  MPC_TYPE_AND       = 24,
+  
+  MPC_TYPE_SCAN      = 25
 };
 
 typedef struct { char *m; } mpc_pdata_fail_t;
@@ -897,9 +1615,10 @@ typedef struct { mpc_parser_t *x; mpc_apply_t f; } mpc_pdata_apply_t;
 typedef struct { mpc_parser_t *x; mpc_apply_to_t f; void *d; } mpc_pdata_apply_to_t;
 typedef struct { mpc_parser_t *x; } mpc_pdata_predict_t;
 typedef struct { mpc_parser_t *x; mpc_dtor_t dx; mpc_ctor_t lf; } mpc_pdata_not_t;
-typedef struct { int n; mpc_fold_t f; mpc_parser_t *x; mpc_dtor_t dx; } mpc_pdata_repeat_t;
-typedef struct { int n; mpc_parser_t **xs; } mpc_pdata_or_t;
-typedef struct { int n; mpc_fold_t f; mpc_parser_t **xs; mpc_dtor_t *dxs;  } mpc_pdata_and_t;
+typedef struct { int n; mpc_fold_t f; mpc_parser_t *x; mpc_dtor_t dx; unsigned char *charset; } mpc_pdata_repeat_t;
+typedef struct { int n; mpc_parser_t **xs; unsigned char *charset; } mpc_pdata_or_t;
+typedef struct { int n; mpc_fold_t f; mpc_parser_t **xs; mpc_dtor_t *dxs; char *lit; } mpc_pdata_and_t;
+typedef struct { mpc_scan_t f; const char *t; mpc_parser_t *x; } mpc_pdata_scan_t;
 
 typedef union {
   mpc_pdata_fail_t fail;
@@ -917,15 +1636,42 @@ typedef union {
   mpc_pdata_repeat_t repeat;
   mpc_pdata_and_t and;
   mpc_pdata_or_t or;
+  mpc_pdata_scan_t scan;
 } mpc_pdata_t;
 
+/*
+** Grammar analysis leaves behind for every
+** parser it reaches the set of bytes the parser
+** can start with, whether it can succeed without
+** consuming anything and, for `or`, a table from
+** the next byte to the first alternative worth
+** trying. Byte zero doubles as end of input.
+** Redefining an analysed parser moves on the
+** generation, which retires all of the tables.
+*/
+
+typedef struct {
+  unsigned char first[32];
+  unsigned char follow[32];
+  char nullable;
+  unsigned long pass;
+  unsigned long generation;
+  unsigned char *dispatch;
+} mpc_first_t;
+
+static unsigned long mpc_generation = 1;
+
 struct mpc_parser_t {
   char retained;
   char *name;
   char type;
   mpc_pdata_t data;
+  mpc_first_t *first;
+  mpc_profile_t *profile;
 };
 
+static int mpc_analyse(mpc_parser_t **ps, int n);
+
 static mpc_val_t *mpcf_input_nth_free(mpc_input_t *i, int n, mpc_val_t **xs, int x) {
   int j;
   for (j = 0; j < n; j++) { if (j != x) { mpc_free(i, xs[j]); } }
@@ -936,9 +1682,31 @@ static mpc_val_t *mpcf_input_fst_free(mpc_input_t *i, int n, mpc_val_t **xs) { r
 static mpc_val_t *mpcf_input_snd_free(mpc_input_t *i, int n, mpc_val_t **xs) { return mpcf_input_nth_free(i, n, xs, 1); }
 static mpc_val_t *mpcf_input_trd_free(mpc_input_t *i, int n, mpc_val_t **xs) { return mpcf_input_nth_free(i, n, xs, 2); }
 
+static mpc_val_t *mpcf_input_slicefold(mpc_input_t *i, int n, mpc_val_t **xs) {
+  
+  int j;
+  long end;
+  mpc_slice_t *s, *t;
+  
+  if (n == 0) { return mpc_slice_new(i, i->state.pos, 0); }
+  
+  /* Parts are consecutive in the input so the result spans all of them */
+  s = xs[0];
+  end = s->pos + s->len;
+  for (j = 1; j < n; j++) {
+    t = xs[j];
+    if (s->len == 0 && t->len != 0) { s->pos = t->pos; }
+    if (t->pos + t->len > end) { end = t->pos + t->len; }
+    mpc_free(i, t);
+  }
+  s->len = end - s->pos;
+  return s;
+}
+
 static mpc_val_t *mpcf_input_strfold(mpc_input_t *i, int n, mpc_val_t **xs) {
   int j;
   size_t l = 0;
+  if (i->view) { return mpcf_input_slicefold(i, n, xs); }
   if (n == 0) { return mpc_calloc(i, 1, 1); }
   for (j = 0; j < n; j++) { l += strlen(xs[j]); }
   xs[0] = mpc_realloc(i, xs[0], l + 1);
@@ -955,6 +1723,134 @@ static mpc_val_t *mpcf_input_state_ast(mpc_input_t *i, int n, mpc_val_t **xs) {
   return a;
 }
 
+/*
+** Arena ASTs
+**
+** These mirror the `mpc_ast_*` functions used
+** by the `mpca` combinators but take their
+** memory from the input's arena. Nothing here
+** frees - dropped tags and intermediate nodes
+** simply go away with the arena.
+*/
+
+static mpc_ast_t *mpc_ast_arena_new(mpc_arena_t *a, const char *tag, const char *contents) {
+  size_t tl = strlen(tag) + 1;
+  size_t cl = strlen(contents) + 1;
+  mpc_ast_t *x = mpc_arena_alloc(a, sizeof(mpc_ast_t) + tl + cl);
+  x->tag = (char*)(x + 1);
+  memcpy(x->tag, tag, tl);
+  x->contents = x->tag + tl;
+  memcpy(x->contents, contents, cl);
+  x->contents_len = cl - 1;
+  x->state = mpc_state_new();
+  x->children_num = 0;
+  x->children = NULL;
+  return x;
+}
+
+static mpc_ast_t *mpc_ast_arena_new_view(mpc_arena_t *a, const char *tag, const char *contents, long len) {
+  size_t tl = strlen(tag) + 1;
+  mpc_ast_t *x = mpc_arena_alloc(a, sizeof(mpc_ast_t) + tl);
+  x->tag = (char*)(x + 1);
+  memcpy(x->tag, tag, tl);
+  x->contents = (char*)contents;
+  x->contents_len = len;
+  x->state = mpc_state_new();
+  x->children_num = 0;
+  x->children = NULL;
+  return x;
+}
+
+static mpc_ast_t *mpc_ast_arena_add_tag(mpc_arena_t *a, mpc_ast_t *x, const char *t) {
+  size_t tl, xl;
+  char *tag;
+  if (x == NULL) { return x; }
+  tl = strlen(t);
+  xl = strlen(x->tag);
+  tag = mpc_arena_alloc(a, tl + 1 + xl + 1);
+  memcpy(tag, t, tl);
+  tag[tl] = '|';
+  memcpy(tag + tl + 1, x->tag, xl + 1);
+  x->tag = tag;
+  return x;
+}
+
+static mpc_ast_t *mpc_ast_arena_add_root_tag(mpc_arena_t *a, mpc_ast_t *x, const char *t) {
+  size_t tl, xl;
+  char *tag;
+  if (x == NULL) { return x; }
+  tl = strlen(t) - 1;
+  xl = strlen(x->tag);
+  tag = mpc_arena_alloc(a, tl + xl + 1);
+  memcpy(tag, t, tl);
+  memcpy(tag + tl, x->tag, xl + 1);
+  x->tag = tag;
+  return x;
+}
+
+static mpc_ast_t *mpc_ast_arena_tag(mpc_arena_t *a, mpc_ast_t *x, const char *t) {
+  x->tag = mpc_arena_alloc(a, strlen(t) + 1);
+  strcpy(x->tag, t);
+  return x;
+}
+
+static mpc_ast_t *mpc_ast_arena_add_root(mpc_arena_t *a, mpc_ast_t *x) {
+  mpc_ast_t *r;
+  if (x == NULL) { return x; }
+  if (x->children_num <= 1) { return x; }
+  r = mpc_ast_arena_new(a, ">", "");
+  r->children = mpc_arena_alloc(a, sizeof(mpc_ast_t*));
+  r->children[0] = x;
+  r->children_num = 1;
+  return r;
+}
+
+static mpc_val_t *mpcf_input_fold_ast(mpc_input_t *i, int n, mpc_val_t **xs) {
+
+  int j, k, total;
+  mpc_ast_t **as = (mpc_ast_t**)xs;
+  mpc_ast_t *r;
+
+  if (i->arena == NULL) { return mpcf_fold_ast(n, xs); }
+
+  if (n == 0) { return NULL; }
+  if (n == 1) { return xs[0]; }
+  if (n == 2 && xs[1] == NULL) { return xs[0]; }
+  if (n == 2 && xs[0] == NULL) { return xs[1]; }
+
+  /* Size the children array once rather than growing it per child */
+  total = 0;
+  for (j = 0; j < n; j++) {
+    if (as[j] == NULL) { continue; }
+    total += as[j]->children_num >= 2 ? as[j]->children_num : 1;
+  }
+
+  r = mpc_ast_arena_new(i->arena, ">", "");
+  r->children = total ? mpc_arena_alloc(i->arena, sizeof(mpc_ast_t*) * total) : NULL;
+
+  for (j = 0; j < n; j++) {
+
+    if (as[j] == NULL) { continue; }
+
+    if (as[j]->children_num == 0) {
+      r->children[r->children_num++] = as[j];
+    } else if (as[j]->children_num == 1) {
+      r->children[r->children_num++] = mpc_ast_arena_add_root_tag(i->arena, as[j]->children[0], as[j]->tag);
+    } else {
+      for (k = 0; k < as[j]->children_num; k++) {
+        r->children[r->children_num++] = as[j]->children[k];
+      }
+    }
+
+  }
+
+  if (r->children_num) {
+    r->state = r->children[0]->state;
+  }
+
+  return r;
+}
+
 static mpc_val_t *mpc_parse_fold(mpc_input_t *i, mpc_fold_t f, int n, mpc_val_t **xs) {
   int j;
   if (f == mpcf_null)      { return mpcf_null(n, xs); }
@@ -966,6 +1862,7 @@ static mpc_val_t *mpc_parse_fold(mpc_input_t *i, mpc_fold_t f, int n, mpc_val_t
   if (f == mpcf_trd_free)  { return mpcf_input_trd_free(i, n, xs); }
   if (f == mpcf_strfold)   { return mpcf_input_strfold(i, n, xs); }
   if (f == mpcf_state_ast) { return mpcf_input_state_ast(i, n, xs); }
+  if (f == mpcf_fold_ast)  { return mpcf_input_fold_ast(i, n, xs); }
   for (j = 0; j < n; j++) { xs[j] = mpc_export(i, xs[j]); }
   return f(j, xs);
 }
@@ -976,7 +1873,13 @@ static mpc_val_t *mpcf_input_free(mpc_input_t *i, mpc_val_t *x) {
 }
 
 static mpc_val_t *mpcf_input_str_ast(mpc_input_t *i, mpc_val_t *c) {
-  mpc_ast_t *a = mpc_ast_new("", c);
+  mpc_slice_t *s = c;
+  mpc_ast_t *a;
+  if (i->view) {
+    a = mpc_ast_arena_new_view(i->arena, "", i->string + s->pos, s->len);
+  } else {
+    a = i->arena ? mpc_ast_arena_new(i->arena, "", c) : mpc_ast_new("", c);
+  }
   mpc_free(i, c);
   return a;
 }
@@ -984,264 +1887,783 @@ static mpc_val_t *mpcf_input_str_ast(mpc_input_t *i, mpc_val_t *c) {
 static mpc_val_t *mpc_parse_apply(mpc_input_t *i, mpc_apply_t f, mpc_val_t *x) {
   if (f == mpcf_free)     { return mpcf_input_free(i, x); }
   if (f == mpcf_str_ast)  { return mpcf_input_str_ast(i, x); }
+  if (i->arena && f == (mpc_apply_t)mpc_ast_add_root) { return mpc_ast_arena_add_root(i->arena, x); }
   return f(mpc_export(i, x));
 }
 
 static mpc_val_t *mpc_parse_apply_to(mpc_input_t *i, mpc_apply_to_t f, mpc_val_t *x, mpc_val_t *d) {
+  if (i->arena && f == (mpc_apply_to_t)mpc_ast_tag)     { return mpc_ast_arena_tag(i->arena, x, d); }
+  if (i->arena && f == (mpc_apply_to_t)mpc_ast_add_tag) { return mpc_ast_arena_add_tag(i->arena, x, d); }
   return f(mpc_export(i, x), d);
 }
 
+static mpc_val_t *mpc_parse_lift(mpc_input_t *i, mpc_ctor_t lf) {
+  if (i->view && lf == mpcf_ctor_str) { return mpc_slice_new(i, i->state.pos, 0); }
+  return lf();
+}
+
 static void mpc_parse_dtor(mpc_input_t *i, mpc_dtor_t d, mpc_val_t *x) {
   if (d == free) { mpc_free(i, x); return; }
+  if (i->arena && d == (mpc_dtor_t)mpc_ast_delete) { return; }
   d(mpc_export(i, x));
 }
 
-enum {
-  MPC_PARSE_STACK_MIN = 4
-};
+static int mpc_set_has(const unsigned char *s, int c) {
+  return (s[c >> 3] >> (c & 7)) & 1;
+}
 
-#define MPC_SUCCESS(x) r->output = x; return 1
-#define MPC_FAILURE(x) r->error = x; return 0
-#define MPC_PRIMITIVE(x) \
-  if (x) { MPC_SUCCESS(r->output); } \
-  else { MPC_FAILURE(NULL); }
+static unsigned char *mpc_or_dispatch(mpc_parser_t *p) {
+  if (p->first == NULL || p->first->generation != mpc_generation) { return NULL; }
+  return p->first->dispatch;
+}
+
+static int mpc_first_viable(mpc_parser_t *p, int c) {
+  return p->first->nullable || mpc_set_has(p->first->first, c);
+}
+
+static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_presult_t *r, mpc_fail_t **e);
+
+/*
+** With backtracking disabled a parser which fails
+** after consuming input cannot be undone, so the
+** `or`, `maybe` and `many` around it must fail too
+** rather than carry on from the wrong position.
+*/
+
+static int mpc_input_committed(mpc_input_t *i, long pos) {
+  return i->backtrack < 1 && i->state.pos != pos;
+}
+
+static mpc_fail_t *mpc_parse_abandon(mpc_input_t *i, mpc_fold_t f, int n, mpc_presult_t *results) {
+  mpc_fail_t *err = results[n].error;
+  mpc_val_t *x = mpc_parse_fold(i, f, n, (mpc_val_t**)results);
+  if (f == mpcf_fold_ast) { mpc_parse_dtor(i, (mpc_dtor_t)mpc_ast_delete, x); }
+  if (f == mpcf_strfold)  { mpc_parse_dtor(i, free, x); }
+  return err;
+}
+
+/*
+** Frames and results are addressed by index since
+** either stack may move when it grows. A frame
+** merges errors into the frame numbered `ef`, or
+** into the caller's error when that is negative.
+*/
 
-static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_err_t **e) {
+static int mpc_stack_reserve(mpc_input_t *i, int n) {
   
-  int j = 0, k = 0;
-  mpc_result_t results_stk[MPC_PARSE_STACK_MIN];
-  mpc_result_t *results;
-  int results_slots = MPC_PARSE_STACK_MIN;
+  int base = i->results_num;
   
-  switch (p->type) {
-      
-    /* Basic Parsers */
+  i->results_num += n;
+  
+  if (i->results_num > i->results_slots) {
+    i->results_slots = i->results_num > MPC_PARSE_RESULTS_MIN
+      ? i->results_num + i->results_num / 2
+      : MPC_PARSE_RESULTS_MIN;
+    i->results = realloc(i->results, sizeof(mpc_presult_t) * i->results_slots);
+  }
+  
+  return base;
+}
 
-    case MPC_TYPE_ANY:     MPC_PRIMITIVE(mpc_input_any(i, (char**)&r->output));
-    case MPC_TYPE_SINGLE:  MPC_PRIMITIVE(mpc_input_char(i, p->data.single.x, (char**)&r->output));
-    case MPC_TYPE_RANGE:   MPC_PRIMITIVE(mpc_input_range(i, p->data.range.x, p->data.range.y, (char**)&r->output));
-    case MPC_TYPE_ONEOF:   MPC_PRIMITIVE(mpc_input_oneof(i, p->data.string.x, (char**)&r->output));
-    case MPC_TYPE_NONEOF:  MPC_PRIMITIVE(mpc_input_noneof(i, p->data.string.x, (char**)&r->output));
-    case MPC_TYPE_SATISFY: MPC_PRIMITIVE(mpc_input_satisfy(i, p->data.satisfy.f, (char**)&r->output));
-    case MPC_TYPE_STRING:  MPC_PRIMITIVE(mpc_input_string(i, p->data.string.x, (char**)&r->output));
-    case MPC_TYPE_ANCHOR:  MPC_PRIMITIVE(mpc_input_anchor(i, p->data.anchor.f, (char**)&r->output));
-    
-    /* Other parsers */
-    
-    case MPC_TYPE_UNDEFINED: MPC_FAILURE(mpc_err_fail(i, "Parser Undefined!"));
-    case MPC_TYPE_PASS:      MPC_SUCCESS(NULL);
-    case MPC_TYPE_FAIL:      MPC_FAILURE(mpc_err_fail(i, p->data.fail.m));
-    case MPC_TYPE_LIFT:      MPC_SUCCESS(p->data.lift.lf());
-    case MPC_TYPE_LIFT_VAL:  MPC_SUCCESS(p->data.lift.x);
-    case MPC_TYPE_STATE:     MPC_SUCCESS(mpc_input_state_copy(i));
-    
-    /* Application Parsers */
-    
-    case MPC_TYPE_APPLY:
-      if (mpc_parse_run(i, p->data.apply.x, r, e)) {
-        MPC_SUCCESS(mpc_parse_apply(i, p->data.apply.f, r->output));
-      } else {
-        MPC_FAILURE(r->output);
-      }
-    
-    case MPC_TYPE_APPLY_TO:
-      if (mpc_parse_run(i, p->data.apply_to.x, r, e)) {
-        MPC_SUCCESS(mpc_parse_apply_to(i, p->data.apply_to.f, r->output, p->data.apply_to.d));
-      } else {
-        MPC_FAILURE(r->error);
-      }
-    
-    case MPC_TYPE_EXPECT:
-      mpc_input_suppress_enable(i);
-      if (mpc_parse_run(i, p->data.expect.x, r, e)) {
-        mpc_input_suppress_disable(i);
-        MPC_SUCCESS(r->output);
-      } else {
-        mpc_input_suppress_disable(i);
-        MPC_FAILURE(mpc_err_new(i, p->data.expect.m));
+static void mpc_stack_push(mpc_input_t *i, mpc_parser_t *p, int r, int ef) {
+  
+  mpc_frame_t *f;
+  
+  if (i->frames_num == i->frames_slots) {
+    i->frames_slots = i->frames_slots ? i->frames_slots * 2 : MPC_PARSE_FRAMES_MIN;
+    i->frames = realloc(i->frames, sizeof(mpc_frame_t) * i->frames_slots);
+  }
+  
+  f = &i->frames[i->frames_num++];
+  f->p = p;
+  f->r = r;
+  f->base = i->results_num;
+  f->ef = ef;
+  f->j = 0;
+  f->dispatch = NULL;
+  f->sub = NULL;
+}
+
+static mpc_fail_t **mpc_stack_err(mpc_input_t *i, mpc_fail_t **e, int ef) {
+  return ef < 0 ? e : &i->frames[ef].sub;
+}
+
+/*
+** Profiling
+**
+** A named parser starting at frame depth `d` has
+** finished when the parse next resumes at `d`, so
+** the records on the input unwind in step with the
+** frames. Time and rewinds go to the innermost named
+** parser only, total time only to the outermost of
+** a parser's recursive calls.
+*/
+
+static int mpc_profiling = 0;
+static mpc_profile_t *mpc_profiles = NULL;
+
+static double mpc_profile_clock(void) {
+#ifdef CLOCK_MONOTONIC
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static void mpc_profile_enter(mpc_input_t *i, mpc_parser_t *p) {
+  
+  mpc_profile_frame_t *t;
+  
+  if (p->profile == NULL) {
+    p->profile = calloc(1, sizeof(mpc_profile_t));
+    p->profile->p = p;
+    p->profile->name = malloc(strlen(p->name) + 1);
+    strcpy(p->profile->name, p->name);
+    p->profile->next = mpc_profiles;
+    mpc_profiles = p->profile;
+  }
+  
+  if (i->profs_num == i->profs_slots) {
+    i->profs_slots = i->profs_slots ? i->profs_slots * 2 : MPC_PARSE_FRAMES_MIN;
+    i->profs = realloc(i->profs, sizeof(mpc_profile_frame_t) * i->profs_slots);
+  }
+  
+  t = &i->profs[i->profs_num++];
+  t->x = p->profile;
+  t->depth = i->frames_num;
+  t->pos = i->state.pos;
+  t->inner = 0;
+  t->rewinds = i->rewinds;
+  t->inner_rewinds = 0;
+  t->x->active++;
+  t->start = mpc_profile_clock();
+}
+
+static void mpc_profile_leave(mpc_input_t *i, int ok) {
+  
+  mpc_profile_frame_t *t = &i->profs[--i->profs_num];
+  mpc_profile_t *x = t->x;
+  double elapsed = mpc_profile_clock() - t->start;
+  unsigned long rewinds = i->rewinds - t->rewinds;
+  
+  x->calls++;
+  if (ok) {
+    x->successes++;
+    x->bytes += (unsigned long)(i->state.pos - t->pos);
+  } else {
+    x->failures++;
+  }
+  x->rewinds += rewinds - t->inner_rewinds;
+  x->self += elapsed - t->inner;
+  if (--x->active == 0) { x->total += elapsed; }
+  
+  if (i->profs_num) {
+    i->profs[i->profs_num-1].inner += elapsed;
+    i->profs[i->profs_num-1].inner_rewinds += rewinds;
+  }
+}
+
+/*
+** Merges the errors of the first `n` alternatives
+** of the dispatched `or` in frame `k` in order.
+** Alternatives which were skipped are only run
+** for their errors when those could still end up
+** in the message.
+**
+** An alternative outside the FIRST set of the next
+** byte should not be able to match it. Should one
+** match anyway the `or` falls back to the order it
+** was written in: the match stays in its result
+** slot with its input consumed and its index is
+** returned, for the caller to succeed with. When
+** every alternative was run -1 is returned.
+*/
+
+static int mpc_parse_or_errors(mpc_input_t *i, mpc_fail_t **e, int k, int n, int replay) {
+  
+  int j;
+  mpc_parser_t *p = i->frames[k].p;
+  int c = i->frames[k].c;
+  int base = i->frames[k].base;
+  int ef = i->frames[k].ef;
+  mpc_presult_t x;
+  mpc_fail_t *sub, **acc;
+  
+  for (j = 0; j < n; j++) {
+    if (mpc_first_viable(p->data.or.xs[j], c)) {
+      acc = mpc_stack_err(i, e, ef);
+      *acc = mpc_err_merge(i, *acc, i->results[base+j].error);
+    } else if (replay && !i->suppress) {
+      sub = NULL;
+      if (mpc_parse_run(i, p->data.or.xs[j], &x, &sub)) {
+        acc = mpc_stack_err(i, e, ef);
+        *acc = mpc_err_merge(i, *acc, sub);
+        i->results[base+j].output = x.output;
+        return j;
       }
-    
+      acc = mpc_stack_err(i, e, ef);
+      *acc = mpc_err_merge(i, *acc, sub);
+      *acc = mpc_err_merge(i, *acc, x.error);
+    }
+  }
+  
+  return -1;
+  
+}
+
+/*
+** Parsers fused by `mpc_optimise` still hold the
+** parsers they stand in for, and fail with the
+** errors those would have given at the same spot.
+** Byte classes are an `expect` chain around a
+** single byte parser, whose outermost message is
+** the only one not suppressed, or an `or` of them,
+** which adds its alternatives' errors to `acc` as
+** it goes.
+*/
+
+static mpc_fail_t *mpc_err_class(mpc_input_t *i, mpc_parser_t *p, mpc_fail_t **acc) {
+  
+  int j;
+  mpc_fail_t *x;
+  
+  if (p->type == MPC_TYPE_EXPECT) { return mpc_err_new(i, p->data.expect.m); }
+  
+  if (p->type == MPC_TYPE_OR) {
+    for (j = 0; j < p->data.or.n; j++) {
+      x = mpc_err_class(i, p->data.or.xs[j], acc);
+      *acc = mpc_err_merge(i, *acc, x);
+    }
+  }
+  
+  return NULL;
+}
+
+static int mpc_parse_literal(mpc_input_t *i, mpc_parser_t *p, mpc_val_t **o, mpc_fail_t **e) {
+  
+  int j;
+  long n = (long)strlen(p->data.and.lit);
+  mpc_parser_t *q;
+  
+  mpc_input_mark(i);
+  
+  for (j = 0; j < p->data.and.n; j++) {
+    q = p->data.and.xs[j];
+    while (q->type == MPC_TYPE_EXPECT) { q = q->data.expect.x; }
+    if (q->type == MPC_TYPE_SINGLE
+      ? !mpc_input_char(i, q->data.single.x, NULL)
+      : !mpc_input_literal(i, q->data.string.x)) {
+      *e = mpc_err_class(i, p->data.and.xs[j], NULL);
+      mpc_input_rewind(i);
+      return 0;
+    }
+  }
+  
+  mpc_input_unmark(i);
+  
+  if (i->view) {
+    *o = mpc_slice_new(i, i->state.pos - n, n);
+    return 1;
+  }
+  
+  *o = mpc_malloc(i, n + 1);
+  strcpy(*o, p->data.and.lit);
+  return 1;
+}
+
+/*
+** A scanner's function reads the string in place.
+** Its token comes out as `x` would build it: the text,
+** or a slice on a view, made into a tagged AST which
+** gets the state it started at. What `x` would have
+** merged into the errors is left out, so scanners are
+** only used on the first pass of `mpc_parse_input`.
+*/
+
+static int mpc_input_scan(mpc_input_t *i, mpc_parser_t *p, mpc_val_t **o) {
+  
+  long start = i->state.pos, len, n, j;
+  mpc_val_t *xs[2], *v;
+  char c;
+  
+  n = p->data.scan.f(i->string + start, i->length - start, &len);
+  if (n < 0) { return 0; }
+  
+  xs[0] = mpc_input_state_copy(i);
+  
+  for (j = 0; j < n; j++) {
+    c = i->string[i->state.pos];
+    i->last = c;
+    i->state.pos++;
+    i->state.col++;
+    if (c == '\n') {
+      i->state.col = 0;
+      i->state.row++;
+    }
+  }
+  
+  if (i->view) {
+    v = mpc_slice_new(i, start, len);
+  } else {
+    v = mpc_malloc(i, len + 1);
+    memcpy(v, i->string + start, len);
+    ((char*)v)[len] = '\0';
+  }
+  
+  v = mpc_parse_apply(i, mpcf_str_ast, v);
+  xs[1] = mpc_parse_apply_to(i, (mpc_apply_to_t)mpc_ast_tag, v, (void*)p->data.scan.t);
+  *o = mpc_parse_fold(i, mpcf_state_ast, 2, xs);
+  return 1;
+}
+
+/*
+** Parsers which never run a child are evaluated
+** straight into the slot they were called with.
+** The rest get a frame, a label to start from and
+** one to resume at once a child has finished, with
+** `ok` and the child's slot saying how it went.
+** Under GCC and Clang these are reached through
+** tables of label addresses, otherwise through a
+** `switch`.
+*/
+
+#if defined(__GNUC__) && !defined(MPC_NO_COMPUTED_GOTO)
+#define MPC_COMPUTED_GOTO
+#endif
+
+#define MPC_RESULT(k) (i->results[(k)])
+#define MPC_CALL(x, s, ef) q = x; qs = s; qe = ef; goto enter
+#define MPC_SUCCESS(x) MPC_RESULT(f->r).output = x; ok = 1; goto ret
+#define MPC_FAILURE(x) MPC_RESULT(f->r).error = x; ok = 0; goto ret
+#define MPC_LEAF_SUCCESS(x) MPC_RESULT(qs).output = x; ok = 1; goto resume
+#define MPC_LEAF_FAILURE(x) MPC_RESULT(qs).error = x; ok = 0; goto resume
+#define MPC_PRIMITIVE(x) \
+  ok = (x); \
+  if (!ok) { MPC_RESULT(qs).error = NULL; } \
+  goto resume
+
+static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_presult_t *r, mpc_fail_t **e) {
+  
+  int j, k, ok = 0, qs, qe;
+  int bottom = i->frames_num;
+  int profiling = mpc_profiling;
+  int slot = mpc_stack_reserve(i, 1);
+  mpc_parser_t *q;
+  mpc_frame_t *f = NULL;
+  mpc_fail_t **acc, *err;
+  mpc_val_t *v;
+  
+#ifdef MPC_COMPUTED_GOTO
+  static void *enters[] = {
+    &&leaf_undefined, &&leaf_pass,    &&leaf_fail,     &&leaf_lift,
+    &&leaf_lift_val,  &&push,         &&leaf_anchor,   &&leaf_state,
+    &&leaf_any,       &&leaf_single,  &&leaf_oneof,    &&leaf_noneof,
+    &&leaf_range,     &&leaf_satisfy, &&leaf_string,   &&push,
+    &&push,           &&push,         &&push,          &&push,
+    &&push,           &&push,         &&push,          &&push,
+    &&push,           &&leaf_scan
+  };
+  static void *calls[] = {
+    NULL,             NULL,           NULL,            NULL,
+    NULL,             &&call_expect,  NULL,            NULL,
+    NULL,             NULL,           NULL,            NULL,
+    NULL,             NULL,           NULL,            &&call_apply,
+    &&call_apply_to,  &&call_predict, &&call_not,      &&call_maybe,
+    &&call_many,      &&call_many,    &&call_count,    &&call_or,
+    &&call_and,       NULL
+  };
+  static void *resumes[] = {
+    NULL,             NULL,           NULL,            NULL,
+    NULL,             &&resume_expect, NULL,           NULL,
+    NULL,             NULL,           NULL,            NULL,
+    NULL,             NULL,           NULL,            &&resume_apply,
+    &&resume_apply_to, &&resume_predict, &&resume_not, &&resume_maybe,
+    &&resume_many,    &&resume_many,  &&resume_count,  &&resume_or,
+    &&resume_and,     NULL
+  };
+#endif
+  
+  q = p; qs = slot; qe = -1;
+  
+  enter:
+  
+  if (profiling && q->retained) { mpc_profile_enter(i, q); }
+  
+#ifdef MPC_COMPUTED_GOTO
+  if ((unsigned char)q->type > MPC_TYPE_SCAN) { goto leaf_unknown; }
+  goto *enters[(unsigned char)q->type];
+#else
+  switch (q->type) {
+    case MPC_TYPE_UNDEFINED: goto leaf_undefined;
+    case MPC_TYPE_PASS:      goto leaf_pass;
+    case MPC_TYPE_FAIL:      goto leaf_fail;
+    case MPC_TYPE_LIFT:      goto leaf_lift;
+    case MPC_TYPE_LIFT_VAL:  goto leaf_lift_val;
+    case MPC_TYPE_ANCHOR:    goto leaf_anchor;
+    case MPC_TYPE_STATE:     goto leaf_state;
+    case MPC_TYPE_ANY:       goto leaf_any;
+    case MPC_TYPE_SINGLE:    goto leaf_single;
+    case MPC_TYPE_ONEOF:     goto leaf_oneof;
+    case MPC_TYPE_NONEOF:    goto leaf_noneof;
+    case MPC_TYPE_RANGE:     goto leaf_range;
+    case MPC_TYPE_SATISFY:   goto leaf_satisfy;
+    case MPC_TYPE_STRING:    goto leaf_string;
+    case MPC_TYPE_SCAN:      goto leaf_scan;
+    case MPC_TYPE_EXPECT:
+    case MPC_TYPE_APPLY:
+    case MPC_TYPE_APPLY_TO:
     case MPC_TYPE_PREDICT:
-      mpc_input_backtrack_disable(i);
-      if (mpc_parse_run(i, p->data.predict.x, r, e)) {      
-        mpc_input_backtrack_enable(i);
-        MPC_SUCCESS(r->output);
-      } else {
-        mpc_input_backtrack_enable(i);
-        MPC_FAILURE(r->error);
-      }
-    
-    /* Optional Parsers */
-    
-    /* TODO: Update Not Error Message */
-    
     case MPC_TYPE_NOT:
-      mpc_input_mark(i);
-      mpc_input_suppress_enable(i);
-      if (mpc_parse_run(i, p->data.not.x, r, e)) {
-        mpc_input_rewind(i);
-        mpc_input_suppress_disable(i);
-        mpc_parse_dtor(i, p->data.not.dx, r->output);
-        MPC_FAILURE(mpc_err_new(i, "opposite"));
-      } else {
-        mpc_input_unmark(i);
-        mpc_input_suppress_disable(i);
-        MPC_SUCCESS(p->data.not.lf());
-      }
-    
     case MPC_TYPE_MAYBE:
-      if (mpc_parse_run(i, p->data.not.x, r, e)) {
-        MPC_SUCCESS(r->output);
-      } else {
-        *e = mpc_err_merge(i, *e, r->error);
-        MPC_SUCCESS(p->data.not.lf());
-      }
-    
-    /* Repeat Parsers */
-    
     case MPC_TYPE_MANY:
-      
-      results = results_stk;
-      
-      while (mpc_parse_run(i, p->data.repeat.x, &results[j], e)) {
-        j++;
-        if (j == MPC_PARSE_STACK_MIN) {
-          results_slots = j + j / 2;
-          results = mpc_malloc(i, sizeof(mpc_result_t) * results_slots);
-          memcpy(results, results_stk, sizeof(mpc_result_t) * MPC_PARSE_STACK_MIN);
-        } else if (j >= results_slots) {
-          results_slots = j + j / 2;
-          results = mpc_realloc(i, results, sizeof(mpc_result_t) * results_slots);
-        }
-      }
-      
-      *e = mpc_err_merge(i, *e, results[j].error);
-      MPC_SUCCESS(
-        mpc_parse_fold(i, p->data.repeat.f, j, (mpc_val_t**)results);
-        if (j >= MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
-    
     case MPC_TYPE_MANY1:
-      
-      results = results_stk;
-      
-      while (mpc_parse_run(i, p->data.repeat.x, &results[j], e)) {
-        j++;
-        if (j == MPC_PARSE_STACK_MIN) {
-          results_slots = j + j / 2;
-          results = mpc_malloc(i, sizeof(mpc_result_t) * results_slots);
-          memcpy(results, results_stk, sizeof(mpc_result_t) * MPC_PARSE_STACK_MIN);
-        } else if (j >= results_slots) {
-          results_slots = j + j / 2;
-          results = mpc_realloc(i, results, sizeof(mpc_result_t) * results_slots);
-        }
-      }
-      
-      if (j == 0) {
-        MPC_FAILURE(
-          mpc_err_many1(i, results[j].error);
-          if (j >= MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
-      } else {
-        *e = mpc_err_merge(i, *e, results[j].error);
-        MPC_SUCCESS(
-          mpc_parse_fold(i, p->data.repeat.f, j, (mpc_val_t**)results);
-          if (j >= MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
-      }
-    
     case MPC_TYPE_COUNT:
-      
-      results = p->data.repeat.n > MPC_PARSE_STACK_MIN
-        ? mpc_malloc(i, sizeof(mpc_result_t) * p->data.repeat.n)
-        : results_stk;
-      
-      while (mpc_parse_run(i, p->data.repeat.x, &results[j], e)) {
-        j++;
-        if (j == p->data.repeat.n) { break; }
+    case MPC_TYPE_OR:
+    case MPC_TYPE_AND:       goto push;
+    default:                 goto leaf_unknown;
+  }
+#endif
+  
+  push:
+  
+  mpc_stack_push(i, q, qs, qe);
+  f = &i->frames[i->frames_num-1];
+  p = q;
+  
+#ifdef MPC_COMPUTED_GOTO
+  goto *calls[(unsigned char)p->type];
+#else
+  switch (p->type) {
+    case MPC_TYPE_EXPECT:    goto call_expect;
+    case MPC_TYPE_APPLY:     goto call_apply;
+    case MPC_TYPE_APPLY_TO:  goto call_apply_to;
+    case MPC_TYPE_PREDICT:   goto call_predict;
+    case MPC_TYPE_NOT:       goto call_not;
+    case MPC_TYPE_MAYBE:     goto call_maybe;
+    case MPC_TYPE_MANY:      goto call_many;
+    case MPC_TYPE_MANY1:     goto call_many;
+    case MPC_TYPE_COUNT:     goto call_count;
+    case MPC_TYPE_OR:        goto call_or;
+    default:                 goto call_and;
+  }
+#endif
+  
+  ret:
+  
+  i->results_num = f->base;
+  i->frames_num--;
+  
+  resume:
+  
+  if (profiling && i->profs_num
+  &&  i->profs[i->profs_num-1].depth == i->frames_num) {
+    mpc_profile_leave(i, ok);
+  }
+  
+  if (i->frames_num == bottom) {
+    *r = i->results[slot];
+    i->results_num = slot;
+    return ok;
+  }
+  
+  f = &i->frames[i->frames_num-1];
+  p = f->p;
+  
+#ifdef MPC_COMPUTED_GOTO
+  goto *resumes[(unsigned char)p->type];
+#else
+  switch (p->type) {
+    case MPC_TYPE_EXPECT:    goto resume_expect;
+    case MPC_TYPE_APPLY:     goto resume_apply;
+    case MPC_TYPE_APPLY_TO:  goto resume_apply_to;
+    case MPC_TYPE_PREDICT:   goto resume_predict;
+    case MPC_TYPE_NOT:       goto resume_not;
+    case MPC_TYPE_MAYBE:     goto resume_maybe;
+    case MPC_TYPE_MANY:      goto resume_many;
+    case MPC_TYPE_MANY1:     goto resume_many;
+    case MPC_TYPE_COUNT:     goto resume_count;
+    case MPC_TYPE_OR:        goto resume_or;
+    default:                 goto resume_and;
+  }
+#endif
+  
+  /* Basic Parsers */
+  
+  leaf_any:     MPC_PRIMITIVE(mpc_input_any(i, (char**)&MPC_RESULT(qs).output));
+  leaf_single:  MPC_PRIMITIVE(mpc_input_char(i, q->data.single.x, (char**)&MPC_RESULT(qs).output));
+  leaf_range:   MPC_PRIMITIVE(mpc_input_range(i, q->data.range.x, q->data.range.y, (char**)&MPC_RESULT(qs).output));
+  leaf_oneof:   MPC_PRIMITIVE(mpc_input_oneof(i, q->data.string.x, (char**)&MPC_RESULT(qs).output));
+  leaf_noneof:  MPC_PRIMITIVE(mpc_input_noneof(i, q->data.string.x, (char**)&MPC_RESULT(qs).output));
+  leaf_satisfy: MPC_PRIMITIVE(mpc_input_satisfy(i, q->data.satisfy.f, (char**)&MPC_RESULT(qs).output));
+  leaf_string:  MPC_PRIMITIVE(mpc_input_string(i, q->data.string.x, (char**)&MPC_RESULT(qs).output));
+  leaf_anchor:  MPC_PRIMITIVE(mpc_input_anchor(i, q->data.anchor.f, (char**)&MPC_RESULT(qs).output));
+  
+  /* Other parsers */
+  
+  leaf_undefined: MPC_LEAF_FAILURE(mpc_err_fail(i, "Parser Undefined!"));
+  leaf_pass:      MPC_LEAF_SUCCESS(NULL);
+  leaf_fail:      MPC_LEAF_FAILURE(mpc_err_fail(i, q->data.fail.m));
+  leaf_lift:      MPC_LEAF_SUCCESS(mpc_parse_lift(i, q->data.lift.lf));
+  leaf_lift_val:  MPC_LEAF_SUCCESS(q->data.lift.x);
+  leaf_state:     MPC_LEAF_SUCCESS(mpc_input_state_copy(i));
+  leaf_unknown:   MPC_LEAF_FAILURE(mpc_err_fail(i, "Unknown Parser Type Id!"));
+  
+  /* A scanner which cannot be used, or fails, stands aside for its parser */
+  leaf_scan:
+    if (i->scan && i->type == MPC_INPUT_STRING
+    &&  mpc_input_scan(i, q, &MPC_RESULT(qs).output)) { ok = 1; goto resume; }
+    MPC_CALL(q->data.scan.x, qs, qe);
+  
+  /* Application Parsers */
+  
+  call_apply:
+    MPC_CALL(p->data.apply.x, f->r, f->ef);
+  
+  resume_apply:
+    if (ok) { MPC_SUCCESS(mpc_parse_apply(i, p->data.apply.f, MPC_RESULT(f->r).output)); }
+    goto ret;
+  
+  call_apply_to:
+    MPC_CALL(p->data.apply_to.x, f->r, f->ef);
+  
+  resume_apply_to:
+    if (ok) { MPC_SUCCESS(mpc_parse_apply_to(i, p->data.apply_to.f, MPC_RESULT(f->r).output, p->data.apply_to.d)); }
+    goto ret;
+  
+  call_expect:
+    mpc_input_suppress_enable(i);
+    MPC_CALL(p->data.expect.x, f->r, f->ef);
+  
+  resume_expect:
+    mpc_input_suppress_disable(i);
+    if (ok) { goto ret; }
+    MPC_FAILURE(mpc_err_new(i, p->data.expect.m));
+  
+  call_predict:
+    mpc_input_backtrack_disable(i);
+    MPC_CALL(p->data.predict.x, f->r, f->ef);
+  
+  resume_predict:
+    mpc_input_backtrack_enable(i);
+    goto ret;
+  
+  /* Optional Parsers */
+  
+  /* TODO: Update Not Error Message */
+  
+  call_not:
+    mpc_input_mark(i);
+    mpc_input_suppress_enable(i);
+    MPC_CALL(p->data.not.x, f->r, f->ef);
+  
+  resume_not:
+    if (ok) {
+      mpc_input_rewind(i);
+      mpc_input_suppress_disable(i);
+      mpc_parse_dtor(i, p->data.not.dx, MPC_RESULT(f->r).output);
+      MPC_FAILURE(mpc_err_new(i, "opposite"));
+    }
+    mpc_input_unmark(i);
+    mpc_input_suppress_disable(i);
+    MPC_SUCCESS(mpc_parse_lift(i, p->data.not.lf));
+  
+  call_maybe:
+    f->pos = i->state.pos;
+    MPC_CALL(p->data.not.x, f->r, f->ef);
+  
+  resume_maybe:
+    if (ok) { goto ret; }
+    acc = mpc_stack_err(i, e, f->ef);
+    *acc = mpc_err_merge(i, *acc, MPC_RESULT(f->r).error);
+    if (mpc_input_committed(i, f->pos)) { MPC_FAILURE(NULL); }
+    MPC_SUCCESS(mpc_parse_lift(i, p->data.not.lf));
+  
+  /* Repeat Parsers */
+  
+  call_many:
+    if (p->data.repeat.charset) {
+      acc = mpc_stack_err(i, e, f->ef);
+      if (mpc_input_span(i, p->data.repeat.charset, p->type == MPC_TYPE_MANY1, (char**)&v)) {
+        err = mpc_err_class(i, p->data.repeat.x, acc);
+        *acc = mpc_err_merge(i, *acc, err);
+        MPC_SUCCESS(v);
       }
-      
-      if (j == p->data.repeat.n) {
-        MPC_SUCCESS(
-          mpc_parse_fold(i, p->data.repeat.f, j, (mpc_val_t**)results);
-          if (p->data.repeat.n > MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
-      } else {
-        for (k = 0; k < j; k++) {
-          mpc_parse_dtor(i, p->data.repeat.dx, results[k].output);
-        }
-        MPC_FAILURE(
-          mpc_err_count(i, results[j].error, p->data.repeat.n);
-          if (p->data.repeat.n > MPC_PARSE_STACK_MIN) { mpc_free(i, results); });  
+      MPC_FAILURE(mpc_err_many1(i, mpc_err_class(i, p->data.repeat.x, acc)));
+    }
+    f->pos = i->state.pos;
+    MPC_CALL(p->data.repeat.x, mpc_stack_reserve(i, 1), f->ef);
+  
+  resume_many:
+    if (ok) {
+      f->pos = i->state.pos;
+      f->j++;
+      MPC_CALL(p->data.repeat.x, mpc_stack_reserve(i, 1), f->ef);
+    }
+    if (p->type == MPC_TYPE_MANY1 && f->j == 0) {
+      MPC_FAILURE(mpc_err_many1(i, MPC_RESULT(f->base).error));
+    }
+    if (mpc_input_committed(i, f->pos)) {
+      MPC_FAILURE(mpc_parse_abandon(i, p->data.repeat.f, f->j, &MPC_RESULT(f->base)));
+    }
+    acc = mpc_stack_err(i, e, f->ef);
+    *acc = mpc_err_merge(i, *acc, MPC_RESULT(f->base + f->j).error);
+    MPC_SUCCESS(mpc_parse_fold(i, p->data.repeat.f, f->j, (mpc_val_t**)&MPC_RESULT(f->base)));
+  
+  call_count:
+    MPC_CALL(p->data.repeat.x, mpc_stack_reserve(i, 1), f->ef);
+  
+  resume_count:
+    if (ok) {
+      f->j++;
+      if (f->j == p->data.repeat.n) {
+        MPC_SUCCESS(mpc_parse_fold(i, p->data.repeat.f, f->j, (mpc_val_t**)&MPC_RESULT(f->base)));
       }
-      
-    /* Combinatory Parsers */
-    
-    case MPC_TYPE_OR:
-      
-      if (p->data.or.n == 0) { MPC_SUCCESS(NULL); }
-      
-      results = p->data.or.n > MPC_PARSE_STACK_MIN
-        ? mpc_malloc(i, sizeof(mpc_result_t) * p->data.or.n)
-        : results_stk;
-      
-      for (j = 0; j < p->data.or.n; j++) {
-        if (mpc_parse_run(i, p->data.or.xs[j], &results[j], e)) {
-          MPC_SUCCESS(results[j].output;
-            if (p->data.or.n > MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
-        } else {
-          *e = mpc_err_merge(i, *e, results[j].error);
-        } 
+      MPC_CALL(p->data.repeat.x, mpc_stack_reserve(i, 1), f->ef);
+    }
+    for (k = 0; k < f->j; k++) {
+      mpc_parse_dtor(i, p->data.repeat.dx, MPC_RESULT(f->base + k).output);
+    }
+    MPC_FAILURE(mpc_err_count(i, MPC_RESULT(f->base + f->j).error, p->data.repeat.n));
+  
+  /* Combinatory Parsers */
+  
+  call_or:
+    if (p->data.or.n == 0) { MPC_SUCCESS(NULL); }
+    if (p->data.or.charset) {
+      /* Undispatched, alternatives before the one which matches fail first */
+      acc = mpc_stack_err(i, e, f->ef);
+      f->j = p->data.or.charset[(unsigned char)mpc_input_peekc(i)] - 1;
+      for (k = 0; k < f->j && mpc_or_dispatch(p) == NULL; k++) {
+        err = mpc_err_class(i, p->data.or.xs[k], acc);
+        *acc = mpc_err_merge(i, *acc, err);
       }
-      
-      MPC_FAILURE(NULL;
-        if (p->data.or.n > MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
-    
-    case MPC_TYPE_AND:
-      
-      if (p->data.and.n == 0) { MPC_SUCCESS(NULL); }
-      
-      results = p->data.or.n > MPC_PARSE_STACK_MIN
-        ? mpc_malloc(i, sizeof(mpc_result_t) * p->data.or.n)
-        : results_stk;
-      
-      mpc_input_mark(i);
-      for (j = 0; j < p->data.and.n; j++) {
-        if (!mpc_parse_run(i, p->data.and.xs[j], &results[j], e)) {
-          mpc_input_rewind(i);
-          for (k = 0; k < j; k++) {
-            mpc_parse_dtor(i, p->data.and.dxs[k], results[k].output);
-          }
-          MPC_FAILURE(results[j].error;
-            if (p->data.or.n > MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
-        }
+      if (f->j >= 0 && mpc_input_charset(i, p->data.or.charset, (char**)&v)) { MPC_SUCCESS(v); }
+      err = mpc_err_class(i, p, acc);
+      MPC_FAILURE(err);
+    }
+    mpc_stack_reserve(i, p->data.or.n);
+    f->pos = i->state.pos;
+    f->dispatch = mpc_or_dispatch(p);
+    if (f->dispatch == NULL) {
+      MPC_CALL(p->data.or.xs[0], f->base, f->ef);
+    }
+    /* Only try alternatives which can start with the next byte */
+    f->c = (unsigned char)mpc_input_peekc(i);
+    f->j = f->dispatch[f->c] - 1;
+    goto next_or;
+  
+  resume_or:
+    if (f->dispatch == NULL) {
+      if (ok) { MPC_SUCCESS(MPC_RESULT(f->base + f->j).output); }
+      acc = mpc_stack_err(i, e, f->ef);
+      *acc = mpc_err_merge(i, *acc, MPC_RESULT(f->base + f->j).error);
+      if (mpc_input_committed(i, f->pos) || ++f->j == p->data.or.n) { MPC_FAILURE(NULL); }
+      MPC_CALL(p->data.or.xs[f->j], f->base + f->j, f->ef);
+    }
+    k = i->frames_num-1;
+    if (ok) {
+      j = mpc_parse_or_errors(i, e, k, f->j, i->state.pos == f->pos);
+      f = &i->frames[k];
+      acc = mpc_stack_err(i, e, f->ef);
+      *acc = mpc_err_merge(i, *acc, f->sub);
+      /* An earlier alternative matched after all, so this one is dropped as far as `free` goes */
+      if (j >= 0) {
+        mpc_parse_dtor(i, free, MPC_RESULT(f->base + f->j).output);
+        f->j = j;
       }
-      mpc_input_unmark(i); 
-      MPC_SUCCESS(
-        mpc_parse_fold(i, p->data.and.f, j, (mpc_val_t**)results);
-        if (p->data.or.n > MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
-    
-    /* End */
-    
-    default:
-      
-      MPC_FAILURE(mpc_err_fail(i, "Unknown Parser Type Id!"));
-  }
+      MPC_SUCCESS(MPC_RESULT(f->base + f->j).output);
+    }
+    MPC_RESULT(f->base + f->j).error = mpc_err_merge(i, f->sub, MPC_RESULT(f->base + f->j).error);
+    if (mpc_input_committed(i, f->pos)) {
+      mpc_parse_or_errors(i, e, k, f->j + 1, 0);
+      f = &i->frames[k];
+      MPC_FAILURE(NULL);
+    }
   
-  return 0;
+  next_or:
+    /* Errors of a dispatched alternative are held back in the frame so they merge in order */
+    while (++f->j < p->data.or.n) {
+      if (mpc_first_viable(p->data.or.xs[f->j], f->c)) {
+        f->sub = NULL;
+        MPC_CALL(p->data.or.xs[f->j], f->base + f->j, i->frames_num-1);
+      }
+    }
+    k = i->frames_num-1;
+    j = mpc_parse_or_errors(i, e, k, p->data.or.n, 1);
+    f = &i->frames[k];
+    if (j >= 0) { MPC_SUCCESS(MPC_RESULT(f->base + j).output); }
+    MPC_FAILURE(NULL);
+  
+  call_and:
+    if (p->data.and.n == 0) { MPC_SUCCESS(NULL); }
+    if (p->data.and.lit) {
+      if (mpc_parse_literal(i, p, &v, &err)) { MPC_SUCCESS(v); }
+      MPC_FAILURE(err);
+    }
+    mpc_stack_reserve(i, p->data.and.n);
+    mpc_input_mark(i);
+    MPC_CALL(p->data.and.xs[0], f->base, f->ef);
+  
+  resume_and:
+    if (!ok) {
+      mpc_input_rewind(i);
+      for (k = 0; k < f->j; k++) {
+        mpc_parse_dtor(i, p->data.and.dxs[k], MPC_RESULT(f->base + k).output);
+      }
+      MPC_FAILURE(MPC_RESULT(f->base + f->j).error);
+    }
+    if (++f->j < p->data.and.n) {
+      MPC_CALL(p->data.and.xs[f->j], f->base + f->j, f->ef);
+    }
+    mpc_input_unmark(i);
+    MPC_SUCCESS(mpc_parse_fold(i, p->data.and.f, f->j, (mpc_val_t**)&MPC_RESULT(f->base)));
   
 }
 
+#undef MPC_RESULT
+#undef MPC_CALL
 #undef MPC_SUCCESS
 #undef MPC_FAILURE
+#undef MPC_LEAF_SUCCESS
+#undef MPC_LEAF_FAILURE
 #undef MPC_PRIMITIVE
 
+/*
+** A string can be read again, so it is parsed first
+** with its scanners and without errors at all. Only
+** a parse which fails is run again, without scanners,
+** to find out why.
+*/
+
 int mpc_parse_input(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r) {
   int x;
-  mpc_err_t *e = mpc_err_fail(i, "Unknown Error");
+  mpc_presult_t y;
+  mpc_state_t start = i->state;
+  char last = i->last;
+  mpc_fail_t *e = NULL;
+  if (i->type == MPC_INPUT_STRING) {
+    i->scan = 1;
+    mpc_input_suppress_enable(i);
+    x = mpc_parse_run(i, p, &y, &e);
+    mpc_input_suppress_disable(i);
+    if (x) {
+      r->output = mpc_export(i, y.output);
+      return x;
+    }
+    i->state = start;
+    i->last = last;
+  }
+  i->scan = 0;
+  e = mpc_err_fail(i, "Unknown Error");
   e->state = mpc_state_invalid();
-  x = mpc_parse_run(i, p, r, &e);
+  x = mpc_parse_run(i, p, &y, &e);
   if (x) {
     mpc_err_delete_internal(i, e);
-    r->output = mpc_export(i, r->output);
+    r->output = mpc_export(i, y.output);
   } else {
-    r->error = mpc_err_export(i, mpc_err_merge(i, e, r->error));
+    r->error = mpc_err_export(i, mpc_err_merge(i, e, y.error));
   }
   return x;
 }
@@ -1281,6 +2703,9 @@ int mpc_parse_pipe(const char *filename, FILE *pipe, mpc_parser_t *p, mpc_result
 int mpc_parse_contents(const char *filename, mpc_parser_t *p, mpc_result_t *r) {
   
   FILE *f = fopen(filename, "rb");
+  mpc_input_t *i;
+  char *addr;
+  size_t size;
   int res;
   
   if (f == NULL) {
@@ -1289,47 +2714,454 @@ int mpc_parse_contents(const char *filename, mpc_parser_t *p, mpc_result_t *r) {
     return 0;
   }
   
-  res = mpc_parse_file(filename, f, p, r);
+  addr = mpc_file_map(f, &size);
+  if (addr == NULL) {
+    res = mpc_parse_file(filename, f, p, r);
+    fclose(f);
+    return res;
+  }
+  
+  i = mpc_input_new_borrowed(filename, addr, size);
+  res = mpc_parse_input(i, p, r);
+  mpc_input_delete(i);
+  mpc_file_unmap(addr, size);
   fclose(f);
   return res;
 }
 
-/*
-** Building a Parser
-*/
-
-static void mpc_undefine_unretained(mpc_parser_t *p, int force);
+int mpc_parse_arena(const char *filename, const char *string, mpc_parser_t *p, mpc_arena_t *a, mpc_result_t *r) {
+  int x;
+  mpc_input_t *i = mpc_input_new_string(filename, string);
+  i->arena = a;
+  x = mpc_parse_input(i, p, r);
+  mpc_input_delete(i);
+  return x;
+}
 
-static void mpc_undefine_or(mpc_parser_t *p) {
+int mpc_parse_contents_arena(const char *filename, mpc_parser_t *p, mpc_arena_t *a, mpc_result_t *r) {
   
-  int i;
-  for (i = 0; i < p->data.or.n; i++) {
-    mpc_undefine_unretained(p->data.or.xs[i], 0);
+  FILE *f = fopen(filename, "rb");
+  mpc_input_t *i;
+  char *addr;
+  size_t size;
+  int res;
+  
+  if (f == NULL) {
+    r->output = NULL;
+    r->error = mpc_err_file(filename, "Unable to open file!");
+    return 0;
   }
-  free(p->data.or.xs);
   
+  addr = mpc_file_map(f, &size);
+  i = addr ? mpc_input_new_borrowed(filename, addr, size) : mpc_input_new_file(filename, f);
+  i->arena = a;
+  res = mpc_parse_input(i, p, r);
+  mpc_input_delete(i);
+  if (addr) { mpc_file_unmap(addr, size); }
+  fclose(f);
+  return res;
 }
 
-static void mpc_undefine_and(mpc_parser_t *p) {
+int mpc_parse_view(const char *filename, const char *string, long length, mpc_parser_t *p, mpc_arena_t *a, mpc_result_t *r) {
+  int x;
+  mpc_input_t *i = mpc_input_new_view(filename, string, length);
+  i->arena = a;
+  x = mpc_parse_input(i, p, r);
+  mpc_input_delete(i);
+  return x;
+}
+
+int mpc_parse_view_range(const char *filename, const char *string, mpc_state_t start, long end, mpc_parser_t *p, mpc_arena_t *a, mpc_result_t *r) {
+  int x;
+  /* The input still spans from the beginning so positions and slices stay those of the whole */
+  mpc_input_t *i = mpc_input_new_view(filename, string, end);
+  i->state = start;
+  i->arena = a;
+  x = mpc_parse_input(i, p, r);
+  mpc_input_delete(i);
+  return x;
+}
+
+int mpc_parse_contents_view(const char *filename, mpc_parser_t *p, mpc_arena_t *a, mpc_result_t *r) {
   
-  int i;
-  for (i = 0; i < p->data.and.n; i++) {
-    mpc_undefine_unretained(p->data.and.xs[i], 0);
+  FILE *f = fopen(filename, "rb");
+  mpc_arena_map_t *m;
+  char *buffer;
+  long length;
+  size_t size;
+  
+  if (f == NULL) {
+    r->output = NULL;
+    r->error = mpc_err_file(filename, "Unable to open file!");
+    return 0;
+  }
+  
+  /* The mapping is owned by the arena, as long as the AST pointing into it */
+  buffer = mpc_file_map(f, &size);
+  if (buffer) {
+    fclose(f);
+    m = mpc_arena_alloc(a, sizeof(mpc_arena_map_t));
+    m->addr = buffer;
+    m->size = size;
+    m->next = a->maps;
+    a->maps = m;
+    return mpc_parse_view(filename, buffer, (long)size, p, a, r);
+  }
+  
+  /* Otherwise read it into an arena buffer */
+  fseek(f, 0, SEEK_END);
+  length = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  
+  if (length < 0) {
+    fclose(f);
+    return mpc_parse_contents_arena(filename, p, a, r);
   }
-  free(p->data.and.xs);
-  free(p->data.and.dxs);
   
+  buffer = mpc_arena_alloc(a, length + 1);
+  length = (long)fread(buffer, 1, length, f);
+  buffer[length] = '\0';
+  fclose(f);
+  
+  return mpc_parse_view(filename, buffer, length, p, a, r);
 }
 
-static void mpc_undefine_unretained(mpc_parser_t *p, int force) {
+/*
+** Streams
+**
+** Files which can be mapped are parsed in place and
+** others through a file input. Pipes cannot wait on
+** the whitespace after a result without blocking on
+** the next one, so they are read a line at a time
+** into a buffer instead. A parse which fails at the
+** end of the buffer is retried with another line,
+** and gives back what it took from the arena. With
+** a bound the buffer is only parsed once the lines
+** read so far could end a result, so one running
+** over many lines is not parsed again for each.
+*/
+
+enum {
+  MPC_STREAM_LINE_MIN = 256
+};
+
+struct mpc_stream_t {
   
-  if (p->retained && !force) { return; }
+  char *filename;
+  mpc_arena_t *arena;
+  int failed;
   
-  switch (p->type) {
-    
-    case MPC_TYPE_FAIL: free(p->data.fail.m); break;
-    
-    case MPC_TYPE_ONEOF: 
+  mpc_input_t *input;
+  FILE *file;
+  int owned;
+  char *addr;
+  size_t size;
+  
+  char *buffer;
+  long length;
+  long slots;
+  long pos;
+  long row;
+  long col;
+  int eof;
+  
+  mpc_bound_t bound;
+  void *state;
+  int whole;
+  
+};
+
+static mpc_stream_t *mpc_stream_new(const char *filename, mpc_arena_t *a) {
+  
+  mpc_stream_t *s = malloc(sizeof(mpc_stream_t));
+  
+  s->filename = malloc(strlen(filename) + 1);
+  strcpy(s->filename, filename);
+  s->arena = a;
+  s->failed = 0;
+  
+  s->input = NULL;
+  s->file = NULL;
+  s->owned = 0;
+  s->addr = NULL;
+  s->size = 0;
+  
+  s->buffer = NULL;
+  s->length = 0;
+  s->slots = 0;
+  s->pos = 0;
+  s->row = 0;
+  s->col = 0;
+  s->eof = 0;
+  
+  s->bound = NULL;
+  s->state = NULL;
+  s->whole = 1;
+  
+  return s;
+}
+
+static void mpc_stream_lines(mpc_stream_t *s) {
+  s->slots = MPC_STREAM_LINE_MIN;
+  s->buffer = malloc(s->slots);
+}
+
+mpc_stream_t *mpc_stream_pipe(const char *filename, FILE *pipe, mpc_arena_t *a) {
+  mpc_stream_t *s = mpc_stream_new(filename, a);
+  s->file = pipe;
+  mpc_stream_lines(s);
+  return s;
+}
+
+mpc_stream_t *mpc_stream_contents(const char *filename, mpc_arena_t *a) {
+  
+  mpc_stream_t *s = mpc_stream_new(filename, a);
+  
+  s->file = fopen(filename, "rb");
+  s->owned = 1;
+  
+  /* Report the failure from the first `mpc_stream_next` */
+  if (s->file == NULL) {
+    s->failed = 1;
+    return s;
+  }
+  
+  s->addr = mpc_file_map(s->file, &s->size);
+  if (s->addr) {
+    s->input = a
+      ? mpc_input_new_view(filename, s->addr, s->size)
+      : mpc_input_new_borrowed(filename, s->addr, s->size);
+  } else if (fseek(s->file, 0, SEEK_CUR) == 0) {
+    s->input = mpc_input_new_file(filename, s->file);
+  } else {
+    mpc_stream_lines(s);
+    return s;
+  }
+  
+  s->input->arena = a;
+  return s;
+}
+
+mpc_stream_t *mpc_stream_view(const char *filename, const char *string, long length, mpc_arena_t *a) {
+  
+  mpc_stream_t *s = mpc_stream_new(filename, a);
+  
+  s->input = a
+    ? mpc_input_new_view(filename, string, length)
+    : mpc_input_new_borrowed(filename, string, length);
+  s->input->arena = a;
+  
+  return s;
+}
+
+mpc_stream_t *mpc_stream_view_range(const char *filename, const char *string, mpc_state_t start, long end, mpc_arena_t *a) {
+  mpc_stream_t *s = mpc_stream_view(filename, string, end, a);
+  s->input->state = start;
+  return s;
+}
+
+void mpc_stream_bound(mpc_stream_t *s, mpc_bound_t f, void *state) {
+  s->bound = f;
+  s->state = state;
+}
+
+/* Appends the next line, dropping what has been parsed already */
+static int mpc_stream_line(mpc_stream_t *s) {
+  
+  int c;
+  long start;
+  
+  if (s->eof) { return 0; }
+  
+  memmove(s->buffer, s->buffer + s->pos, s->length - s->pos);
+  s->length -= s->pos;
+  s->pos = 0;
+  start = s->length;
+  
+  while ((c = fgetc(s->file)) != EOF) {
+    if (s->length == s->slots) {
+      s->slots *= 2;
+      s->buffer = realloc(s->buffer, s->slots);
+    }
+    s->buffer[s->length++] = (char)c;
+    if (c == '\n') { break; }
+  }
+  
+  if (c == EOF) { s->eof = 1; }
+  if (s->bound) { s->whole = s->bound(s->buffer + start, s->length - start, s->state); }
+  return s->length > start;
+}
+
+static void mpc_stream_advance(mpc_stream_t *s, long n) {
+  while (n--) {
+    s->col++;
+    if (s->buffer[s->pos++] == '\n') {
+      s->col = 0;
+      s->row++;
+    }
+  }
+}
+
+int mpc_stream_done(mpc_stream_t *s) {
+  
+  char *x;
+  
+  if (s->failed) { return s->filename == NULL; }
+  
+  if (s->input) {
+    while (mpc_input_oneof(s->input, " \f\n\r\t\v", &x)) {
+      mpc_free(s->input, x);
+    }
+    return mpc_input_terminated(s->input);
+  }
+  
+  while (1) {
+    while (s->pos < s->length
+    &&     s->buffer[s->pos] != '\0'
+    &&     strchr(" \f\n\r\t\v", s->buffer[s->pos])) {
+      mpc_stream_advance(s, 1);
+    }
+    if (s->pos < s->length) { return 0; }
+    if (!mpc_stream_line(s)) { return 1; }
+  }
+}
+
+int mpc_stream_next(mpc_stream_t *s, mpc_parser_t *p, mpc_result_t *r) {
+  
+  mpc_input_t *i;
+  mpc_arena_mark_t m;
+  int x;
+  
+  if (s->failed) {
+    r->output = NULL;
+    r->error = mpc_err_file(s->filename, "Unable to open file!");
+    free(s->filename);
+    s->filename = NULL;
+    return 0;
+  }
+  
+  if (s->input) { return mpc_parse_input(s->input, p, r); }
+  
+  while (1) {
+    
+    /* Lines which leave a result open are not worth parsing yet */
+    while (!s->whole && mpc_stream_line(s));
+    
+    if (s->arena) { m = mpc_arena_mark(s->arena); }
+    
+    i = s->arena
+      ? mpc_input_new_view(s->filename, s->buffer + s->pos, s->length - s->pos)
+      : mpc_input_new_borrowed(s->filename, s->buffer + s->pos, s->length - s->pos);
+    i->arena = s->arena;
+    i->state.row = s->row;
+    i->state.col = s->col;
+    
+    x = mpc_parse_input(i, p, r);
+    
+    if (x) {
+      mpc_stream_advance(s, i->state.pos);
+      mpc_input_delete(i);
+      return 1;
+    }
+    
+    mpc_input_delete(i);
+    
+    /* Only a failure at the end of what has been read so far may be an unfinished result */
+    if (s->eof || r->error->state.pos < s->length - s->pos) { return 0; }
+    
+    mpc_err_delete(r->error);
+    if (s->arena) { mpc_arena_rewind(s->arena, m); }
+    mpc_stream_line(s);
+  }
+}
+
+void mpc_stream_delete(mpc_stream_t *s) {
+  if (s->input) { mpc_input_delete(s->input); }
+  if (s->addr) { mpc_file_unmap(s->addr, s->size); }
+  if (s->file && s->owned) { fclose(s->file); }
+  free(s->buffer);
+  free(s->filename);
+  free(s);
+}
+
+/*
+** Building a Parser
+*/
+
+static void mpc_undefine_unretained(mpc_parser_t *p, int force);
+
+static void mpc_first_release(mpc_parser_t *p) {
+  if (p->first == NULL) { return; }
+  free(p->first->dispatch);
+  free(p->first);
+  p->first = NULL;
+}
+
+/*
+** Byte tables left by `mpc_optimise`, 256 entries
+** each. For `or` an entry is one more than the
+** index of the first alternative taking that byte.
+*/
+
+static unsigned char *mpc_charset_copy(const unsigned char *s) {
+  unsigned char *t;
+  if (s == NULL) { return NULL; }
+  t = malloc(256);
+  memcpy(t, s, 256);
+  return t;
+}
+
+static void mpc_fuse_release(mpc_parser_t *p) {
+  switch (p->type) {
+    case MPC_TYPE_MANY:
+    case MPC_TYPE_MANY1:
+      free(p->data.repeat.charset);
+      p->data.repeat.charset = NULL;
+      break;
+    case MPC_TYPE_OR:
+      free(p->data.or.charset);
+      p->data.or.charset = NULL;
+      break;
+    case MPC_TYPE_AND:
+      free(p->data.and.lit);
+      p->data.and.lit = NULL;
+      break;
+    default: break;
+  }
+}
+
+static void mpc_undefine_or(mpc_parser_t *p) {
+  
+  int i;
+  for (i = 0; i < p->data.or.n; i++) {
+    mpc_undefine_unretained(p->data.or.xs[i], 0);
+  }
+  free(p->data.or.xs);
+  free(p->data.or.charset);
+  
+}
+
+static void mpc_undefine_and(mpc_parser_t *p) {
+  
+  int i;
+  for (i = 0; i < p->data.and.n; i++) {
+    mpc_undefine_unretained(p->data.and.xs[i], 0);
+  }
+  free(p->data.and.xs);
+  free(p->data.and.dxs);
+  free(p->data.and.lit);
+  
+}
+
+static void mpc_undefine_unretained(mpc_parser_t *p, int force) {
+  
+  if (p->retained && !force) { return; }
+  
+  switch (p->type) {
+    
+    case MPC_TYPE_FAIL: free(p->data.fail.m); break;
+    
+    case MPC_TYPE_ONEOF: 
     case MPC_TYPE_NONEOF:
     case MPC_TYPE_STRING:
       free(p->data.string.x); 
@@ -1338,6 +3170,7 @@ static void mpc_undefine_unretained(mpc_parser_t *p, int force) {
     case MPC_TYPE_APPLY:    mpc_undefine_unretained(p->data.apply.x, 0);    break;
     case MPC_TYPE_APPLY_TO: mpc_undefine_unretained(p->data.apply_to.x, 0); break;
     case MPC_TYPE_PREDICT:  mpc_undefine_unretained(p->data.predict.x, 0);  break;
+    case MPC_TYPE_SCAN:     mpc_undefine_unretained(p->data.scan.x, 0);     break;
     
     case MPC_TYPE_MAYBE:
     case MPC_TYPE_NOT:
@@ -1353,6 +3186,7 @@ static void mpc_undefine_unretained(mpc_parser_t *p, int force) {
     case MPC_TYPE_MANY1:
     case MPC_TYPE_COUNT:
       mpc_undefine_unretained(p->data.repeat.x, 0);
+      free(p->data.repeat.charset);
       break;
     
     case MPC_TYPE_OR:  mpc_undefine_or(p);  break;
@@ -1361,6 +3195,8 @@ static void mpc_undefine_unretained(mpc_parser_t *p, int force) {
     default: break;
   }
   
+  mpc_first_release(p);
+  
   if (!force) {
     free(p->name);
     free(p);
@@ -1375,6 +3211,8 @@ void mpc_delete(mpc_parser_t *p) {
       mpc_undefine_unretained(p, 0);
     } 
     
+    mpc_first_release(p);
+    if (p->profile) { p->profile->p = NULL; }
     free(p->name);
     free(p);
   
@@ -1436,6 +3274,7 @@ mpc_parser_t *mpc_copy(mpc_parser_t *a) {
     case MPC_TYPE_APPLY:    p->data.apply.x    = mpc_copy(a->data.apply.x);    break;
     case MPC_TYPE_APPLY_TO: p->data.apply_to.x = mpc_copy(a->data.apply_to.x); break;
     case MPC_TYPE_PREDICT:  p->data.predict.x  = mpc_copy(a->data.predict.x);  break;
+    case MPC_TYPE_SCAN:     p->data.scan.x     = mpc_copy(a->data.scan.x);     break;
     
     case MPC_TYPE_MAYBE:
     case MPC_TYPE_NOT:
@@ -1452,6 +3291,7 @@ mpc_parser_t *mpc_copy(mpc_parser_t *a) {
     case MPC_TYPE_MANY1:
     case MPC_TYPE_COUNT:
       p->data.repeat.x = mpc_copy(a->data.repeat.x);
+      p->data.repeat.charset = mpc_charset_copy(a->data.repeat.charset);
       break;
     
     case MPC_TYPE_OR:
@@ -1459,6 +3299,7 @@ mpc_parser_t *mpc_copy(mpc_parser_t *a) {
       for (i = 0; i < a->data.or.n; i++) {
         p->data.or.xs[i] = mpc_copy(a->data.or.xs[i]);
       }
+      p->data.or.charset = mpc_charset_copy(a->data.or.charset);
     break;
     case MPC_TYPE_AND:
       p->data.and.xs = malloc(a->data.and.n * sizeof(mpc_parser_t*));
@@ -1469,6 +3310,10 @@ mpc_parser_t *mpc_copy(mpc_parser_t *a) {
       for (i = 0; i < a->data.and.n-1; i++) {
         p->data.and.dxs[i] = a->data.and.dxs[i];
       }
+      if (a->data.and.lit) {
+        p->data.and.lit = malloc(strlen(a->data.and.lit)+1);
+        strcpy(p->data.and.lit, a->data.and.lit);
+      }
     break;
     
     default: break;
@@ -1479,6 +3324,7 @@ mpc_parser_t *mpc_copy(mpc_parser_t *a) {
 }
 
 mpc_parser_t *mpc_undefine(mpc_parser_t *p) {
+  if (p->first) { mpc_generation++; }
   mpc_undefine_unretained(p, 1);
   p->type = MPC_TYPE_UNDEFINED;
   return p;
@@ -1486,6 +3332,12 @@ mpc_parser_t *mpc_undefine(mpc_parser_t *p) {
 
 mpc_parser_t *mpc_define(mpc_parser_t *p, mpc_parser_t *a) {
   
+  /* Anything analysed against the old definition is now stale */
+  if (p->first) {
+    mpc_generation++;
+    mpc_first_release(p);
+  }
+  
   if (p->retained) {
     p->type = a->type;
     p->data = a->data;
@@ -2218,6 +4070,7 @@ mpc_parser_t *mpc_re(const char *re) {
   mpc_cleanup(6, RegexEnclose, Regex, Term, Factor, Base, Range);
   
   mpc_optimise(r.output);
+  mpc_analyse((mpc_parser_t**)&r.output, 1);
   
   return r.output;
   
@@ -2560,6 +4413,7 @@ static void mpc_print_unretained(mpc_parser_t *p, int force) {
   if (p->type == MPC_TYPE_APPLY)    { mpc_print_unretained(p->data.apply.x, 0); }
   if (p->type == MPC_TYPE_APPLY_TO) { mpc_print_unretained(p->data.apply_to.x, 0); }
   if (p->type == MPC_TYPE_PREDICT)  { mpc_print_unretained(p->data.predict.x, 0); }
+  if (p->type == MPC_TYPE_SCAN)     { mpc_print_unretained(p->data.scan.x, 0); }
 
   if (p->type == MPC_TYPE_NOT)   { mpc_print_unretained(p->data.not.x, 0); printf("!"); }
   if (p->type == MPC_TYPE_MAYBE) { mpc_print_unretained(p->data.not.x, 0); printf("?"); }
@@ -2696,8 +4550,9 @@ mpc_ast_t *mpc_ast_new(const char *tag, const char *contents) {
   a->tag = malloc(strlen(tag) + 1);
   strcpy(a->tag, tag);
   
-  a->contents = malloc(strlen(contents) + 1);
-  strcpy(a->contents, contents);
+  a->contents_len = strlen(contents);
+  a->contents = malloc(a->contents_len + 1);
+  memcpy(a->contents, contents, a->contents_len + 1);
   
   a->state = mpc_state_new();
   
@@ -2743,7 +4598,8 @@ int mpc_ast_eq(mpc_ast_t *a, mpc_ast_t *b) {
   int i;
 
   if (strcmp(a->tag, b->tag) != 0) { return 0; }
-  if (strcmp(a->contents, b->contents) != 0) { return 0; }
+  if (a->contents_len != b->contents_len) { return 0; }
+  if (memcmp(a->contents, b->contents, a->contents_len) != 0) { return 0; }
   if (a->children_num != b->children_num) { return 0; }
   
   for (i = 0; i < a->children_num; i++) {
@@ -2789,6 +4645,11 @@ mpc_ast_t *mpc_ast_state(mpc_ast_t *a, mpc_state_t s) {
   return a;
 }
 
+int mpc_ast_contents_eq(mpc_ast_t *a, const char *s) {
+  size_t l = strlen(s);
+  return (size_t)a->contents_len == l && memcmp(a->contents, s, l) == 0;
+}
+
 static void mpc_ast_print_depth(mpc_ast_t *a, int d, FILE *fp) {
   
   int i;
@@ -2800,11 +4661,11 @@ static void mpc_ast_print_depth(mpc_ast_t *a, int d, FILE *fp) {
   
   for (i = 0; i < d; i++) { fprintf(fp, "  "); }
   
-  if (strlen(a->contents)) {
-    fprintf(fp, "%s:%lu:%lu '%s'\n", a->tag, 
+  if (a->contents_len) {
+    fprintf(fp, "%s:%lu:%lu '%.*s'\n", a->tag, 
       (long unsigned int)(a->state.row+1),
       (long unsigned int)(a->state.col+1),
-      a->contents);
+      (int)a->contents_len, a->contents);
   } else {
     fprintf(fp, "%s \n", a->tag);
   }
@@ -3114,6 +4975,15 @@ mpc_parser_t *mpca_and(int n, ...) {
 
 mpc_parser_t *mpca_total(mpc_parser_t *a) { return mpc_total(a, (mpc_dtor_t)mpc_ast_delete); }
 
+mpc_parser_t *mpca_scan(mpc_scan_t f, const char *t, mpc_parser_t *x) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_SCAN;
+  p->data.scan.f = f;
+  p->data.scan.t = t;
+  p->data.scan.x = x;
+  return p;
+}
+
 /*
 ** Grammar Parser
 */
@@ -3348,6 +5218,7 @@ mpc_parser_t *mpca_grammar_st(const char *grammar, mpca_grammar_st_t *st) {
   mpc_cleanup(5, GrammarTotal, Grammar, Term, Factor, Base);
   
   mpc_optimise(r.output);
+  mpc_analyse((mpc_parser_t**)&r.output, 1);
   
   return (st->flags & MPCA_LANG_PREDICTIVE) ? mpc_predictive(r.output) : r.output;
   
@@ -3422,7 +5293,13 @@ static mpc_val_t *mpca_stmt_list_apply_to(mpc_val_t *x, void *s) {
   mpca_grammar_st_t *st = s;
   mpca_stmt_t *stmt;
   mpca_stmt_t **stmts = x;
-  mpc_parser_t *left;
+  mpc_parser_t *left, *inner;
+  mpc_parser_t **lefts;
+  int j, n = 0;
+
+  while(stmts[n]) { n++; }
+  lefts = malloc(sizeof(mpc_parser_t*) * (n ? n : 1));
+  n = 0;
 
   while(*stmts) {
     stmt = *stmts;
@@ -3431,6 +5308,7 @@ static mpc_val_t *mpca_stmt_list_apply_to(mpc_val_t *x, void *s) {
     if (stmt->name) { stmt->grammar = mpc_expect(stmt->grammar, stmt->name); }
     mpc_optimise(stmt->grammar);
     mpc_define(left, stmt->grammar);
+    lefts[n++] = left;
     free(stmt->ident);
     free(stmt->name);
     free(stmt);
@@ -3439,6 +5317,20 @@ static mpc_val_t *mpca_stmt_list_apply_to(mpc_val_t *x, void *s) {
   
   free(x);
   
+  /* Grammars which never need to backtrack are made predictive */
+  if (mpc_analyse(lefts, n) && !(st->flags & MPCA_LANG_PREDICTIVE)) {
+    for (j = 0; j < n; j++) {
+      inner = mpc_undefined();
+      inner->type = lefts[j]->type;
+      inner->data = lefts[j]->data;
+      lefts[j]->type = MPC_TYPE_PREDICT;
+      lefts[j]->data.predict.x = inner;
+    }
+    mpc_analyse(lefts, n);
+  }
+  
+  free(lefts);
+  
   return NULL;
 }
 
@@ -3623,6 +5515,7 @@ static int mpc_nodecount_unretained(mpc_parser_t* p, int force) {
   if (p->type == MPC_TYPE_APPLY)    { return 1 + mpc_nodecount_unretained(p->data.apply.x, 0); }
   if (p->type == MPC_TYPE_APPLY_TO) { return 1 + mpc_nodecount_unretained(p->data.apply_to.x, 0); }
   if (p->type == MPC_TYPE_PREDICT)  { return 1 + mpc_nodecount_unretained(p->data.predict.x, 0); }
+  if (p->type == MPC_TYPE_SCAN)     { return 1 + mpc_nodecount_unretained(p->data.scan.x, 0); }
 
   if (p->type == MPC_TYPE_NOT)   { return 1 + mpc_nodecount_unretained(p->data.not.x, 0); }
   if (p->type == MPC_TYPE_MAYBE) { return 1 + mpc_nodecount_unretained(p->data.not.x, 0); }
@@ -3657,56 +5550,302 @@ void mpc_stats(mpc_parser_t* p) {
   printf("Node Count: %i\n", mpc_nodecount_unretained(p, 1));
 }
 
-static void mpc_optimise_unretained(mpc_parser_t *p, int force) {
+void mpc_profile_enable(int on) {
+  mpc_profiling = on;
+}
+
+void mpc_profile_reset(void) {
+  mpc_profile_t *x = mpc_profiles, *n;
+  while (x) {
+    n = x->next;
+    if (x->p) { x->p->profile = NULL; }
+    free(x->name);
+    free(x);
+    x = n;
+  }
+  mpc_profiles = NULL;
+}
+
+static int mpc_profile_cmp(const void *a, const void *b) {
+  const mpc_profile_t *x = *(mpc_profile_t* const*)a;
+  const mpc_profile_t *y = *(mpc_profile_t* const*)b;
+  if (x->self != y->self) { return x->self < y->self ? 1 : -1; }
+  return strcmp(x->name, y->name);
+}
+
+/* Heaviest first by time spent in the parser itself */
+static mpc_profile_t **mpc_profile_sorted(int *n) {
   
-  int i, n, m;
-  mpc_parser_t *t;
+  mpc_profile_t *x, **xs;
+  int j = 0;
   
-  if (p->retained && !force) { return; }
+  *n = 0;
+  for (x = mpc_profiles; x; x = x->next) { (*n)++; }
   
-  /* Optimise Subexpressions */
+  xs = malloc(sizeof(mpc_profile_t*) * (*n + 1));
+  for (x = mpc_profiles; x; x = x->next) { xs[j++] = x; }
+  qsort(xs, *n, sizeof(mpc_profile_t*), mpc_profile_cmp);
   
-  if (p->type == MPC_TYPE_EXPECT)   { mpc_optimise_unretained(p->data.expect.x, 0); }
-  if (p->type == MPC_TYPE_APPLY)    { mpc_optimise_unretained(p->data.apply.x, 0); }
-  if (p->type == MPC_TYPE_APPLY_TO) { mpc_optimise_unretained(p->data.apply_to.x, 0); }
-  if (p->type == MPC_TYPE_PREDICT)  { mpc_optimise_unretained(p->data.predict.x, 0); }
-  if (p->type == MPC_TYPE_NOT)      { mpc_optimise_unretained(p->data.not.x, 0); }
-  if (p->type == MPC_TYPE_MAYBE)    { mpc_optimise_unretained(p->data.not.x, 0); }
-  if (p->type == MPC_TYPE_MANY)     { mpc_optimise_unretained(p->data.repeat.x, 0); }
-  if (p->type == MPC_TYPE_MANY1)    { mpc_optimise_unretained(p->data.repeat.x, 0); }
-  if (p->type == MPC_TYPE_COUNT)    { mpc_optimise_unretained(p->data.repeat.x, 0); }
+  return xs;
+}
+
+void mpc_profile_print_to(FILE *f) {
   
-  if (p->type == MPC_TYPE_OR) { 
-    for(i = 0; i < p->data.or.n; i++) {
-      mpc_optimise_unretained(p->data.or.xs[i], 0);
-    }
+  int j, n;
+  mpc_profile_t **xs = mpc_profile_sorted(&n);
+  
+  fprintf(f, "%-20s %10s %10s %10s %10s %12s %10s %10s\n",
+    "rule", "calls", "successes", "failures", "rewinds", "bytes", "self ms", "total ms");
+  
+  for (j = 0; j < n; j++) {
+    fprintf(f, "%-20s %10lu %10lu %10lu %10lu %12lu %10.3f %10.3f\n",
+      xs[j]->name, xs[j]->calls, xs[j]->successes, xs[j]->failures,
+      xs[j]->rewinds, xs[j]->bytes, xs[j]->self * 1e3, xs[j]->total * 1e3);
   }
   
-  if (p->type == MPC_TYPE_AND) {
-    for(i = 0; i < p->data.and.n; i++) {
-      mpc_optimise_unretained(p->data.and.xs[i], 0);
+  free(xs);
+}
+
+void mpc_profile_print(void) {
+  mpc_profile_print_to(stdout);
+}
+
+void mpc_profile_json_to(FILE *f) {
+  
+  int j, n;
+  char *c;
+  mpc_profile_t **xs = mpc_profile_sorted(&n);
+  
+  fprintf(f, "[");
+  
+  for (j = 0; j < n; j++) {
+    fprintf(f, "%s\n  {\"rule\": \"", j ? "," : "");
+    for (c = xs[j]->name; *c; c++) {
+      if (*c == '"' || *c == '\\') { fputc('\\', f); }
+      fputc(*c, f);
     }
-  }  
+    fprintf(f, "\", \"calls\": %lu, \"successes\": %lu, \"failures\": %lu, "
+      "\"rewinds\": %lu, \"bytes\": %lu, \"self_ms\": %.3f, \"total_ms\": %.3f}",
+      xs[j]->calls, xs[j]->successes, xs[j]->failures,
+      xs[j]->rewinds, xs[j]->bytes, xs[j]->self * 1e3, xs[j]->total * 1e3);
+  }
   
-  /* Perform optimisations */
+  fprintf(f, "%s]\n", n ? "\n" : "");
   
-  while (1) {
-    
-    /* Merge rhs `or` */
-    if (p->type == MPC_TYPE_OR
-    &&  p->data.or.xs[p->data.or.n-1]->type == MPC_TYPE_OR
-    && !p->data.or.xs[p->data.or.n-1]->retained) {
-      t = p->data.or.xs[p->data.or.n-1];
-      n = p->data.or.n; m = t->data.or.n;
-      p->data.or.n = n + m - 1;
-      p->data.or.xs = realloc(p->data.or.xs, sizeof(mpc_parser_t*) * (n + m -1));
-      memmove(p->data.or.xs + n - 1, t->data.or.xs, m * sizeof(mpc_parser_t*));
-      free(t->data.or.xs); free(t->name); free(t);
-      continue;
+  free(xs);
+}
+
+/*
+** Fusion
+**
+** Single byte parsers under `or` become one table
+** lookup, runs of them folded into a string one
+** scan of the input, and literals joined by a
+** string fold one comparison. The fused parser
+** keeps its children, which grammar analysis,
+** printing and errors still go by, and `mpc_parse`
+** takes the fast path whenever the table or
+** literal is there.
+*/
+
+static mpc_parser_t *mpc_fuse_unwrap(mpc_parser_t *p) {
+  while (!p->retained && p->type == MPC_TYPE_EXPECT) { p = p->data.expect.x; }
+  return p->retained ? NULL : p;
+}
+
+/* Same comparisons as the input functions so signedness agrees */
+static int mpc_fuse_byte(mpc_parser_t *p, int c) {
+  switch (p->type) {
+    case MPC_TYPE_ANY:    return 1;
+    case MPC_TYPE_SINGLE: return (char)c == p->data.single.x;
+    case MPC_TYPE_RANGE:  return (char)c >= p->data.range.x && (char)c <= p->data.range.y;
+    case MPC_TYPE_ONEOF:  return strchr(p->data.string.x, (char)c) != 0;
+    case MPC_TYPE_NONEOF: return strchr(p->data.string.x, (char)c) == 0;
+    case MPC_TYPE_OR:     return p->data.or.charset[c] != 0;
+    default: return 0;
+  }
+}
+
+static int mpc_fuse_is_class(mpc_parser_t *p, int or) {
+  p = mpc_fuse_unwrap(p);
+  if (p == NULL) { return 0; }
+  switch (p->type) {
+    case MPC_TYPE_ANY:
+    case MPC_TYPE_SINGLE:
+    case MPC_TYPE_RANGE:
+    case MPC_TYPE_ONEOF:
+    case MPC_TYPE_NONEOF: return 1;
+    case MPC_TYPE_OR:     return or && p->data.or.charset != NULL;
+    default: return 0;
+  }
+}
+
+static void mpc_fuse_class(mpc_parser_t *p, unsigned char *s, int v) {
+  int c;
+  p = mpc_fuse_unwrap(p);
+  for (c = 0; c < 256; c++) {
+    if (!s[c] && mpc_fuse_byte(p, c)) { s[c] = (unsigned char)v; }
+  }
+}
+
+static int mpc_fuse_is_literal(mpc_parser_t *p) {
+  p = mpc_fuse_unwrap(p);
+  return p && ((p->type == MPC_TYPE_SINGLE && p->data.single.x) || p->type == MPC_TYPE_STRING);
+}
+
+static char *mpc_fuse_literal(mpc_parser_t *p) {
+  
+  int i;
+  size_t l = 0;
+  char *lit;
+  mpc_parser_t *q;
+  
+  for (i = 0; i < p->data.and.n; i++) {
+    q = mpc_fuse_unwrap(p->data.and.xs[i]);
+    l += q->type == MPC_TYPE_SINGLE ? 1 : strlen(q->data.string.x);
+  }
+  
+  lit = malloc(l + 1);
+  l = 0;
+  for (i = 0; i < p->data.and.n; i++) {
+    q = mpc_fuse_unwrap(p->data.and.xs[i]);
+    if (q->type == MPC_TYPE_SINGLE) {
+      lit[l++] = q->data.single.x;
+    } else {
+      strcpy(lit + l, q->data.string.x);
+      l += strlen(q->data.string.x);
     }
+  }
+  lit[l] = '\0';
+  
+  return lit;
+}
 
-    /* Merge lhs `or` */
-    if (p->type == MPC_TYPE_OR
+static void mpc_fuse(mpc_parser_t *p) {
+  
+  int i;
+  
+  /* Optimising again may have changed the children */
+  mpc_fuse_release(p);
+  
+  if (p->type == MPC_TYPE_OR && p->data.or.n > 0 && p->data.or.n < 256) {
+    for (i = 0; i < p->data.or.n; i++) {
+      if (!mpc_fuse_is_class(p->data.or.xs[i], 0)) { return; }
+    }
+    p->data.or.charset = calloc(1, 256);
+    for (i = 0; i < p->data.or.n; i++) {
+      mpc_fuse_class(p->data.or.xs[i], p->data.or.charset, i + 1);
+    }
+  }
+  
+  if ((p->type == MPC_TYPE_MANY || p->type == MPC_TYPE_MANY1)
+  &&  p->data.repeat.f == mpcf_strfold
+  &&  mpc_fuse_is_class(p->data.repeat.x, 1)) {
+    p->data.repeat.charset = calloc(1, 256);
+    mpc_fuse_class(p->data.repeat.x, p->data.repeat.charset, 1);
+  }
+  
+  if (p->type == MPC_TYPE_AND && p->data.and.f == mpcf_strfold && p->data.and.n > 1) {
+    for (i = 0; i < p->data.and.n; i++) {
+      if (!mpc_fuse_is_literal(p->data.and.xs[i])) { return; }
+    }
+    p->data.and.lit = mpc_fuse_literal(p);
+  }
+  
+}
+
+/* Moves the first run of literals in a re `and` which is not all of it into an `and` of its own */
+static int mpc_fuse_literals(mpc_parser_t *p) {
+  
+  int i, j, m, n = p->data.and.n;
+  mpc_parser_t *t, **xs = p->data.and.xs;
+  mpc_dtor_t *dxs = p->data.and.dxs;
+  
+  for (i = 0; i < n; i = j + 1) {
+    
+    for (j = i; j < n && mpc_fuse_is_literal(xs[j]); j++);
+    
+    m = j - i;
+    if (m < 2 || m == n) { continue; }
+    
+    t = mpc_undefined();
+    t->type = MPC_TYPE_AND;
+    t->data.and.n = m;
+    t->data.and.f = mpcf_strfold;
+    t->data.and.xs = malloc(sizeof(mpc_parser_t*) * m);
+    t->data.and.dxs = malloc(sizeof(mpc_dtor_t) * (m - 1));
+    memcpy(t->data.and.xs, xs + i, sizeof(mpc_parser_t*) * m);
+    memcpy(t->data.and.dxs, dxs + i, sizeof(mpc_dtor_t) * (m - 1));
+    mpc_fuse(t);
+    
+    xs[i] = t;
+    memmove(xs + i + 1, xs + j, sizeof(mpc_parser_t*) * (n - j));
+    if (j < n) {
+      dxs[i] = dxs[j - 1];
+      memmove(dxs + i + 1, dxs + j, sizeof(mpc_dtor_t) * (n - 1 - j));
+    }
+    p->data.and.n = n - m + 1;
+    return 1;
+  }
+  
+  return 0;
+}
+
+static void mpc_optimise_unretained(mpc_parser_t *p, int force) {
+  
+  int i, n, m;
+  mpc_parser_t *t;
+  
+  if (p->retained && !force) { return; }
+  
+  /* Rewrites below may merge or move nodes */
+  mpc_first_release(p);
+  mpc_fuse_release(p);
+  
+  /* Optimise Subexpressions */
+  
+  if (p->type == MPC_TYPE_EXPECT)   { mpc_optimise_unretained(p->data.expect.x, 0); }
+  if (p->type == MPC_TYPE_APPLY)    { mpc_optimise_unretained(p->data.apply.x, 0); }
+  if (p->type == MPC_TYPE_APPLY_TO) { mpc_optimise_unretained(p->data.apply_to.x, 0); }
+  if (p->type == MPC_TYPE_PREDICT)  { mpc_optimise_unretained(p->data.predict.x, 0); }
+  if (p->type == MPC_TYPE_SCAN)     { mpc_optimise_unretained(p->data.scan.x, 0); }
+  if (p->type == MPC_TYPE_NOT)      { mpc_optimise_unretained(p->data.not.x, 0); }
+  if (p->type == MPC_TYPE_MAYBE)    { mpc_optimise_unretained(p->data.not.x, 0); }
+  if (p->type == MPC_TYPE_MANY)     { mpc_optimise_unretained(p->data.repeat.x, 0); }
+  if (p->type == MPC_TYPE_MANY1)    { mpc_optimise_unretained(p->data.repeat.x, 0); }
+  if (p->type == MPC_TYPE_COUNT)    { mpc_optimise_unretained(p->data.repeat.x, 0); }
+  
+  if (p->type == MPC_TYPE_OR) { 
+    for(i = 0; i < p->data.or.n; i++) {
+      mpc_optimise_unretained(p->data.or.xs[i], 0);
+    }
+  }
+  
+  if (p->type == MPC_TYPE_AND) {
+    for(i = 0; i < p->data.and.n; i++) {
+      mpc_optimise_unretained(p->data.and.xs[i], 0);
+    }
+  }  
+  
+  /* Perform optimisations */
+  
+  while (1) {
+    
+    /* Merge rhs `or` */
+    if (p->type == MPC_TYPE_OR
+    &&  p->data.or.xs[p->data.or.n-1]->type == MPC_TYPE_OR
+    && !p->data.or.xs[p->data.or.n-1]->retained) {
+      t = p->data.or.xs[p->data.or.n-1];
+      n = p->data.or.n; m = t->data.or.n;
+      p->data.or.n = n + m - 1;
+      p->data.or.xs = realloc(p->data.or.xs, sizeof(mpc_parser_t*) * (n + m -1));
+      memmove(p->data.or.xs + n - 1, t->data.or.xs, m * sizeof(mpc_parser_t*));
+      free(t->data.or.xs); free(t->data.or.charset); free(t->name); free(t);
+      continue;
+    }
+
+    /* Merge lhs `or` */
+    if (p->type == MPC_TYPE_OR
     &&  p->data.or.xs[0]->type == MPC_TYPE_OR
     && !p->data.or.xs[0]->retained) {
       t = p->data.or.xs[0];
@@ -3715,7 +5854,7 @@ static void mpc_optimise_unretained(mpc_parser_t *p, int force) {
       p->data.or.xs = realloc(p->data.or.xs, sizeof(mpc_parser_t*) * (n + m -1));
       memmove(p->data.or.xs + m, t->data.or.xs + 1, n * sizeof(mpc_parser_t*));
       memmove(p->data.or.xs, t->data.or.xs, m * sizeof(mpc_parser_t*));
-      free(t->data.or.xs); free(t->name); free(t);
+      free(t->data.or.xs); free(t->data.or.charset); free(t->name); free(t);
       continue;
     }
     
@@ -3788,7 +5927,8 @@ static void mpc_optimise_unretained(mpc_parser_t *p, int force) {
     &&  p->data.and.f == mpcf_strfold
     &&  p->data.and.xs[0]->type == MPC_TYPE_AND
     && !p->data.and.xs[0]->retained
-    &&  p->data.and.xs[0]->data.and.f == mpcf_strfold) {
+    &&  p->data.and.xs[0]->data.and.f == mpcf_strfold
+    && !p->data.and.xs[0]->data.and.lit) {
       t = p->data.and.xs[0];
       n = p->data.and.n; m = t->data.and.n;
       p->data.and.n = n + m - 1;
@@ -3806,7 +5946,8 @@ static void mpc_optimise_unretained(mpc_parser_t *p, int force) {
     &&  p->data.and.f == mpcf_strfold
     &&  p->data.and.xs[p->data.and.n-1]->type == MPC_TYPE_AND
     && !p->data.and.xs[p->data.and.n-1]->retained
-    &&  p->data.and.xs[p->data.and.n-1]->data.and.f == mpcf_strfold) {
+    &&  p->data.and.xs[p->data.and.n-1]->data.and.f == mpcf_strfold
+    && !p->data.and.xs[p->data.and.n-1]->data.and.lit) {
       t = p->data.and.xs[p->data.and.n-1];
       n = p->data.and.n; m = t->data.and.n;
       p->data.and.n = n + m - 1;
@@ -3818,6 +5959,14 @@ static void mpc_optimise_unretained(mpc_parser_t *p, int force) {
       continue;
     }
     
+    /* Fuse literals in re `and` */
+    if (p->type == MPC_TYPE_AND
+    &&  p->data.and.f == mpcf_strfold
+    &&  mpc_fuse_literals(p)) {
+      continue;
+    }
+    
+    mpc_fuse(p);
     return;
     
   }
@@ -3828,3 +5977,998 @@ void mpc_optimise(mpc_parser_t *p) {
   mpc_optimise_unretained(p, 1);
 }
 
+
+/*
+** Code Generation
+**
+** Writes C which builds a set of retained parsers
+** straight from the combinators. Parsers from
+** `mpca_lang` come out with every regex already
+** lowered, the rules optimised and made predictive
+** where it is safe, so a program which includes the
+** result skips the grammar and regex parsers and
+** name lookups at startup entirely.
+**
+** Only parsers built from the functions mpc exports
+** can be written out. Anything else, a `satisfy`
+** with a function of the program or a lifted value,
+** is reported and makes the whole output unusable.
+*/
+
+typedef struct {
+  const char *name;
+  void (*f)(void);
+} mpc_codegen_func_t;
+
+static const mpc_codegen_func_t mpc_codegen_funcs[] = {
+  { "free",                       (void(*)(void))free },
+  { "mpcf_dtor_null",             (void(*)(void))mpcf_dtor_null },
+  { "(mpc_dtor_t)mpc_ast_delete", (void(*)(void))mpc_ast_delete },
+  { "mpcf_ctor_null",             (void(*)(void))mpcf_ctor_null },
+  { "mpcf_ctor_str",              (void(*)(void))mpcf_ctor_str },
+  { "mpcf_free",                  (void(*)(void))mpcf_free },
+  { "mpcf_int",                   (void(*)(void))mpcf_int },
+  { "mpcf_hex",                   (void(*)(void))mpcf_hex },
+  { "mpcf_oct",                   (void(*)(void))mpcf_oct },
+  { "mpcf_float",                 (void(*)(void))mpcf_float },
+  { "mpcf_strtriml",              (void(*)(void))mpcf_strtriml },
+  { "mpcf_strtrimr",              (void(*)(void))mpcf_strtrimr },
+  { "mpcf_strtrim",               (void(*)(void))mpcf_strtrim },
+  { "mpcf_escape",                (void(*)(void))mpcf_escape },
+  { "mpcf_escape_regex",          (void(*)(void))mpcf_escape_regex },
+  { "mpcf_escape_string_raw",     (void(*)(void))mpcf_escape_string_raw },
+  { "mpcf_escape_char_raw",       (void(*)(void))mpcf_escape_char_raw },
+  { "mpcf_unescape",              (void(*)(void))mpcf_unescape },
+  { "mpcf_unescape_regex",        (void(*)(void))mpcf_unescape_regex },
+  { "mpcf_unescape_string_raw",   (void(*)(void))mpcf_unescape_string_raw },
+  { "mpcf_unescape_char_raw",     (void(*)(void))mpcf_unescape_char_raw },
+  { "mpcf_str_ast",               (void(*)(void))mpcf_str_ast },
+  { "mpcf_null",                  (void(*)(void))mpcf_null },
+  { "mpcf_fst",                   (void(*)(void))mpcf_fst },
+  { "mpcf_snd",                   (void(*)(void))mpcf_snd },
+  { "mpcf_trd",                   (void(*)(void))mpcf_trd },
+  { "mpcf_fst_free",              (void(*)(void))mpcf_fst_free },
+  { "mpcf_snd_free",              (void(*)(void))mpcf_snd_free },
+  { "mpcf_trd_free",              (void(*)(void))mpcf_trd_free },
+  { "mpcf_strfold",               (void(*)(void))mpcf_strfold },
+  { "mpcf_maths",                 (void(*)(void))mpcf_maths },
+  { "mpcf_fold_ast",              (void(*)(void))mpcf_fold_ast },
+  { "mpcf_state_ast",             (void(*)(void))mpcf_state_ast },
+  { NULL, NULL }
+};
+
+typedef struct {
+  FILE *f;
+  const char *name;
+  int n;
+  mpc_parser_t **ps;
+  int failed;
+  mpc_parser_t **scans;
+  int scans_num;
+  mpc_parser_t *plain;
+  int label;
+} mpc_codegen_t;
+
+static void mpc_codegen_unretained(mpc_codegen_t *g, mpc_parser_t *p, int depth, int force);
+static mpc_parser_t **mpc_children(mpc_parser_t *p, int *n);
+
+static void mpc_codegen_fail(mpc_codegen_t *g, const char *what) {
+  fprintf(g->f, "/* cannot generate %s */", what);
+  g->failed = 1;
+}
+
+static void mpc_codegen_func(mpc_codegen_t *g, void (*f)(void)) {
+  int i;
+  for (i = 0; mpc_codegen_funcs[i].name; i++) {
+    if (mpc_codegen_funcs[i].f == f) {
+      fprintf(g->f, "%s", mpc_codegen_funcs[i].name);
+      return;
+    }
+  }
+  mpc_codegen_fail(g, "function");
+}
+
+static void mpc_codegen_string(mpc_codegen_t *g, const char *x) {
+  char *s = mpcf_escape_new((mpc_val_t*)x, mpc_escape_input_c, mpc_escape_output_c);
+  fprintf(g->f, "\"%s\"", s);
+  free(s);
+}
+
+static void mpc_codegen_char(mpc_codegen_t *g, char x) {
+  char buff[2];
+  char *s;
+  buff[0] = x; buff[1] = '\0';
+  s = mpcf_escape_new(buff, mpc_escape_input_c, mpc_escape_output_c);
+  fprintf(g->f, "'%s'", s);
+  free(s);
+}
+
+static void mpc_codegen_child(mpc_codegen_t *g, mpc_parser_t *p, int depth) {
+  fprintf(g->f, ",\n%*s", 2 * depth, "");
+  mpc_codegen_unretained(g, p, depth, 0);
+}
+
+/* The anchors are static, so they are written as the public parsers wrapping them */
+static int mpc_codegen_anchor(mpc_codegen_t *g, mpc_parser_t *p) {
+  
+  mpc_parser_t *q = p->data.expect.x;
+  int(*f)(char,char);
+  
+  if (q->type == MPC_TYPE_EXPECT && strcmp(q->data.expect.m, "anchor") == 0) { q = q->data.expect.x; }
+  if (q->type != MPC_TYPE_ANCHOR) { return 0; }
+  
+  f = q->data.anchor.f;
+  if (f == mpc_soi_anchor && strcmp(p->data.expect.m, "start of input") == 0) { fprintf(g->f, "mpc_soi()"); }
+  else if (f == mpc_eoi_anchor && strcmp(p->data.expect.m, "end of input") == 0) { fprintf(g->f, "mpc_eoi()"); }
+  else if (f == mpc_boundary_anchor && strcmp(p->data.expect.m, "boundary") == 0) { fprintf(g->f, "mpc_boundary()"); }
+  else { mpc_codegen_fail(g, "anchor"); }
+  
+  return 1;
+}
+
+/*
+** Token Scanners
+**
+** A token in the shape `mpca_lang` gives a regex, its
+** text made a tagged AST with the state it started at
+** and the whitespace after it skipped, is also written
+** out as a byte loop for `mpca_scan`. Every byte class
+** is a table filled in by the same tests the input
+** functions make, so the loop takes just the bytes the
+** parsers would, a NUL included. Each construct jumps
+** to the label it is given on failure, and whatever
+** catches it puts the position back.
+*/
+
+/* With `text` set the value must be the bytes matched, otherwise only what is matched counts */
+static int mpc_codegen_scannable(mpc_parser_t *p, int text) {
+  
+  int j;
+  
+  if (p->retained) { return 0; }
+  
+  switch (p->type) {
+    
+    case MPC_TYPE_ANY:
+    case MPC_TYPE_SINGLE:
+    case MPC_TYPE_RANGE:
+    case MPC_TYPE_ONEOF:
+    case MPC_TYPE_NONEOF:
+    case MPC_TYPE_STRING:
+      return 1;
+    
+    case MPC_TYPE_PASS: return !text;
+    case MPC_TYPE_LIFT: return p->data.lift.lf == mpcf_ctor_str || (!text && p->data.lift.lf == mpcf_ctor_null);
+    
+    case MPC_TYPE_EXPECT: return mpc_codegen_scannable(p->data.expect.x, text);
+    case MPC_TYPE_APPLY:  return !text && p->data.apply.f == mpcf_free && mpc_codegen_scannable(p->data.apply.x, 0);
+    
+    case MPC_TYPE_MAYBE:
+      return (p->data.not.lf == mpcf_ctor_str || (!text && p->data.not.lf == mpcf_ctor_null))
+        && mpc_codegen_scannable(p->data.not.x, text);
+    
+    case MPC_TYPE_MANY:
+    case MPC_TYPE_MANY1:
+    case MPC_TYPE_COUNT:
+      return p->data.repeat.f == mpcf_strfold && mpc_codegen_scannable(p->data.repeat.x, text);
+    
+    case MPC_TYPE_OR:
+      for (j = 0; j < p->data.or.n; j++) {
+        if (!mpc_codegen_scannable(p->data.or.xs[j], text)) { return 0; }
+      }
+      return p->data.or.n > 0;
+    
+    case MPC_TYPE_AND:
+      if (p->data.and.f != mpcf_strfold) { return 0; }
+      for (j = 0; j < p->data.and.n; j++) {
+        if (!mpc_codegen_scannable(p->data.and.xs[j], text)) { return 0; }
+      }
+      return 1;
+    
+    default: return 0;
+  }
+  
+}
+
+/* The tag of a token, which is the text `r` followed by `w`, or NULL */
+static const char *mpc_codegen_token(mpc_parser_t *p, mpc_parser_t **r, mpc_parser_t **w) {
+  
+  const char *t;
+  
+  if (p->type != MPC_TYPE_AND || p->data.and.n != 2 || p->data.and.f != mpcf_state_ast
+  ||  p->data.and.xs[0]->type != MPC_TYPE_STATE) { return NULL; }
+  
+  p = p->data.and.xs[1];
+  if (p->retained || p->type != MPC_TYPE_APPLY_TO
+  ||  p->data.apply_to.f != (mpc_apply_to_t)mpc_ast_tag) { return NULL; }
+  t = p->data.apply_to.d;
+  
+  p = p->data.apply_to.x;
+  if (p->retained || p->type != MPC_TYPE_APPLY || p->data.apply.f != mpcf_str_ast) { return NULL; }
+  
+  p = p->data.apply.x;
+  if (p->retained || p->type != MPC_TYPE_AND || p->data.and.n != 2 || p->data.and.f != mpcf_fst) { return NULL; }
+  
+  *r = p->data.and.xs[0];
+  *w = p->data.and.xs[1];
+  return mpc_codegen_scannable(*r, 1) && mpc_codegen_scannable(*w, 0) ? t : NULL;
+}
+
+/* Whether the code for a parser jumps to its failure label */
+static int mpc_codegen_can_fail(mpc_parser_t *p) {
+  
+  int j;
+  
+  switch (p->type) {
+    case MPC_TYPE_STRING:   return p->data.string.x[0] != '\0';
+    case MPC_TYPE_PASS:
+    case MPC_TYPE_LIFT:
+    case MPC_TYPE_MAYBE:
+    case MPC_TYPE_MANY:     return 0;
+    case MPC_TYPE_EXPECT:   return mpc_codegen_can_fail(p->data.expect.x);
+    case MPC_TYPE_APPLY:    return mpc_codegen_can_fail(p->data.apply.x);
+    case MPC_TYPE_MANY1:
+    case MPC_TYPE_COUNT:    return mpc_codegen_can_fail(p->data.repeat.x);
+    case MPC_TYPE_OR:       return mpc_codegen_can_fail(p->data.or.xs[p->data.or.n-1]);
+    case MPC_TYPE_AND:
+      for (j = 0; j < p->data.and.n; j++) {
+        if (mpc_codegen_can_fail(p->data.and.xs[j])) { return 1; }
+      }
+      return 0;
+    default:                return 1;
+  }
+  
+}
+
+/* The bytes a single byte parser takes, if it is one */
+static int mpc_codegen_class(mpc_parser_t *p, unsigned char *s) {
+  
+  int c, in;
+  
+  while (p->type == MPC_TYPE_EXPECT) { p = p->data.expect.x; }
+  
+  memset(s, 0, 32);
+  for (c = 0; c < 256; c++) {
+    switch (p->type) {
+      case MPC_TYPE_ANY:    in = 1; break;
+      case MPC_TYPE_SINGLE: in = (char)c == p->data.single.x; break;
+      case MPC_TYPE_RANGE:  in = (char)c >= p->data.range.x && (char)c <= p->data.range.y; break;
+      case MPC_TYPE_ONEOF:  in = strchr(p->data.string.x, (char)c) != 0; break;
+      case MPC_TYPE_NONEOF: in = strchr(p->data.string.x, (char)c) == 0; break;
+      default: return 0;
+    }
+    if (in) { s[c >> 3] |= (unsigned char)(1 << (c & 7)); }
+  }
+  
+  return 1;
+}
+
+static void mpc_codegen_table(mpc_codegen_t *g, const unsigned char *s, int depth) {
+  int j;
+  fprintf(g->f, "%*sstatic const unsigned char k[32] = {", 2 * depth, "");
+  for (j = 0; j < 32; j++) { fprintf(g->f, "%s0x%02x", j ? "," : "", s[j]); }
+  fprintf(g->f, "};\n");
+}
+
+static void mpc_codegen_match(mpc_codegen_t *g, mpc_parser_t *p, int fail, int depth) {
+  
+  int j, k, d;
+  unsigned char s[32];
+  
+  if (mpc_codegen_class(p, s)) {
+    fprintf(g->f, "%*s{\n", 2 * depth, "");
+    mpc_codegen_table(g, s, depth + 1);
+    fprintf(g->f, "%*sif (c == e || !(k[*c >> 3] >> (*c & 7) & 1)) { goto f%i; }\n", 2 * (depth + 1), "", fail);
+    fprintf(g->f, "%*sc++;\n", 2 * (depth + 1), "");
+    fprintf(g->f, "%*s}\n", 2 * depth, "");
+    return;
+  }
+  
+  switch (p->type) {
+    
+    case MPC_TYPE_EXPECT: mpc_codegen_match(g, p->data.expect.x, fail, depth); break;
+    case MPC_TYPE_APPLY:  mpc_codegen_match(g, p->data.apply.x, fail, depth); break;
+    
+    case MPC_TYPE_STRING:
+      if (!mpc_codegen_can_fail(p)) { break; }
+      k = (int)strlen(p->data.string.x);
+      fprintf(g->f, "%*sif (e - c < %i || memcmp(c, ", 2 * depth, "", k);
+      mpc_codegen_string(g, p->data.string.x);
+      fprintf(g->f, ", %i) != 0) { goto f%i; }\n", k, fail);
+      fprintf(g->f, "%*sc += %i;\n", 2 * depth, "", k);
+      break;
+    
+    case MPC_TYPE_MAYBE:
+      if (!mpc_codegen_can_fail(p->data.not.x)) {
+        mpc_codegen_match(g, p->data.not.x, fail, depth);
+        break;
+      }
+      k = ++g->label;
+      fprintf(g->f, "%*s{\n", 2 * depth, "");
+      fprintf(g->f, "%*sconst unsigned char *b%i = c;\n", 2 * (depth + 1), "", k);
+      mpc_codegen_match(g, p->data.not.x, k, depth + 1);
+      fprintf(g->f, "%*sgoto d%i;\n", 2 * (depth + 1), "", k);
+      fprintf(g->f, "%*sf%i: c = b%i;\n", 2 * (depth + 1), "", k, k);
+      fprintf(g->f, "%*sd%i: ;\n", 2 * (depth + 1), "", k);
+      fprintf(g->f, "%*s}\n", 2 * depth, "");
+      break;
+    
+    case MPC_TYPE_MANY1:
+      mpc_codegen_match(g, p->data.repeat.x, fail, depth);
+      /* fallthrough */
+    case MPC_TYPE_MANY:
+      /* A run of one byte class is a plain loop */
+      if (mpc_codegen_class(p->data.repeat.x, s)) {
+        fprintf(g->f, "%*s{\n", 2 * depth, "");
+        mpc_codegen_table(g, s, depth + 1);
+        fprintf(g->f, "%*swhile (c < e && k[*c >> 3] >> (*c & 7) & 1) { c++; }\n", 2 * (depth + 1), "");
+        fprintf(g->f, "%*s}\n", 2 * depth, "");
+        break;
+      }
+      k = ++g->label;
+      fprintf(g->f, "%*sfor (;;) {\n", 2 * depth, "");
+      fprintf(g->f, "%*sconst unsigned char *b%i = c;\n", 2 * (depth + 1), "", k);
+      mpc_codegen_match(g, p->data.repeat.x, k, depth + 1);
+      fprintf(g->f, "%*sif (c == b%i) { break; }\n", 2 * (depth + 1), "", k);
+      if (mpc_codegen_can_fail(p->data.repeat.x)) {
+        fprintf(g->f, "%*scontinue;\n", 2 * (depth + 1), "");
+        fprintf(g->f, "%*sf%i: c = b%i;\n", 2 * (depth + 1), "", k, k);
+        fprintf(g->f, "%*sbreak;\n", 2 * (depth + 1), "");
+      }
+      fprintf(g->f, "%*s}\n", 2 * depth, "");
+      break;
+    
+    case MPC_TYPE_COUNT:
+      k = ++g->label;
+      fprintf(g->f, "%*s{\n", 2 * depth, "");
+      fprintf(g->f, "%*sint n%i;\n", 2 * (depth + 1), "", k);
+      fprintf(g->f, "%*sfor (n%i = 0; n%i < %i; n%i++) {\n", 2 * (depth + 1), "", k, k, p->data.repeat.n, k);
+      mpc_codegen_match(g, p->data.repeat.x, fail, depth + 2);
+      fprintf(g->f, "%*s}\n", 2 * (depth + 1), "");
+      fprintf(g->f, "%*s}\n", 2 * depth, "");
+      break;
+    
+    /* The last alternative fails as the whole */
+    case MPC_TYPE_OR:
+      d = ++g->label;
+      fprintf(g->f, "%*s{\n", 2 * depth, "");
+      fprintf(g->f, "%*sconst unsigned char *b%i = c;\n", 2 * (depth + 1), "", d);
+      for (j = 0; j < p->data.or.n - 1; j++) {
+        k = ++g->label;
+        mpc_codegen_match(g, p->data.or.xs[j], k, depth + 1);
+        fprintf(g->f, "%*sgoto d%i;\n", 2 * (depth + 1), "", d);
+        if (mpc_codegen_can_fail(p->data.or.xs[j])) {
+          fprintf(g->f, "%*sf%i: c = b%i;\n", 2 * (depth + 1), "", k, d);
+        }
+      }
+      mpc_codegen_match(g, p->data.or.xs[j], fail, depth + 1);
+      if (p->data.or.n > 1) { fprintf(g->f, "%*sd%i: ;\n", 2 * (depth + 1), "", d); }
+      else { fprintf(g->f, "%*s(void)b%i;\n", 2 * (depth + 1), "", d); }
+      fprintf(g->f, "%*s}\n", 2 * depth, "");
+      break;
+    
+    case MPC_TYPE_AND:
+      for (j = 0; j < p->data.and.n; j++) { mpc_codegen_match(g, p->data.and.xs[j], fail, depth); }
+      break;
+    
+    default: break;
+  }
+  
+}
+
+static void mpc_codegen_scans(mpc_codegen_t *g, mpc_parser_t *p, int force) {
+  
+  int j, n;
+  mpc_parser_t **xs, *r, *w;
+  
+  if (p->retained && !force) { return; }
+  
+  if (mpc_codegen_token(p, &r, &w)) {
+    
+    g->scans = realloc(g->scans, sizeof(mpc_parser_t*) * (g->scans_num + 1));
+    g->scans[g->scans_num] = p;
+    
+    if (p->retained) { fprintf(g->f, "/* <%s> */\n", p->name); }
+    fprintf(g->f, "static long %s_scan%i(const char *s, long n, long *len) {\n\n", g->name, g->scans_num);
+    fprintf(g->f, "  const unsigned char *c = (const unsigned char*)s, *e = c + n;\n\n");
+    mpc_codegen_match(g, r, 0, 1);
+    fprintf(g->f, "  *len = (long)(c - (const unsigned char*)s);\n");
+    mpc_codegen_match(g, w, 0, 1);
+    fprintf(g->f, "  return (long)(c - (const unsigned char*)s);\n");
+    if (mpc_codegen_can_fail(r) || mpc_codegen_can_fail(w)) {
+      fprintf(g->f, "\n  f0: return -1;\n");
+    }
+    fprintf(g->f, "\n}\n\n");
+    
+    g->scans_num++;
+    return;
+  }
+  
+  xs = mpc_children(p, &n);
+  for (j = 0; j < n; j++) { mpc_codegen_scans(g, xs[j], 0); }
+}
+
+static void mpc_codegen_unretained(mpc_codegen_t *g, mpc_parser_t *p, int depth, int force) {
+  
+  int i;
+  mpc_parser_t *r, *w;
+  
+  if (p->retained && !force) {
+    for (i = 0; i < g->n; i++) {
+      if (g->ps[i] == p) { fprintf(g->f, "%s", p->name); return; }
+    }
+    mpc_codegen_fail(g, "reference to a parser outside the grammar");
+    return;
+  }
+  
+  /* A token goes through its scanner, around the parsers it stands in for */
+  for (i = 0; i < g->scans_num && p != g->plain; i++) {
+    if (g->scans[i] != p) { continue; }
+    fprintf(g->f, "mpca_scan(%s_scan%i, ", g->name, i);
+    mpc_codegen_string(g, mpc_codegen_token(p, &r, &w));
+    fprintf(g->f, ",\n%*s", 2 * (depth + 1), "");
+    g->plain = p;
+    mpc_codegen_unretained(g, p, depth + 1, force);
+    g->plain = NULL;
+    fprintf(g->f, ")");
+    return;
+  }
+  
+  switch (p->type) {
+    
+    case MPC_TYPE_PASS:  fprintf(g->f, "mpc_pass()"); break;
+    case MPC_TYPE_FAIL:  fprintf(g->f, "mpc_fail("); mpc_codegen_string(g, p->data.fail.m); fprintf(g->f, ")"); break;
+    case MPC_TYPE_LIFT:  fprintf(g->f, "mpc_lift("); mpc_codegen_func(g, (void(*)(void))p->data.lift.lf); fprintf(g->f, ")"); break;
+    case MPC_TYPE_STATE: fprintf(g->f, "mpc_state()"); break;
+    case MPC_TYPE_ANY:   fprintf(g->f, "mpc_any()"); break;
+    
+    case MPC_TYPE_SINGLE: fprintf(g->f, "mpc_char("); mpc_codegen_char(g, p->data.single.x); fprintf(g->f, ")"); break;
+    case MPC_TYPE_ONEOF:  fprintf(g->f, "mpc_oneof("); mpc_codegen_string(g, p->data.string.x); fprintf(g->f, ")"); break;
+    case MPC_TYPE_NONEOF: fprintf(g->f, "mpc_noneof("); mpc_codegen_string(g, p->data.string.x); fprintf(g->f, ")"); break;
+    case MPC_TYPE_STRING: fprintf(g->f, "mpc_string("); mpc_codegen_string(g, p->data.string.x); fprintf(g->f, ")"); break;
+    case MPC_TYPE_RANGE:
+      fprintf(g->f, "mpc_range(");
+      mpc_codegen_char(g, p->data.range.x);
+      fprintf(g->f, ", ");
+      mpc_codegen_char(g, p->data.range.y);
+      fprintf(g->f, ")");
+      break;
+    
+    case MPC_TYPE_EXPECT:
+      if (mpc_codegen_anchor(g, p)) { break; }
+      fprintf(g->f, "mpc_expect(");
+      mpc_codegen_unretained(g, p->data.expect.x, depth, 0);
+      fprintf(g->f, ", ");
+      mpc_codegen_string(g, p->data.expect.m);
+      fprintf(g->f, ")");
+      break;
+    
+    case MPC_TYPE_APPLY:
+      if (p->data.apply.f == (mpc_apply_t)mpc_ast_add_root) {
+        fprintf(g->f, "mpca_root(");
+        mpc_codegen_unretained(g, p->data.apply.x, depth, 0);
+      } else {
+        fprintf(g->f, "mpc_apply(");
+        mpc_codegen_unretained(g, p->data.apply.x, depth, 0);
+        fprintf(g->f, ", ");
+        mpc_codegen_func(g, (void(*)(void))p->data.apply.f);
+      }
+      fprintf(g->f, ")");
+      break;
+    
+    /* Only tags can be written out, any other data is opaque */
+    case MPC_TYPE_APPLY_TO:
+      if (p->data.apply_to.f == (mpc_apply_to_t)mpc_ast_tag) {
+        fprintf(g->f, "mpca_tag(");
+      } else if (p->data.apply_to.f == (mpc_apply_to_t)mpc_ast_add_tag) {
+        fprintf(g->f, "mpca_add_tag(");
+      } else {
+        mpc_codegen_fail(g, "apply_to");
+        break;
+      }
+      mpc_codegen_unretained(g, p->data.apply_to.x, depth, 0);
+      fprintf(g->f, ", ");
+      mpc_codegen_string(g, (const char*)p->data.apply_to.d);
+      fprintf(g->f, ")");
+      break;
+    
+    case MPC_TYPE_PREDICT:
+      fprintf(g->f, "mpc_predictive(");
+      mpc_codegen_unretained(g, p->data.predict.x, depth, 0);
+      fprintf(g->f, ")");
+      break;
+    
+    case MPC_TYPE_NOT:
+      fprintf(g->f, "mpc_not_lift(");
+      mpc_codegen_unretained(g, p->data.not.x, depth, 0);
+      fprintf(g->f, ", ");
+      mpc_codegen_func(g, (void(*)(void))p->data.not.dx);
+      fprintf(g->f, ", ");
+      mpc_codegen_func(g, (void(*)(void))p->data.not.lf);
+      fprintf(g->f, ")");
+      break;
+    
+    case MPC_TYPE_MAYBE:
+      fprintf(g->f, "mpc_maybe_lift(");
+      mpc_codegen_unretained(g, p->data.not.x, depth, 0);
+      fprintf(g->f, ", ");
+      mpc_codegen_func(g, (void(*)(void))p->data.not.lf);
+      fprintf(g->f, ")");
+      break;
+    
+    case MPC_TYPE_MANY:
+    case MPC_TYPE_MANY1:
+      fprintf(g->f, p->type == MPC_TYPE_MANY ? "mpc_many(" : "mpc_many1(");
+      mpc_codegen_func(g, (void(*)(void))p->data.repeat.f);
+      mpc_codegen_child(g, p->data.repeat.x, depth + 1);
+      fprintf(g->f, ")");
+      break;
+    
+    case MPC_TYPE_COUNT:
+      fprintf(g->f, "mpc_count(%i, ", p->data.repeat.n);
+      mpc_codegen_func(g, (void(*)(void))p->data.repeat.f);
+      mpc_codegen_child(g, p->data.repeat.x, depth + 1);
+      fprintf(g->f, ", ");
+      mpc_codegen_func(g, (void(*)(void))p->data.repeat.dx);
+      fprintf(g->f, ")");
+      break;
+    
+    case MPC_TYPE_OR:
+      fprintf(g->f, "mpc_or(%i", p->data.or.n);
+      for (i = 0; i < p->data.or.n; i++) { mpc_codegen_child(g, p->data.or.xs[i], depth + 1); }
+      fprintf(g->f, ")");
+      break;
+    
+    case MPC_TYPE_AND:
+      fprintf(g->f, "mpc_and(%i, ", p->data.and.n);
+      mpc_codegen_func(g, (void(*)(void))p->data.and.f);
+      for (i = 0; i < p->data.and.n; i++) { mpc_codegen_child(g, p->data.and.xs[i], depth + 1); }
+      for (i = 0; i < p->data.and.n-1; i++) {
+        fprintf(g->f, ", ");
+        mpc_codegen_func(g, (void(*)(void))p->data.and.dxs[i]);
+      }
+      fprintf(g->f, ")");
+      break;
+    
+    case MPC_TYPE_ANCHOR:   mpc_codegen_fail(g, "anchor"); break;
+    case MPC_TYPE_LIFT_VAL: mpc_codegen_fail(g, "lift_val"); break;
+    case MPC_TYPE_SCAN:     mpc_codegen_fail(g, "scan"); break;
+    case MPC_TYPE_SATISFY:  mpc_codegen_fail(g, "satisfy"); break;
+    default:                mpc_codegen_fail(g, "undefined parser"); break;
+  }
+  
+}
+
+int mpc_codegen(FILE *f, const char *name, int n, mpc_parser_t **ps) {
+  
+  int i;
+  mpc_codegen_t g;
+  
+  g.f = f;
+  g.name = name;
+  g.n = n;
+  g.ps = ps;
+  g.failed = 0;
+  g.scans = NULL;
+  g.scans_num = 0;
+  g.plain = NULL;
+  g.label = 0;
+  
+  for (i = 0; i < n; i++) { mpc_codegen_scans(&g, ps[i], 1); }
+  
+  fprintf(f, "static void %s(", name);
+  for (i = 0; i < n; i++) { fprintf(f, "%smpc_parser_t *%s", i ? ", " : "", ps[i]->name); }
+  fprintf(f, ") {\n\n");
+  
+  fprintf(f, "  mpc_parser_t *ps[%i];\n\n", n);
+  
+  for (i = 0; i < n; i++) {
+    fprintf(f, "  mpc_define(%s, ", ps[i]->name);
+    mpc_codegen_unretained(&g, ps[i], 2, 1);
+    fprintf(f, ");\n\n");
+  }
+  
+  /* Fused parsers are written out as their parts, so fusion runs again on loading */
+  for (i = 0; i < n; i++) { fprintf(f, "  mpc_optimise(%s);\n", ps[i]->name); }
+  fprintf(f, "\n");
+  
+  for (i = 0; i < n; i++) { fprintf(f, "  ps[%i] = %s;\n", i, ps[i]->name); }
+  fprintf(f, "  mpc_analyse_grammar(%i, ps);\n\n", n);
+  fprintf(f, "}\n");
+  
+  free(g.scans);
+  return !g.failed;
+}
+
+/*
+** Grammar Analysis
+**
+** Computes FIRST, nullable and FOLLOW for every
+** parser reachable from the given roots by
+** iterating to a fixed point, then gives each
+** `or` a dispatch table. Parsers whose behaviour
+** is opaque - `satisfy` and undefined ones - are
+** assumed to start with anything.
+**
+** Returns whether the grammar is LL(1) in the
+** sense that matters here: that running it with
+** backtracking disabled cannot change the result.
+** That holds when no parser which may fail after
+** consuming input shares a first byte with an
+** alternative, or repetition exit, that would be
+** tried after it.
+*/
+
+typedef struct {
+  mpc_parser_t **xs;
+  int n;
+  int slots;
+} mpc_nodes_t;
+
+static unsigned long mpc_analyse_pass = 0;
+
+static void mpc_set_add(unsigned char *s, int c) {
+  s[c >> 3] |= (unsigned char)(1 << (c & 7));
+}
+
+static int mpc_set_union(unsigned char *s, const unsigned char *t) {
+  int k, changed = 0;
+  for (k = 0; k < 32; k++) {
+    if ((s[k] | t[k]) != s[k]) { s[k] |= t[k]; changed = 1; }
+  }
+  return changed;
+}
+
+/*
+** Byte zero is left out. `oneof` and friends accept a
+** NUL byte through `strchr` and end of input reads as
+** one too, so counting it would rule out nearly every
+** grammar, while mpc already treats an embedded NUL as
+** the end of input in its anchors.
+*/
+
+static int mpc_set_overlaps(const unsigned char *s, const unsigned char *t) {
+  int k;
+  if ((s[0] & t[0]) & ~1) { return 1; }
+  for (k = 1; k < 32; k++) {
+    if (s[k] & t[k]) { return 1; }
+  }
+  return 0;
+}
+
+static mpc_parser_t **mpc_children(mpc_parser_t *p, int *n) {
+  switch (p->type) {
+    case MPC_TYPE_EXPECT:   *n = 1; return &p->data.expect.x;
+    case MPC_TYPE_APPLY:    *n = 1; return &p->data.apply.x;
+    case MPC_TYPE_APPLY_TO: *n = 1; return &p->data.apply_to.x;
+    case MPC_TYPE_PREDICT:  *n = 1; return &p->data.predict.x;
+    case MPC_TYPE_SCAN:     *n = 1; return &p->data.scan.x;
+    case MPC_TYPE_NOT:
+    case MPC_TYPE_MAYBE:    *n = 1; return &p->data.not.x;
+    case MPC_TYPE_MANY:
+    case MPC_TYPE_MANY1:
+    case MPC_TYPE_COUNT:    *n = 1; return &p->data.repeat.x;
+    case MPC_TYPE_OR:       *n = p->data.or.n;  return p->data.or.xs;
+    case MPC_TYPE_AND:      *n = p->data.and.n; return p->data.and.xs;
+    default:                *n = 0; return NULL;
+  }
+}
+
+static void mpc_analyse_collect(mpc_parser_t *p, mpc_nodes_t *ns) {
+  
+  int j, n;
+  mpc_parser_t **xs;
+  
+  if (p->first == NULL) {
+    p->first = calloc(1, sizeof(mpc_first_t));
+  } else if (p->first->pass == mpc_analyse_pass) {
+    return;
+  } else {
+    free(p->first->dispatch);
+    memset(p->first, 0, sizeof(mpc_first_t));
+  }
+  
+  p->first->pass = mpc_analyse_pass;
+  p->first->generation = mpc_generation;
+  
+  if (ns->n == ns->slots) {
+    ns->slots = ns->slots ? ns->slots * 2 : 64;
+    ns->xs = realloc(ns->xs, sizeof(mpc_parser_t*) * ns->slots);
+  }
+  ns->xs[ns->n++] = p;
+  
+  xs = mpc_children(p, &n);
+  for (j = 0; j < n; j++) { mpc_analyse_collect(xs[j], ns); }
+}
+
+static void mpc_analyse_leaf(mpc_parser_t *p) {
+  
+  int c;
+  mpc_first_t *f = p->first;
+  
+  switch (p->type) {
+    
+    case MPC_TYPE_UNDEFINED:
+      memset(f->first, 0xFF, sizeof(f->first));
+      f->nullable = 1;
+      break;
+    
+    case MPC_TYPE_ANY:
+    case MPC_TYPE_SATISFY:
+      memset(f->first, 0xFF, sizeof(f->first));
+      break;
+    
+    case MPC_TYPE_SINGLE:
+      mpc_set_add(f->first, (unsigned char)p->data.single.x);
+      break;
+    
+    /* Same comparisons as the input functions so signedness agrees */
+    case MPC_TYPE_RANGE:
+      for (c = 0; c < 256; c++) {
+        if ((char)c >= p->data.range.x && (char)c <= p->data.range.y) { mpc_set_add(f->first, c); }
+      }
+      break;
+    
+    case MPC_TYPE_ONEOF:
+      for (c = 0; c < 256; c++) {
+        if (strchr(p->data.string.x, (char)c) != 0) { mpc_set_add(f->first, c); }
+      }
+      break;
+    
+    case MPC_TYPE_NONEOF:
+      for (c = 0; c < 256; c++) {
+        if (strchr(p->data.string.x, (char)c) == 0) { mpc_set_add(f->first, c); }
+      }
+      break;
+    
+    case MPC_TYPE_STRING:
+      if (p->data.string.x[0]) {
+        mpc_set_add(f->first, (unsigned char)p->data.string.x[0]);
+      } else {
+        f->nullable = 1;
+      }
+      break;
+    
+    /* End of input only matches where the next byte reads as zero */
+    case MPC_TYPE_ANCHOR:
+      if (p->data.anchor.f == mpc_eoi_anchor) {
+        mpc_set_add(f->first, 0);
+      } else {
+        f->nullable = 1;
+      }
+      break;
+    
+    case MPC_TYPE_PASS:
+    case MPC_TYPE_LIFT:
+    case MPC_TYPE_LIFT_VAL:
+    case MPC_TYPE_STATE:
+    case MPC_TYPE_NOT:
+      f->nullable = 1;
+      break;
+    
+    case MPC_TYPE_MAYBE:
+    case MPC_TYPE_MANY:
+      f->nullable = 1;
+      break;
+    
+    case MPC_TYPE_COUNT:
+      f->nullable = p->data.repeat.n == 0;
+      break;
+    
+    default: break;
+  }
+  
+}
+
+static int mpc_analyse_first(mpc_parser_t *p) {
+  
+  int j, n, changed = 0;
+  mpc_parser_t **xs = mpc_children(p, &n);
+  mpc_first_t *f = p->first;
+  char nullable = f->nullable;
+  
+  switch (p->type) {
+    
+    case MPC_TYPE_EXPECT:
+    case MPC_TYPE_APPLY:
+    case MPC_TYPE_APPLY_TO:
+    case MPC_TYPE_PREDICT:
+    case MPC_TYPE_SCAN:
+    case MPC_TYPE_MANY1:
+    case MPC_TYPE_COUNT:
+      changed |= mpc_set_union(f->first, xs[0]->first->first);
+      nullable |= xs[0]->first->nullable;
+      break;
+    
+    case MPC_TYPE_MAYBE:
+    case MPC_TYPE_MANY:
+      changed |= mpc_set_union(f->first, xs[0]->first->first);
+      break;
+    
+    case MPC_TYPE_OR:
+      for (j = 0; j < n; j++) {
+        changed |= mpc_set_union(f->first, xs[j]->first->first);
+        nullable |= xs[j]->first->nullable;
+      }
+      break;
+    
+    case MPC_TYPE_AND:
+      for (j = 0; j < n; j++) {
+        changed |= mpc_set_union(f->first, xs[j]->first->first);
+        if (!xs[j]->first->nullable) { break; }
+      }
+      if (j == n) { nullable = 1; }
+      break;
+    
+    default: break;
+  }
+  
+  if (nullable != f->nullable) {
+    f->nullable = nullable;
+    changed = 1;
+  }
+  
+  return changed;
+}
+
+static int mpc_analyse_follow(mpc_parser_t *p) {
+  
+  int j, n, changed = 0;
+  unsigned char tail[32];
+  mpc_parser_t **xs = mpc_children(p, &n);
+  mpc_first_t *f = p->first;
+  
+  switch (p->type) {
+    
+    case MPC_TYPE_MANY:
+    case MPC_TYPE_MANY1:
+    case MPC_TYPE_COUNT:
+      changed |= mpc_set_union(xs[0]->first->follow, xs[0]->first->first);
+      changed |= mpc_set_union(xs[0]->first->follow, f->follow);
+      break;
+    
+    case MPC_TYPE_AND:
+      memcpy(tail, f->follow, sizeof(tail));
+      for (j = n-1; j >= 0; j--) {
+        changed |= mpc_set_union(xs[j]->first->follow, tail);
+        if (!xs[j]->first->nullable) { memset(tail, 0, sizeof(tail)); }
+        mpc_set_union(tail, xs[j]->first->first);
+      }
+      break;
+    
+    default:
+      for (j = 0; j < n; j++) {
+        changed |= mpc_set_union(xs[j]->first->follow, f->follow);
+      }
+      break;
+  }
+  
+  return changed;
+}
+
+/* Whether a parser is sure not to consume input when it fails */
+static int mpc_analyse_atomic(mpc_parser_t *p, int depth) {
+  
+  int j, n;
+  mpc_parser_t **xs = mpc_children(p, &n);
+  
+  if (depth > 32) { return 0; }
+  
+  switch (p->type) {
+    
+    case MPC_TYPE_UNDEFINED:
+    case MPC_TYPE_NOT:
+    case MPC_TYPE_COUNT:
+    case MPC_TYPE_AND:
+      return 0;
+    
+    case MPC_TYPE_STRING:
+      return strlen(p->data.string.x) <= 1;
+    
+    case MPC_TYPE_EXPECT:
+    case MPC_TYPE_APPLY:
+    case MPC_TYPE_APPLY_TO:
+    case MPC_TYPE_PREDICT:
+    case MPC_TYPE_SCAN:
+    case MPC_TYPE_MAYBE:
+    case MPC_TYPE_MANY:
+    case MPC_TYPE_MANY1:
+    case MPC_TYPE_OR:
+      for (j = 0; j < n; j++) {
+        if (!mpc_analyse_atomic(xs[j], depth+1)) { return 0; }
+      }
+      return 1;
+    
+    default:
+      return 1;
+  }
+  
+}
+
+static int mpc_analyse_ll1(mpc_parser_t *p) {
+  
+  int j, k, n;
+  mpc_parser_t **xs = mpc_children(p, &n);
+  
+  switch (p->type) {
+    
+    case MPC_TYPE_UNDEFINED:
+    case MPC_TYPE_NOT:
+      return 0;
+    
+    case MPC_TYPE_MAYBE:
+    case MPC_TYPE_MANY:
+    case MPC_TYPE_MANY1:
+      return mpc_analyse_atomic(xs[0], 0)
+         || !mpc_set_overlaps(xs[0]->first->first, p->first->follow);
+    
+    case MPC_TYPE_OR:
+      for (j = 0; j < n; j++) {
+        if (mpc_analyse_atomic(xs[j], 0)) { continue; }
+        for (k = j+1; k < n; k++) {
+          if (mpc_set_overlaps(xs[j]->first->first, xs[k]->first->first)) { return 0; }
+          if (xs[k]->first->nullable
+          &&  mpc_set_overlaps(xs[j]->first->first, p->first->follow)) { return 0; }
+        }
+      }
+      return 1;
+    
+    default:
+      return 1;
+  }
+  
+}
+
+static void mpc_analyse_dispatch(mpc_parser_t *p) {
+  
+  int c, j;
+  
+  if (p->type != MPC_TYPE_OR || p->data.or.n >= 255) { return; }
+  
+  p->first->dispatch = malloc(256);
+  for (c = 0; c < 256; c++) {
+    for (j = 0; j < p->data.or.n; j++) {
+      if (mpc_first_viable(p->data.or.xs[j], c)) { break; }
+    }
+    p->first->dispatch[c] = (unsigned char)j;
+  }
+  
+}
+
+static int mpc_analyse(mpc_parser_t **ps, int n) {
+  
+  int j, changed, ll1 = 1;
+  mpc_nodes_t ns;
+  
+  ns.xs = NULL;
+  ns.n = 0;
+  ns.slots = 0;
+  
+  mpc_analyse_pass++;
+  for (j = 0; j < n; j++) { mpc_analyse_collect(ps[j], &ns); }
+  
+  for (j = 0; j < ns.n; j++) { mpc_analyse_leaf(ns.xs[j]); }
+  do {
+    changed = 0;
+    for (j = 0; j < ns.n; j++) { changed |= mpc_analyse_first(ns.xs[j]); }
+  } while (changed);
+  
+  /* A root may be used on its own, followed by anything */
+  for (j = 0; j < n; j++) { memset(ps[j]->first->follow, 0xFF, 32); }
+  do {
+    changed = 0;
+    for (j = 0; j < ns.n; j++) { changed |= mpc_analyse_follow(ns.xs[j]); }
+  } while (changed);
+  
+  for (j = 0; j < ns.n; j++) {
+    if (ll1 && !mpc_analyse_ll1(ns.xs[j])) { ll1 = 0; }
+    mpc_analyse_dispatch(ns.xs[j]);
+  }
+  
+  free(ns.xs);
+  return ll1;
+}
+
+void mpc_analyse_grammar(int n, mpc_parser_t **ps) {
+  mpc_analyse(ps, n);
+}
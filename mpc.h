@@ -50,6 +50,35 @@ char *mpc_err_string(mpc_err_t *e);
 void mpc_err_print(mpc_err_t *e);
 void mpc_err_print_to(mpc_err_t *e, FILE *f);
 
+/*
+** Arena
+*/
+
+struct mpc_arena_t;
+typedef struct mpc_arena_t mpc_arena_t;
+
+mpc_arena_t *mpc_arena_new(void);
+void mpc_arena_clear(mpc_arena_t *a);
+void mpc_arena_delete(mpc_arena_t *a);
+void *mpc_arena_alloc(mpc_arena_t *a, size_t n);
+
+/*
+** Memory Statistics
+**
+** Totals over every finished parse of how many
+** values were allocated, how many of those missed
+** the small-block pools and went to `malloc`, and
+** how many extra pool slabs had to be added.
+*/
+
+typedef struct {
+  unsigned long allocs;
+  unsigned long fallbacks;
+  unsigned long slabs;
+} mpc_mem_stats_t;
+
+void mpc_mem_stats(mpc_mem_stats_t *s);
+
 /*
 ** Parsing
 */
@@ -64,12 +93,96 @@ typedef union {
 struct mpc_parser_t;
 typedef struct mpc_parser_t mpc_parser_t;
 
+/*
+** Parsing only reads the parsers, so once a grammar is
+** built any number of threads may parse with it at the
+** same time. Nothing may define, undefine, optimise or
+** delete its parsers meanwhile, and an arena or stream
+** must only be used by one thread at a time.
+*/
+
 int mpc_parse(const char *filename, const char *string, mpc_parser_t *p, mpc_result_t *r);
 int mpc_nparse(const char *filename, const char *string, size_t length, mpc_parser_t *p, mpc_result_t *r);
 int mpc_parse_file(const char *filename, FILE *file, mpc_parser_t *p, mpc_result_t *r);
 int mpc_parse_pipe(const char *filename, FILE *pipe, mpc_parser_t *p, mpc_result_t *r);
 int mpc_parse_contents(const char *filename, mpc_parser_t *p, mpc_result_t *r);
 
+/*
+** The `_arena` variants place the whole AST built by
+** the `mpca` combinators into the given arena. Release
+** it with `mpc_arena_clear` or `mpc_arena_delete` and
+** never call `mpc_ast_delete` on such a tree.
+*/
+
+int mpc_parse_arena(const char *filename, const char *string, mpc_parser_t *p, mpc_arena_t *a, mpc_result_t *r);
+int mpc_parse_contents_arena(const char *filename, mpc_parser_t *p, mpc_arena_t *a, mpc_result_t *r);
+
+/*
+** The `_view` variants go further and do not copy
+** token text at all. Each `contents` points into the
+** input with its length in `contents_len` and is not
+** null terminated. The input must outlive the AST, so
+** `mpc_parse_contents_view` reads the file into the
+** arena. Only the `mpca` combinators and `mpcf_strfold`
+** understand view values - other callbacks will not.
+*/
+
+int mpc_parse_view(const char *filename, const char *string, long length, mpc_parser_t *p, mpc_arena_t *a, mpc_result_t *r);
+int mpc_parse_contents_view(const char *filename, mpc_parser_t *p, mpc_arena_t *a, mpc_result_t *r);
+
+/*
+** `mpc_parse_view_range` parses only the part of a view
+** from `start` up to `end`. The state in `start` gives
+** the position, row and column to count on from, so the
+** AST and errors refer to the view as a whole.
+*/
+
+int mpc_parse_view_range(const char *filename, const char *string, mpc_state_t start, long end, mpc_parser_t *p, mpc_arena_t *a, mpc_result_t *r);
+
+/*
+** A stream parses a file, pipe or string one result at a time,
+** skipping whitespace between them, so a caller can act
+** on each as soon as it is read. Pipes are read a line
+** at a time. A parse that fails at the end of what has
+** been read is tried again with the next line, so a
+** result may run over many lines, but one that is
+** already complete at a line break is taken as it is,
+** even if the next line could have extended it. With
+** an arena each result lives there
+** and should be dropped with `mpc_arena_clear` before
+** the stream is used again. After a failed
+** `mpc_stream_next` the stream should be deleted.
+** `mpc_stream_view` borrows its string, which must
+** outlive the stream. `mpc_stream_view_range` streams
+** only the part of it from `start` up to `end`, counting
+** positions on from `start` as `mpc_parse_view_range`
+** does.
+**
+** `mpc_stream_bound` gives a stream reading lines a
+** function to say whether a result could end in each
+** line. It is passed the line as it is read, along
+** with `state` to keep between lines, and returns
+** nonzero if a result could end anywhere in it - at
+** a point where every bracket opened is closed, say.
+** The stream parses only after such a line, so one
+** result running over many lines is parsed once
+** rather than again for every line. Streams which
+** do not read lines ignore it.
+*/
+
+struct mpc_stream_t;
+typedef struct mpc_stream_t mpc_stream_t;
+typedef int(*mpc_bound_t)(const char*,long,void*);
+
+mpc_stream_t *mpc_stream_pipe(const char *filename, FILE *pipe, mpc_arena_t *a);
+mpc_stream_t *mpc_stream_contents(const char *filename, mpc_arena_t *a);
+mpc_stream_t *mpc_stream_view(const char *filename, const char *string, long length, mpc_arena_t *a);
+mpc_stream_t *mpc_stream_view_range(const char *filename, const char *string, mpc_state_t start, long end, mpc_arena_t *a);
+void mpc_stream_bound(mpc_stream_t *s, mpc_bound_t f, void *state);
+int mpc_stream_done(mpc_stream_t *s);
+int mpc_stream_next(mpc_stream_t *s, mpc_parser_t *p, mpc_result_t *r);
+void mpc_stream_delete(mpc_stream_t *s);
+
 /*
 ** Function Types
 */
@@ -80,6 +193,7 @@ typedef mpc_val_t*(*mpc_ctor_t)(void);
 typedef mpc_val_t*(*mpc_apply_t)(mpc_val_t*);
 typedef mpc_val_t*(*mpc_apply_to_t)(mpc_val_t*,void*);
 typedef mpc_val_t*(*mpc_fold_t)(int,mpc_val_t**);
+typedef long(*mpc_scan_t)(const char*,long,long*);
 
 /*
 ** Building a Parser
@@ -264,6 +378,7 @@ mpc_parser_t *mpc_re(const char *re);
 typedef struct mpc_ast_t {
   char *tag;
   char *contents;
+  long contents_len;
   mpc_state_t state;
   int children_num;
   struct mpc_ast_t** children;
@@ -278,6 +393,8 @@ mpc_ast_t *mpc_ast_add_root_tag(mpc_ast_t *a, const char *t);
 mpc_ast_t *mpc_ast_tag(mpc_ast_t *a, const char *t);
 mpc_ast_t *mpc_ast_state(mpc_ast_t *a, mpc_state_t s);
 
+int mpc_ast_contents_eq(mpc_ast_t *a, const char *s);
+
 void mpc_ast_delete(mpc_ast_t *a);
 void mpc_ast_print(mpc_ast_t *a);
 void mpc_ast_print_to(mpc_ast_t *a, FILE *fp);
@@ -321,6 +438,20 @@ mpc_parser_t *mpca_root(mpc_parser_t *a);
 mpc_parser_t *mpca_state(mpc_parser_t *a);
 mpc_parser_t *mpca_total(mpc_parser_t *a);
 
+/*
+** `mpca_scan` matches a token with a plain function
+** instead of parsers. Given the `n` bytes from the
+** position it returns how many it consumes, or `-1`,
+** with the length of the token itself in `*len`. The
+** result is the token as an AST tagged `t` with its
+** state, so `x` must give the same - as the rules
+** `mpc_codegen` writes it for do. `x` runs instead
+** where there is no string to hand the function, and
+** when it fails, so errors are unchanged.
+*/
+
+mpc_parser_t *mpca_scan(mpc_scan_t f, const char *t, mpc_parser_t *x);
+
 mpc_parser_t *mpca_not(mpc_parser_t *a);
 mpc_parser_t *mpca_maybe(mpc_parser_t *a);
 
@@ -351,8 +482,42 @@ mpc_err_t *mpca_lang_contents(int flags, const char *filename, ...);
 
 void mpc_print(mpc_parser_t *p);
 void mpc_optimise(mpc_parser_t *p);
+
+/*
+** Writes C for a function `name` which takes the given
+** retained parsers, in order, and defines each of them
+** as it is now. Returns zero if some part cannot be
+** written out, see the notes in mpc.c. The function
+** ends with `mpc_analyse_grammar`, which prepares a
+** set of parsers built by hand the way `mpca_lang`
+** prepares its own. Token parsers in the shape
+** `mpca_lang` gives a regex are written out as
+** `mpca_scan` with a byte loop of their own.
+*/
+int mpc_codegen(FILE *f, const char *name, int n, mpc_parser_t **ps);
+void mpc_analyse_grammar(int n, mpc_parser_t **ps);
 void mpc_stats(mpc_parser_t *p);
 
+/*
+** Profiling
+**
+** While enabled every parse counts, for each named
+** parser, its calls, successes and failures, the
+** bytes it matched, how often it moved the input
+** back, and the time spent in it. Rewinds and self
+** time leave out the named parsers it calls, total
+** time includes them. Reports list the rules by
+** self time, as a table or as a JSON array. The
+** counts are shared and not locked, so profile one
+** parse at a time.
+*/
+
+void mpc_profile_enable(int on);
+void mpc_profile_reset(void);
+void mpc_profile_print(void);
+void mpc_profile_print_to(FILE *f);
+void mpc_profile_json_to(FILE *f);
+
 int mpc_test_pass(mpc_parser_t *p, const char *s, const void *d,
   int(*tester)(const void*, const void*), 
   mpc_dtor_t destructor, 
@@ -0,0 +1,117 @@
+// Turns an mpca grammar into C ahead of time
+//
+//   mpc_codegen name grammar.mpca > GRAMMAR.h
+//
+// The output defines a function `name` taking the grammar's parsers in
+// the order their rules appear, and building them without mpca_lang.
+
+#include "mpc.h"
+
+enum { CODEGEN_RULES_MAX = 32 };
+
+// Find the names of the rules, each is the identifier starting a statement
+int codegen_rules(char* text, char** names) {
+	int n = 0;
+	char* c = text;
+
+	while (*c) {
+		while (*c && isspace((unsigned char)*c)) c++;
+		if (!*c) break;
+
+		if (n == CODEGEN_RULES_MAX) return -1;
+
+		char* start = c;
+		while (*c && (isalnum((unsigned char)*c) || *c == '_')) c++;
+		if (c == start) return -1;
+
+		names[n] = malloc(c - start + 1);
+		memcpy(names[n], start, c - start);
+		names[n][c - start] = '\0';
+		n++;
+
+		// Skip to the end of the statement, over literals which may hold a ';'
+		while (*c && *c != ';') {
+			if (*c == '"' || *c == '\'' || *c == '/') {
+				char quote = *c++;
+				while (*c && *c != quote) {
+					if (*c == '\\' && c[1]) c++;
+					c++;
+				}
+			}
+			if (*c) c++;
+		}
+		if (*c) c++;
+	}
+
+	return n;
+}
+
+char* codegen_read(char* filename) {
+	FILE* f = fopen(filename, "rb");
+	if (!f) return NULL;
+
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	char* text = malloc(size + 1);
+	size = (long)fread(text, 1, size, f);
+	text[size] = '\0';
+	fclose(f);
+
+	return text;
+}
+
+int main(int argc, char** argv) {
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s name grammar.mpca\n", argv[0]);
+		return 1;
+	}
+
+	char* text = codegen_read(argv[2]);
+	if (!text) {
+		fprintf(stderr, "%s: could not read %s\n", argv[0], argv[2]);
+		return 1;
+	}
+
+	char* names[CODEGEN_RULES_MAX];
+	int n = codegen_rules(text, names);
+	if (n <= 0) {
+		fprintf(stderr, "%s: could not find the rules of %s\n", argv[0], argv[2]);
+		return 1;
+	}
+
+	// mpca_lang takes its parsers as arguments, unused ones end the list
+	mpc_parser_t* ps[CODEGEN_RULES_MAX + 1] = { NULL };
+	for (int i = 0; i < n; i++) ps[i] = mpc_new(names[i]);
+
+	mpc_err_t* err = mpca_lang(MPCA_LANG_DEFAULT, text,
+		ps[0], ps[1], ps[2], ps[3], ps[4], ps[5], ps[6], ps[7],
+		ps[8], ps[9], ps[10], ps[11], ps[12], ps[13], ps[14], ps[15],
+		ps[16], ps[17], ps[18], ps[19], ps[20], ps[21], ps[22], ps[23],
+		ps[24], ps[25], ps[26], ps[27], ps[28], ps[29], ps[30], ps[31], NULL);
+
+	if (err) {
+		mpc_err_print_to(err, stderr);
+		mpc_err_delete(err);
+		return 1;
+	}
+
+	printf("/*\n** Generated by mpc_codegen from %s, do not edit.\n*/\n\n", argv[2]);
+	int ok = mpc_codegen(stdout, argv[1], n, ps);
+
+	// Rules refer to each other, so all go undefined before any is deleted
+	for (int i = 0; i < n; i++) mpc_undefine(ps[i]);
+	for (int i = 0; i < n; i++) {
+		mpc_delete(ps[i]);
+		free(names[i]);
+	}
+	free(text);
+
+	if (!ok) {
+		fprintf(stderr, "%s: %s has parts which cannot be generated\n", argv[0], argv[2]);
+		return 1;
+	}
+
+	return 0;
+}
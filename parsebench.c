@@ -0,0 +1,309 @@
+// Parser throughput benchmark
+//
+//   parsebench [--size BYTES] [--depth N] [--runs N] [--seed N]
+//              [--symbols W] [--numbers W] [--strings W] [--comments W]
+//              [--profile table|json]
+//
+// Generates a Lipl source of about BYTES bytes, lists nested at most N
+// deep, and atoms drawn in proportion to the weights W. Then it parses
+// the source through each of mpc's entry points and prints one JSON
+// object per line with the throughput, the pool allocations per KB of
+// input and the peak resident set so far. With --profile the per-rule
+// counts over all the parses go to stderr afterwards, which slows the
+// parses down, so the throughput is not comparable then.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#include "mpc.h"
+#include "GRAMMAR.h"
+
+typedef struct {
+	long size;
+	int depth;
+	int runs;
+	unsigned long seed;
+	int weights[4];
+	const char* profile;
+} bench_options;
+
+enum { BENCH_SYMBOL, BENCH_NUMBER, BENCH_STRING, BENCH_COMMENT };
+
+typedef struct {
+	char* data;
+	long length;
+	long slots;
+	unsigned long state;
+} bench_source;
+
+mpc_parser_t* Number;
+mpc_parser_t* Symbol;
+mpc_parser_t* String;
+mpc_parser_t* Comment;
+mpc_parser_t* Sexpr;
+mpc_parser_t* Qexpr;
+mpc_parser_t* Expr;
+mpc_parser_t* Lipl;
+
+// xorshift, so a seed gives the same source everywhere
+unsigned long bench_rand(bench_source* s) {
+	s->state ^= s->state << 13;
+	s->state ^= s->state >> 7;
+	s->state ^= s->state << 17;
+	return s->state;
+}
+
+int bench_below(bench_source* s, int n) {
+	return (int)(bench_rand(s) % (unsigned long)n);
+}
+
+void bench_put(bench_source* s, const char* text, long length) {
+	if (s->length + length + 1 > s->slots) {
+		while (s->length + length + 1 > s->slots) s->slots *= 2;
+		s->data = realloc(s->data, s->slots);
+	}
+	memcpy(s->data + s->length, text, length);
+	s->length += length;
+	s->data[s->length] = '\0';
+}
+
+void bench_puts(bench_source* s, const char* text) {
+	bench_put(s, text, (long)strlen(text));
+}
+
+void bench_atom(bench_source* s, bench_options* o) {
+	static const char* symbols[] = {
+		"def", "fun", "if", "head", "tail", "list", "join", "eval",
+		"+", "-", "*", "/", "==", "!=", "<=", ">", "x", "xs", "acc", "map",
+	};
+	static const char chars[] = "abcdefghijklmnopqrstuvwxyz ABCDEFGHIJ0123456789(){};";
+
+	int total = o->weights[0] + o->weights[1] + o->weights[2] + o->weights[3];
+	int pick = bench_below(s, total);
+	int kind = 0;
+	while (pick >= o->weights[kind]) pick -= o->weights[kind++];
+
+	char buffer[64];
+	int n;
+
+	switch (kind) {
+		case BENCH_SYMBOL:
+			bench_puts(s, symbols[bench_below(s, sizeof(symbols) / sizeof(symbols[0]))]);
+			break;
+
+		case BENCH_NUMBER:
+			n = snprintf(buffer, sizeof(buffer), "%s%lu", bench_below(s, 8) ? "" : "-", bench_rand(s) % 100000);
+			bench_put(s, buffer, n);
+			break;
+
+		case BENCH_STRING:
+			bench_puts(s, "\"");
+			for (n = bench_below(s, 24); n > 0; n--) {
+				if (bench_below(s, 16) == 0) bench_puts(s, "\\\"");
+				else bench_put(s, &chars[bench_below(s, sizeof(chars) - 1)], 1);
+			}
+			bench_puts(s, "\"");
+			break;
+
+		case BENCH_COMMENT:
+			bench_puts(s, "; ");
+			for (n = bench_below(s, 40); n > 0; n--) {
+				bench_put(s, &chars[bench_below(s, sizeof(chars) - 1)], 1);
+			}
+			bench_puts(s, "\n");
+			break;
+	}
+}
+
+void bench_form(bench_source* s, bench_options* o, int depth) {
+	int q = depth > 1 && bench_below(s, 4) == 0;
+	bench_puts(s, q ? "{" : "(");
+
+	int n = 1 + bench_below(s, 6);
+	for (int i = 0; i < n; i++) {
+		if (i) bench_puts(s, bench_below(s, 8) ? " " : "\n\t");
+		if (depth < o->depth && bench_below(s, 3) == 0) bench_form(s, o, depth + 1);
+		else bench_atom(s, o);
+	}
+
+	bench_puts(s, q ? "}" : ")");
+}
+
+bench_source bench_generate(bench_options* o) {
+	bench_source s;
+	s.slots = 4096;
+	s.data = malloc(s.slots);
+	s.data[0] = '\0';
+	s.length = 0;
+	s.state = o->seed ? o->seed : 1;
+
+	while (s.length < o->size) {
+		bench_form(&s, o, 1);
+		bench_puts(&s, "\n");
+	}
+
+	return s;
+}
+
+double bench_now(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+long bench_peak_rss(void) {
+	struct rusage u;
+	getrusage(RUSAGE_SELF, &u);
+	return u.ru_maxrss;
+}
+
+enum { BENCH_PARSE, BENCH_CONTENTS, BENCH_PIPE, BENCH_VIEW, BENCH_METHODS };
+
+const char* bench_methods[] = {
+	"mpc_parse", "mpc_parse_contents", "mpc_parse_pipe", "mpc_parse_contents_view"
+};
+
+// One parse through the given entry point, the tree is dropped straight away
+int bench_parse(int method, bench_source* s, char* path, mpc_arena_t* arena) {
+	mpc_result_t r;
+	int ok = 0;
+	FILE* f;
+	char command[4096];
+
+	switch (method) {
+		case BENCH_PARSE:
+			ok = mpc_parse(path, s->data, Lipl, &r);
+			break;
+
+		case BENCH_CONTENTS:
+			ok = mpc_parse_contents(path, Lipl, &r);
+			break;
+
+		case BENCH_PIPE:
+			snprintf(command, sizeof(command), "cat '%s'", path);
+			f = popen(command, "r");
+			if (!f) return 0;
+			ok = mpc_parse_pipe(path, f, Lipl, &r);
+			pclose(f);
+			break;
+
+		case BENCH_VIEW:
+			ok = mpc_parse_contents_view(path, Lipl, arena, &r);
+			break;
+	}
+
+	if (!ok) {
+		mpc_err_print_to(r.error, stderr);
+		mpc_err_delete(r.error);
+		return 0;
+	}
+
+	if (method == BENCH_VIEW) mpc_arena_clear(arena);
+	else mpc_ast_delete(r.output);
+	return 1;
+}
+
+int bench_option(int argc, char** argv, bench_options* o) {
+	for (int i = 1; i < argc; i += 2) {
+		if (i + 1 == argc) return 0;
+
+		if (strcmp(argv[i], "--profile") == 0) {
+			if (strcmp(argv[i+1], "table") != 0 && strcmp(argv[i+1], "json") != 0) return 0;
+			o->profile = argv[i+1];
+			continue;
+		}
+
+		long v = strtol(argv[i+1], NULL, 10);
+		if (v < 0) return 0;
+
+		if (strcmp(argv[i], "--size") == 0) o->size = v;
+		else if (strcmp(argv[i], "--depth") == 0) o->depth = (int)v;
+		else if (strcmp(argv[i], "--runs") == 0) o->runs = (int)v;
+		else if (strcmp(argv[i], "--seed") == 0) o->seed = (unsigned long)v;
+		else if (strcmp(argv[i], "--symbols") == 0) o->weights[BENCH_SYMBOL] = (int)v;
+		else if (strcmp(argv[i], "--numbers") == 0) o->weights[BENCH_NUMBER] = (int)v;
+		else if (strcmp(argv[i], "--strings") == 0) o->weights[BENCH_STRING] = (int)v;
+		else if (strcmp(argv[i], "--comments") == 0) o->weights[BENCH_COMMENT] = (int)v;
+		else return 0;
+	}
+
+	return o->depth > 0 && o->runs > 0
+		&& o->weights[0] + o->weights[1] + o->weights[2] + o->weights[3] > 0;
+}
+
+int main(int argc, char** argv) {
+	bench_options o = { 256 << 10, 4, 5, 1, { 50, 30, 15, 5 }, NULL };
+
+	if (!bench_option(argc, argv, &o)) {
+		fprintf(stderr,
+			"usage: %s [--size BYTES] [--depth N] [--runs N] [--seed N]\n"
+			"       [--symbols W] [--numbers W] [--strings W] [--comments W]\n"
+			"       [--profile table|json]\n", argv[0]);
+		return 1;
+	}
+
+	Number = mpc_new("number");
+	Symbol = mpc_new("symbol");
+	String = mpc_new("string");
+	Comment = mpc_new("comment");
+	Sexpr  = mpc_new("sexpr");
+	Qexpr  = mpc_new("qexpr");
+	Expr   = mpc_new("expr");
+	Lipl   = mpc_new("lipl");
+	lipl_grammar(Number, Symbol, String, Comment, Sexpr, Qexpr, Expr, Lipl);
+
+	bench_source s = bench_generate(&o);
+
+	// The file entry points read the same source back from disk
+	char path[] = "/tmp/parsebench-XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0 || write(fd, s.data, s.length) != s.length) {
+		fprintf(stderr, "%s: could not write %s\n", argv[0], path);
+		return 1;
+	}
+	close(fd);
+
+	mpc_arena_t* arena = mpc_arena_new();
+	int failed = 0;
+
+	if (o.profile) mpc_profile_enable(1);
+
+	for (int m = 0; m < BENCH_METHODS && !failed; m++) {
+		mpc_mem_stats_t before, after;
+		double best = 0;
+
+		mpc_mem_stats(&before);
+		for (int k = 0; k < o.runs; k++) {
+			double start = bench_now();
+			if (!bench_parse(m, &s, path, arena)) { failed = 1; break; }
+			double t = bench_now() - start;
+			if (k == 0 || t < best) best = t;
+		}
+		mpc_mem_stats(&after);
+		if (failed) break;
+
+		double kb = s.length / 1024.0;
+		printf("{\"method\": \"%s\", \"bytes\": %ld, \"depth\": %d, \"runs\": %d, "
+			"\"mb_per_s\": %.2f, \"allocs_per_kb\": %.1f, \"fallbacks_per_kb\": %.2f, "
+			"\"peak_rss_kb\": %ld}\n",
+			bench_methods[m], s.length, o.depth, o.runs,
+			s.length / best / (1024.0 * 1024.0),
+			(after.allocs - before.allocs) / kb / o.runs,
+			(after.fallbacks - before.fallbacks) / kb / o.runs,
+			bench_peak_rss());
+		fflush(stdout);
+	}
+
+	if (o.profile && strcmp(o.profile, "json") == 0) mpc_profile_json_to(stderr);
+	else if (o.profile) mpc_profile_print_to(stderr);
+	mpc_profile_reset();
+
+	unlink(path);
+	mpc_arena_delete(arena);
+	mpc_cleanup(8, Number, Symbol, String, Comment, Sexpr, Qexpr, Expr, Lipl);
+	free(s.data);
+
+	return failed;
+}
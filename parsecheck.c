@@ -0,0 +1,173 @@
+// Parser differential check
+//
+//   parsecheck [--runs N] [--seed N]
+//
+// Parses N short random inputs of brackets, quotes, escapes and NUL bytes
+// with the Lipl grammar through mpc_parse_view, which is given the input
+// with its length, and through each entry point which reads it from a
+// file. Every one has to give the same tree or error as mpc_parse_view,
+// and each input where one does not is printed in hex with both results.
+// Exits nonzero if there were any.
+//
+// Trees are compared by their tags and positions. Contents are left out,
+// as a view keeps a NUL byte where the other entry points drop it.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <unistd.h>
+#include "mpc.h"
+#include "GRAMMAR.h"
+
+mpc_parser_t* Lipl;
+
+enum { CHECK_VIEW, CHECK_CONTENTS, CHECK_ARENA, CHECK_FILE, CHECK_PIPE, CHECK_METHODS };
+
+const char* check_methods[] = {
+	"mpc_parse_view", "mpc_parse_contents", "mpc_parse_contents_arena",
+	"mpc_parse_file", "mpc_parse_pipe"
+};
+
+// xorshift, so a seed gives the same inputs everywhere
+unsigned long check_rand(unsigned long* state) {
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+void check_print(mpc_ast_t* a, int depth, FILE* f) {
+	fprintf(f, "%*s%s %ld:%ld\n", depth * 2, "", a->tag, a->state.row + 1, a->state.col + 1);
+	for (int i = 0; i < a->children_num; i++) check_print(a->children[i], depth + 1, f);
+}
+
+// What one entry point made of the input, as its tree or error printed
+char* check_parse(int method, const char* input, long length, char* path, mpc_arena_t* arena) {
+	mpc_result_t r;
+	int ok = 0;
+	FILE* f = NULL;
+	char* out = NULL;
+	size_t size = 0;
+
+	if (method == CHECK_FILE || method == CHECK_PIPE) {
+		f = fopen(path, "rb");
+		if (!f) return NULL;
+	}
+
+	// Every entry point is given the same name, which the errors print
+	switch (method) {
+		case CHECK_VIEW:
+			ok = mpc_parse_view(path, input, length, Lipl, arena, &r);
+			break;
+
+		case CHECK_CONTENTS:
+			ok = mpc_parse_contents(path, Lipl, &r);
+			break;
+
+		case CHECK_ARENA:
+			ok = mpc_parse_contents_arena(path, Lipl, arena, &r);
+			break;
+
+		case CHECK_FILE:
+			ok = mpc_parse_file(path, f, Lipl, &r);
+			break;
+
+		case CHECK_PIPE:
+			ok = mpc_parse_pipe(path, f, Lipl, &r);
+			break;
+	}
+
+	if (f) fclose(f);
+
+	FILE* o = open_memstream(&out, &size);
+	if (ok) check_print(r.output, 0, o);
+	else mpc_err_print_to(r.error, o);
+	fclose(o);
+
+	if (!ok) mpc_err_delete(r.error);
+	else if (method == CHECK_VIEW || method == CHECK_ARENA) mpc_arena_clear(arena);
+	else mpc_ast_delete(r.output);
+
+	return out;
+}
+
+int main(int argc, char** argv) {
+	// NUL comes up twice as often as anything else
+	static const char chars[] = "\0\0\"\\(){};a1- \n";
+
+	long runs = 2000;
+	unsigned long seed = 1;
+
+	for (int i = 1; i < argc; i += 2) {
+		long v = i + 1 < argc ? strtol(argv[i+1], NULL, 10) : -1;
+		if (v < 0) runs = -1;
+		else if (strcmp(argv[i], "--runs") == 0) runs = v;
+		else if (strcmp(argv[i], "--seed") == 0) seed = (unsigned long)v;
+		else runs = -1;
+	}
+
+	if (runs < 0) {
+		fprintf(stderr, "usage: %s [--runs N] [--seed N]\n", argv[0]);
+		return 1;
+	}
+
+	mpc_parser_t* Number = mpc_new("number");
+	mpc_parser_t* Symbol = mpc_new("symbol");
+	mpc_parser_t* String = mpc_new("string");
+	mpc_parser_t* Comment = mpc_new("comment");
+	mpc_parser_t* Sexpr  = mpc_new("sexpr");
+	mpc_parser_t* Qexpr  = mpc_new("qexpr");
+	mpc_parser_t* Expr   = mpc_new("expr");
+	Lipl = mpc_new("lipl");
+	lipl_grammar(Number, Symbol, String, Comment, Sexpr, Qexpr, Expr, Lipl);
+
+	// The file entry points read each input back from disk
+	char path[] = "/tmp/parsecheck-XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0) {
+		fprintf(stderr, "%s: could not create %s\n", argv[0], path);
+		return 1;
+	}
+	close(fd);
+
+	mpc_arena_t* arena = mpc_arena_new();
+	unsigned long state = seed ? seed : 1;
+	long failed = 0;
+	char input[16];
+
+	for (long k = 0; k < runs; k++) {
+		long length = 1 + (long)(check_rand(&state) % sizeof(input));
+		for (long j = 0; j < length; j++) {
+			input[j] = chars[check_rand(&state) % (sizeof(chars) - 1)];
+		}
+
+		FILE* f = fopen(path, "wb");
+		if (!f || fwrite(input, 1, length, f) != (size_t)length || fclose(f) != 0) {
+			fprintf(stderr, "%s: could not write %s\n", argv[0], path);
+			failed++;
+			break;
+		}
+
+		char* expected = check_parse(CHECK_VIEW, input, length, path, arena);
+
+		for (int m = CHECK_VIEW + 1; m < CHECK_METHODS; m++) {
+			char* got = check_parse(m, input, length, path, arena);
+			if (!got || strcmp(got, expected) != 0) {
+				failed++;
+				printf("input");
+				for (long j = 0; j < length; j++) printf(" %02x", (unsigned char)input[j]);
+				printf("\n%s:\n%s%s:\n%s\n", check_methods[CHECK_VIEW], expected, check_methods[m], got ? got : "");
+			}
+			free(got);
+		}
+
+		free(expected);
+	}
+
+	if (failed) fprintf(stderr, "%s: %ld of %ld parses differ\n", argv[0], failed, runs * (CHECK_METHODS - 1));
+
+	unlink(path);
+	mpc_arena_delete(arena);
+	mpc_cleanup(8, Number, Symbol, String, Comment, Sexpr, Qexpr, Expr, Lipl);
+
+	return failed != 0;
+}
@@ -0,0 +1,131 @@
+// Decodes a trace written by load --trace
+//
+//   tracedump trace.bin
+//
+// Prints the events of every thread merged in time order, one per line
+// with its time in microseconds before the trace was written, its thread
+// and what it names. Calls are indented by their depth on their thread.
+
+#include <stddef.h>
+#include "mpc.h"
+#include "TYPES.h"
+
+const char* trace_kinds[LTRACE_KINDS] = {
+	"enter", "exit", "builtin", "load", "loaded", "parse", "parsed", "error"
+};
+
+typedef struct {
+	ltrace_event event;
+	int thread;
+} trace_line;
+
+ltrace_ring** rings;
+int rings_num;
+
+int trace_compare(const void* a, const void* b) {
+	const trace_line* x = a;
+	const trace_line* y = b;
+	if (x->event.time != y->event.time) return x->event.time < y->event.time ? -1 : 1;
+	return x->thread - y->thread;
+}
+
+// Names are kept by the thread which first met them, so look through them all
+const char* trace_name(uint32_t id) {
+	if (id == 0) return "";
+
+	for (int k = 0; k < rings_num; k++) {
+		ltrace_symbol* names = rings[k]->names;
+		uint32_t i = id & (LTRACE_NAMES - 1);
+		for (int n = 0; n < LTRACE_NAMES && names[i].id; n++, i = (i + 1) & (LTRACE_NAMES - 1))
+			if (names[i].id == id) return names[i].name;
+	}
+
+	return "?";
+}
+
+int main(int argc, char** argv) {
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s trace.bin\n", argv[0]);
+		return 1;
+	}
+
+	FILE* f = fopen(argv[1], "rb");
+	if (!f) {
+		fprintf(stderr, "%s: could not read %s\n", argv[0], argv[1]);
+		return 1;
+	}
+
+	ltrace_header h;
+	if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, "LPLT", 4) != 0
+		|| h.order != LTRACE_ORDER || h.version != LTRACE_VERSION
+		|| h.events != LTRACE_EVENTS || h.names != LTRACE_NAMES || h.rings < 0) {
+		fprintf(stderr, "%s: %s is not a trace this build can read\n", argv[0], argv[1]);
+		fclose(f);
+		return 1;
+	}
+
+	// Each ring was written from its thread on
+	long size = sizeof(ltrace_ring) - offsetof(ltrace_ring, thread);
+	rings = malloc(sizeof(ltrace_ring*) * (h.rings + 1));
+	long total = 0;
+
+	for (rings_num = 0; rings_num < h.rings; rings_num++) {
+		ltrace_ring* r = malloc(sizeof(ltrace_ring));
+		if (fread(&r->thread, size, 1, f) != 1) {
+			free(r);
+			break;
+		}
+		rings[rings_num] = r;
+		total += r->next < LTRACE_EVENTS ? (long)r->next : LTRACE_EVENTS;
+	}
+	fclose(f);
+
+	if (rings_num < h.rings)
+		fprintf(stderr, "%s: %s is cut short, %d of %d threads read\n", argv[0], argv[1], rings_num, h.rings);
+
+	// Once a ring has wrapped its oldest event is the next to be overwritten
+	trace_line* lines = malloc(sizeof(trace_line) * (total + 1));
+	long n = 0;
+	for (int k = 0; k < rings_num; k++) {
+		ltrace_ring* r = rings[k];
+		uint64_t first = r->next > LTRACE_EVENTS ? r->next - LTRACE_EVENTS : 0;
+		for (uint64_t i = first; i < r->next; i++) {
+			lines[n].event = r->events[i & (LTRACE_EVENTS - 1)];
+			lines[n].thread = r->thread;
+			n++;
+		}
+	}
+	qsort(lines, n, sizeof(trace_line), trace_compare);
+
+	// Ticks between the start of tracing and the write give the rate
+	double ns_per_tick = h.ticks[1] > h.ticks[0]
+		? (double)(h.ns[1] - h.ns[0]) / (double)(h.ticks[1] - h.ticks[0]) : 1.0;
+
+	int threads = 0;
+	for (int k = 0; k < rings_num; k++)
+		if (rings[k]->thread >= threads) threads = rings[k]->thread + 1;
+	int* depth = calloc(threads + 1, sizeof(int));
+
+	printf("%ld events on %d threads\n", n, rings_num);
+	printf("%14s %6s  %s\n", "us before", "thread", "event");
+
+	for (long i = 0; i < n; i++) {
+		ltrace_event* ev = &lines[i].event;
+		int t = lines[i].thread;
+		if (ev->kind == LTRACE_EXIT && depth[t] > 0) depth[t]--;
+
+		const char* kind = ev->kind < LTRACE_KINDS ? trace_kinds[ev->kind] : "unknown";
+		double us = (double)(int64_t)(h.ticks[1] - ev->time) * ns_per_tick / 1e3;
+
+		printf("%14.3f %6d  %*s%-8s %s\n", us, t, 2 * depth[t], "", kind, trace_name(ev->id));
+
+		if (ev->kind == LTRACE_ENTER) depth[t]++;
+	}
+
+	free(depth);
+	free(lines);
+	for (int k = 0; k < rings_num; k++) free(rings[k]);
+	free(rings);
+
+	return 0;
+}